@@ -0,0 +1,461 @@
+﻿#include "BatchProcessor.h"
+#include "WaferConfig.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <direct.h>
+
+using namespace cv;
+using namespace std;
+
+// ---------------------------------------------------------------- BatchStats
+
+void BatchStats::Moments::add(double x) {
+    n++;
+    double delta = x - mean;
+    mean += delta / n;
+    m2 += delta * (x - mean);
+}
+
+void BatchStats::Moments::merge(const Moments& o) {
+    if (o.n == 0) return;
+    if (n == 0) {
+        *this = o;
+        return;
+    }
+    int64_t total = n + o.n;
+    double delta = o.mean - mean;
+    mean += delta * o.n / total;
+    m2 += o.m2 + delta * delta * ((double)n * o.n / total);
+    n = total;
+}
+
+void BatchStats::add(const FrameResult& r) {
+    total++;
+    if (r.status == FRAME_FAIL) {
+        failed++;
+        return;
+    }
+    if (r.status == FRAME_REJECTED) {
+        rejected++;
+        return;
+    }
+    if (r.status == FRAME_PASS) passed++;
+    else warned++;
+
+    errX.add(r.errX);
+    errY.add(r.errY);
+    double e = std::max(r.errX, r.errY);
+    maxError = std::max(maxError, e);
+    hist[std::min(HIST_BINS, (int)(e / HIST_BIN_WIDTH))]++;
+}
+
+void BatchStats::merge(const BatchStats& other) {
+    total += other.total;
+    passed += other.passed;
+    warned += other.warned;
+    failed += other.failed;
+    rejected += other.rejected;
+    maxError = std::max(maxError, other.maxError);
+    errX.merge(other.errX);
+    errY.merge(other.errY);
+    for (int i = 0; i <= HIST_BINS; ++i) hist[i] += other.hist[i];
+}
+
+bool BatchStats::save(const std::string& path) const {
+    // 先写临时文件再改名，协调器看到的统计文件总是完整的
+    string tmp = path + ".tmp";
+    {
+        ofstream ofs(tmp, ios::trunc);
+        if (!ofs) return false;
+        ofs << setprecision(17);
+        ofs << "total " << total << "\npassed " << passed << "\nwarned " << warned << "\nfailed " << failed
+            << "\nrejected " << rejected
+            << "\nmaxError " << maxError
+            << "\nerrX " << errX.n << " " << errX.mean << " " << errX.m2
+            << "\nerrY " << errY.n << " " << errY.mean << " " << errY.m2
+            << "\nhist";
+        for (int i = 0; i <= HIST_BINS; ++i) ofs << " " << hist[i];
+        ofs << "\n";
+        if (!ofs.good()) return false;
+    }
+    std::remove(path.c_str());
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool BatchStats::load(const std::string& path) {
+    ifstream ifs(path);
+    if (!ifs) return false;
+
+    *this = BatchStats();
+    string key;
+    while (ifs >> key) {
+        if (key == "total") ifs >> total;
+        else if (key == "passed") ifs >> passed;
+        else if (key == "warned") ifs >> warned;
+        else if (key == "failed") ifs >> failed;
+        else if (key == "rejected") ifs >> rejected;
+        else if (key == "maxError") ifs >> maxError;
+        else if (key == "errX") ifs >> errX.n >> errX.mean >> errX.m2;
+        else if (key == "errY") ifs >> errY.n >> errY.mean >> errY.m2;
+        else if (key == "hist") { for (int i = 0; i <= HIST_BINS; ++i) ifs >> hist[i]; }
+        else return false;
+    }
+    return true;
+}
+
+double BatchStats::percentile(double q) const {
+    int64_t n = passed + warned;
+    if (n == 0) return 0.0;
+    int64_t target = (int64_t)std::ceil(q * n), acc = 0;
+    for (int i = 0; i < HIST_BINS; ++i) {
+        acc += hist[i];
+        if (acc >= target) return (i + 1) * HIST_BIN_WIDTH;   // 所在档的上界
+    }
+    return maxError;
+}
+
+void BatchStats::printSummary() const {
+    cout << "\n[Summary] Success: " << passed << "/" << total << endl;
+    cout << "Max Error Observed: " << maxError << " px" << endl;
+
+    if (maxError < WaferConfig::PASS_TOLERANCE) {
+        cout << ">> SYSTEM VERIFIED: Algorithm matches paper's expected precision on standard steps." << endl;
+    }
+    else {
+        cout << ">> STILL HAS ERROR: Look for patterns in the table above (e.g., is error higher at 0.5?)." << endl;
+    }
+
+    cout << "[Summary] Warn: " << warned << ", Fail: " << failed << ", Rejected: " << rejected << endl;
+    cout << fixed << setprecision(4)
+        << "[Summary] Err X mean/std: " << errX.mean << " / " << errX.stddev() << " px, "
+        << "Err Y mean/std: " << errY.mean << " / " << errY.stddev() << " px" << endl;
+    cout << "[Summary] Max(ErrX, ErrY) p50/p95/p99 <= " << percentile(0.50) << " / "
+        << percentile(0.95) << " / " << percentile(0.99) << " px" << endl;
+}
+
+// ---------------------------------------------------------------- BatchProcessor
+
+BatchProcessor::BatchProcessor(const std::string& recipePath) {
+    // 配方文件映射为毫秒级；否则生成标准模板 (无偏移，50 倍超采样，秒级)，与 TraditionalMethodTest 相同
+    if (recipePath.empty() || !localization.loadRecipe(recipePath)) {
+        localization.createTemplate(Mat(), Rect(0, 0, 0, 0));
+    }
+}
+
+bool BatchProcessor::loadManifest(const std::string& path, std::vector<FrameJob>& jobs) {
+    ifstream ifs(path);
+    if (!ifs) {
+        cerr << "[Batch] Cannot open manifest: " << path << endl;
+        return false;
+    }
+
+    jobs.clear();
+    string line;
+    int lineNo = 0;
+    while (getline(ifs, line)) {
+        lineNo++;
+        if (line.empty() || line[0] == '#') continue;
+
+        istringstream ss(line);
+        string kind;
+        FrameJob job;
+        ss >> kind;
+        if (kind == "sim") {
+            ss >> job.id >> job.imageSize >> job.shiftX >> job.shiftY >> job.noise >> job.angle;
+        }
+        else if (kind == "file") {
+            ss >> job.id >> job.imagePath >> job.shiftX >> job.shiftY;
+        }
+        else {
+            cerr << "[Batch] Unknown job type at line " << lineNo << ": " << kind << endl;
+            return false;
+        }
+        if (ss.fail()) {
+            cerr << "[Batch] Malformed job at line " << lineNo << endl;
+            return false;
+        }
+        // 可选的配方 id
+        int recipeId;
+        if (ss >> recipeId) job.recipeId = recipeId;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+bool BatchProcessor::saveManifest(const std::string& path, const std::vector<FrameJob>& jobs) {
+    ofstream ofs(path, ios::trunc);
+    if (!ofs) return false;
+
+    ofs << "# sim  <id> <size> <shiftX> <shiftY> <noise> <angle> [recipeId]\n";
+    ofs << "# file <id> <path> <trueShiftX> <trueShiftY> [recipeId]\n";
+    ofs << setprecision(17);
+    for (const FrameJob& j : jobs) {
+        if (j.imagePath.empty()) {
+            ofs << "sim " << j.id << " " << j.imageSize << " " << j.shiftX << " " << j.shiftY << " "
+                << j.noise << " " << j.angle << " " << j.recipeId << "\n";
+        }
+        else {
+            ofs << "file " << j.id << " " << j.imagePath << " " << j.shiftX << " " << j.shiftY << " " << j.recipeId << "\n";
+        }
+    }
+    return ofs.good();
+}
+
+std::vector<FrameJob> BatchProcessor::simulationManifest(int count, uint64_t seed, double maxShift, double maxNoise) {
+    RNG rng(seed);
+    vector<FrameJob> jobs(std::max(0, count));
+    for (int i = 0; i < (int)jobs.size(); ++i) {
+        jobs[i].id = i;
+        jobs[i].shiftX = rng.uniform(-maxShift, maxShift);
+        jobs[i].shiftY = rng.uniform(-maxShift, maxShift);
+        jobs[i].noise = rng.uniform(0.0, maxNoise);
+    }
+    return jobs;
+}
+
+cv::Mat BatchProcessor::render(const FrameJob& job) {
+    // 保留 16 位 PNG/TIFF 的原始位深，测量路径直接处理 CV_16U
+    if (!job.imagePath.empty()) return imread(job.imagePath, IMREAD_GRAYSCALE | IMREAD_ANYDEPTH);
+
+    // 每帧按 id 设种子，同一帧在任何分片/节点上渲染结果一致
+    simulator.setSeed((uint64_t)job.id + 1);
+    if (registry) {
+        auto plan = registry->find(job.recipeId);
+        if (plan) simulator.setGeometry(plan->geometry);
+    }
+    return simulator.generateWaferImage(job.imageSize, job.shiftX, job.shiftY, job.noise, job.angle);
+}
+
+bool BatchProcessor::measureCoarse(const FrameJob& job, const cv::Mat& image, FrameResult& r, int& searchLen) {
+    r = FrameResult();
+    r.id = job.id;
+    searchLen = 0;
+    if (image.empty()) return false;
+
+    // 按帧取配方计划：快照查找 + 指针比较，同一配方连续的帧没有任何准备开销
+    if (registry) {
+        auto plan = registry->find(job.recipeId);
+        if (!plan) return false;
+        localization.setPlan(plan);
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    double score = -1.0;
+    if (detector && !cascadeCoarse) {
+        r.coarsePos = localization.coarseLocalizationYolo(image, detector, &score);
+    }
+    else {
+        // 模板匹配 (全图或级联候选区域) 给出亚像素峰值与不确定度，精定位窗口按此缩短
+        CoarsePeak peak = detector ? localization.coarseLocalizationCascade(image, detector) : localization.coarsePeak(image);
+        r.coarsePos = Point(cvRound(peak.position.x), cvRound(peak.position.y));
+        score = peak.score;
+        searchLen = localization.adaptiveSearchLen(peak);
+    }
+    auto t1 = chrono::steady_clock::now();
+    r.coarseMs = chrono::duration<float, milli>(t1 - t0).count();
+
+    // 质量门控耗时计入精定位阶段；被拒绝的帧只付出粗定位 + 读 8 个窗口的代价
+    if (qualityGate && !localization.assessQuality(image, r.coarsePos, score, frameQuality)) {
+        r.status = FRAME_REJECTED;
+        r.quality = frameQuality.verdict;
+        r.fineMs = chrono::duration<float, milli>(chrono::steady_clock::now() - t1).count();
+        return false;
+    }
+    r.fineMs = chrono::duration<float, milli>(chrono::steady_clock::now() - t1).count();
+    return true;
+}
+
+void BatchProcessor::measureEdges(const FrameJob& job, const cv::Mat& image, cv::Point coarsePos,
+    unsigned edgeMask, EdgeMeasurement out[8], int searchLen) {
+    if (registry) {
+        auto plan = registry->find(job.recipeId);
+        if (!plan) return;
+        localization.setPlan(plan);
+    }
+    localization.fineEdges(image, coarsePos, SubPixelModel::SpatialMoment, edgeMask, out, searchLen);
+}
+
+void BatchProcessor::grade(const FrameJob& job, FrameResult& r) {
+    if (r.measured.x == -999.0) return;
+
+    r.errX = std::abs(r.measured.x - job.shiftX);
+    r.errY = std::abs(r.measured.y - job.shiftY);
+
+    // 严格标准: < 0.05 px
+    double tol = WaferConfig::PASS_TOLERANCE;
+    r.status = (r.errX < tol && r.errY < tol) ? FRAME_PASS : FRAME_WARN;
+}
+
+bool BatchProcessor::captureProfiles(const FrameJob& job, const cv::Mat& image, FrameProfiles& out, FrameResult* timing) {
+    FrameResult r;
+    int searchLen = 0;
+    bool ok = measureCoarse(job, image, r, searchLen);
+    if (ok) {
+        out.frameId = job.id;
+        out.truthX = job.shiftX;
+        out.truthY = job.shiftY;
+        auto t0 = chrono::steady_clock::now();
+        ok = localization.captureProfiles(image, r.coarsePos, out, searchLen);
+        r.fineMs += chrono::duration<float, milli>(chrono::steady_clock::now() - t0).count();
+    }
+    if (timing) *timing = r;
+    return ok;
+}
+
+int BatchProcessor::captureAll(const std::vector<FrameJob>& jobs, ProfileCache& cache) {
+    int captured = 0;
+    for (const FrameJob& job : jobs) {
+        FrameProfiles p;
+        if (!captureProfiles(job, render(job), p)) continue;
+        cache.put(std::move(p));
+        captured++;
+    }
+    cout << "[Profiles] Captured " << captured << "/" << jobs.size() << " frames, "
+        << fixed << setprecision(1) << cache.bytes() / 1024.0 << " KB cached" << endl;
+    return captured;
+}
+
+void BatchProcessor::compareModels(const ProfileCache& cache) {
+    Localization fitter;
+    for (SubPixelModel::ModelType type : SubPixelModel::allTypes()) {
+        BatchStats stats;
+        auto t0 = chrono::steady_clock::now();
+        for (const FrameProfiles& p : cache.frames()) {
+            FrameJob job;
+            job.id = (int)p.frameId;
+            job.shiftX = p.truthX;
+            job.shiftY = p.truthY;
+
+            FrameResult r;
+            r.id = job.id;
+            r.measured = fitter.fitProfiles(p, type);
+            grade(job, r);
+            stats.add(r);
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+        cout << "[Profiles] Model " << SubPixelModel::typeName(type) << ": " << fixed << setprecision(3)
+            << (cache.size() ? ms * 1000.0 / cache.size() : 0.0) << " us/frame (fit only)" << endl;
+        stats.printSummary();
+    }
+}
+
+FrameResult BatchProcessor::measure(const FrameJob& job, const cv::Mat& image) {
+    FrameResult r;
+    int searchLen = 0;
+    if (!measureCoarse(job, image, r, searchLen)) return r;
+
+    auto t1 = chrono::steady_clock::now();
+    r.measured = localization.fineLocalization(image, r.coarsePos, SubPixelModel::SpatialMoment, &edgeBuffer,
+        qualityGate ? &frameQuality : nullptr, searchLen);
+    r.fineMs += chrono::duration<float, milli>(chrono::steady_clock::now() - t1).count();
+
+    for (size_t i = 0; i < edgeBuffer.size() && i < 8; ++i) r.edges[i] = edgeBuffer[i].position;
+    grade(job, r);
+    return r;
+}
+
+ResultRecord BatchProcessor::toRecord(const FrameResult& r) {
+    ResultRecord rec;
+    rec.frameId = r.id;
+    rec.coarseX = r.coarsePos.x;
+    rec.coarseY = r.coarsePos.y;
+    for (int i = 0; i < 8; ++i) rec.edges[i] = r.edges[i];
+    rec.overlayX = r.measured.x;
+    rec.overlayY = r.measured.y;
+    rec.status = r.status;
+    rec.quality = r.quality;
+    rec.renderMs = r.renderMs;
+    rec.coarseMs = r.coarseMs;
+    rec.fineMs = r.fineMs;
+    return rec;
+}
+
+BatchStats BatchProcessor::runShard(const std::vector<FrameJob>& jobs, int shardIndex, int shardCount, ResultLog* log) {
+    BatchStats stats;
+    shardCount = std::max(1, shardCount);
+
+    auto t0 = chrono::steady_clock::now();
+    auto lastReport = t0;
+    for (size_t i = shardIndex; i < jobs.size(); i += shardCount) {
+        auto tr = chrono::steady_clock::now();
+        Mat image = render(jobs[i]);
+        float renderMs = chrono::duration<float, milli>(chrono::steady_clock::now() - tr).count();
+
+        FrameResult r = measure(jobs[i], image);
+        r.renderMs = renderMs;
+        stats.add(r);
+        if (log) log->write(toRecord(r));
+
+        auto now = chrono::steady_clock::now();
+        if (chrono::duration<double>(now - lastReport).count() >= 10.0) {
+            double sec = chrono::duration<double>(now - t0).count();
+            cout << "[Batch] Shard " << shardIndex << ": " << stats.total << " frames, "
+                << fixed << setprecision(2) << stats.total / sec << " frames/s" << endl;
+            lastReport = now;
+        }
+    }
+    return stats;
+}
+
+std::string BatchProcessor::shardStatsPath(const std::string& workDir, int shardIndex) {
+    return workDir + "/shard_" + to_string(shardIndex) + ".stats";
+}
+
+std::string BatchProcessor::shardLogPath(const std::string& workDir, int shardIndex) {
+    return workDir + "/shard_" + to_string(shardIndex) + ".olog";
+}
+
+bool BatchProcessor::runCoordinator(const std::string& exePath, const std::string& manifestPath,
+    int shards, const std::string& workDir, BatchStats& merged, const std::vector<std::string>& recipeSpecs, int sensorBits) {
+    shards = std::max(1, shards);
+    _mkdir(workDir.c_str());
+
+    // 清除上次运行的残留，避免把旧分片误当作本次结果
+    for (int s = 0; s < shards; ++s) {
+        std::remove(shardStatsPath(workDir, s).c_str());
+        std::remove(shardLogPath(workDir, s).c_str());
+    }
+
+    cout << "[Batch] Launching " << shards << " worker processes for " << manifestPath << endl;
+    auto t0 = chrono::steady_clock::now();
+
+    vector<thread> launchers;
+    vector<int> exitCodes(shards, 0);
+    for (int s = 0; s < shards; ++s) {
+        string cmd = "\"" + exePath + "\" --worker \"" + manifestPath + "\" " + to_string(s) + " " +
+            to_string(shards) + " \"" + shardStatsPath(workDir, s) + "\" \"" + shardLogPath(workDir, s) + "\"";
+        for (const string& spec : recipeSpecs) cmd += " --recipe \"" + spec + "\"";
+        if (sensorBits > 0) cmd += " --bits " + to_string(sensorBits);
+#ifdef _WIN32
+        // cmd.exe 会剥掉首尾引号，整条命令需再包一层
+        cmd = "\"" + cmd + "\"";
+#endif
+        launchers.emplace_back([cmd, s, &exitCodes] { exitCodes[s] = std::system(cmd.c_str()); });
+    }
+    for (auto& th : launchers) th.join();
+
+    merged = BatchStats();
+    bool complete = true;
+    for (int s = 0; s < shards; ++s) {
+        BatchStats part;
+        if (exitCodes[s] != 0 || !part.load(shardStatsPath(workDir, s))) {
+            cerr << "[Batch] Shard " << s << " failed (exit code " << exitCodes[s] << ")" << endl;
+            complete = false;
+            continue;
+        }
+        merged.merge(part);
+    }
+
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    cout << "[Batch] " << merged.total << " frames in " << fixed << setprecision(1) << sec << " s ("
+        << setprecision(2) << (sec > 0 ? merged.total / sec : 0.0) << " frames/s)" << endl;
+    return complete;
+}
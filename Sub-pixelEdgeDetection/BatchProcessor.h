@@ -0,0 +1,188 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include "ImageSimulator.h"
+#include "Localization.h"
+#include "ResultLog.h"
+#include "ProfileCache.h"
+
+/**
+ * @struct FrameJob
+ * @brief 批量测量中的一帧：磁盘图像或一组仿真参数。
+ *
+ * 清单 (manifest) 每行一帧，'#' 开头为注释：
+ *   sim  <id> <size> <shiftX> <shiftY> <noise> <angle> [recipeId]
+ *   file <id> <path> <trueShiftX> <trueShiftY> [recipeId]
+ * recipeId 缺省为 0 (需配合 RecipeRegistry 使用)。
+ */
+struct FrameJob {
+    int id = 0;
+    std::string imagePath;       // 非空时从磁盘读取，否则按下列参数仿真
+    int imageSize = 640;
+    double shiftX = 0.0;         // 真值偏移 (仿真输入 / 磁盘图像的标注)
+    double shiftY = 0.0;
+    double noise = 0.0;
+    double angle = 0.0;
+    int recipeId = 0;            // 该帧所用配方计划 (BatchProcessor 设置了 RecipeRegistry 时生效)
+};
+
+// REJECTED: 质量门控拒绝，未做精定位 (原因见 FrameResult::quality)
+enum FrameStatus { FRAME_PASS = 0, FRAME_WARN = 1, FRAME_FAIL = 2, FRAME_REJECTED = 3 };
+
+/**
+ * @struct FrameResult
+ * @brief 单帧测量结果。
+ */
+struct FrameResult {
+    int id = 0;
+    cv::Point coarsePos;
+    cv::Point2d measured{ -999.0, -999.0 };
+    double errX = 0.0;
+    double errY = 0.0;
+    FrameStatus status = FRAME_FAIL;
+    QualityVerdict quality = QUALITY_OK;
+    double edges[8] = { -999.0, -999.0, -999.0, -999.0, -999.0, -999.0, -999.0, -999.0 };
+    float renderMs = 0.f, coarseMs = 0.f, fineMs = 0.f;
+};
+
+/**
+ * @class BatchStats
+ * @brief 可合并的批量统计：计数、误差均值/方差 (Chan 并行合并公式) 与误差直方图。
+ *
+ * 各分片独立累计后以文本文件交换，merge 的结果与单进程顺序累计一致 (浮点舍入除外)。
+ */
+class BatchStats {
+public:
+    static constexpr int HIST_BINS = 40;           // max(errX, errY) 直方图，每档 HIST_BIN_WIDTH
+    static constexpr double HIST_BIN_WIDTH = 0.005; // 最后一档之外计入 overflow
+
+    void add(const FrameResult& r);
+    void merge(const BatchStats& other);
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    // 与 TraditionalMethodTest 相同格式的汇总，并附均值/标准差与分位数
+    void printSummary() const;
+
+    int64_t total = 0;
+    int64_t passed = 0;
+    int64_t warned = 0;
+    int64_t failed = 0;
+    int64_t rejected = 0;        // 质量门控拒绝的帧 (不计入 failed)
+    double maxError = 0.0;
+
+private:
+    struct Moments {
+        int64_t n = 0;
+        double mean = 0.0;
+        double m2 = 0.0;
+        void add(double x);
+        void merge(const Moments& o);
+        double stddev() const { return n > 1 ? std::sqrt(m2 / (n - 1)) : 0.0; }
+    };
+
+    Moments errX, errY;
+    int64_t hist[HIST_BINS + 1] = {};
+
+    double percentile(double q) const;
+};
+
+/**
+ * @class BatchProcessor
+ * @brief 批量测量：清单读写、单帧测量、分片执行，以及本机多进程协调 (代替多节点)。
+ *
+ * 多节点时各节点共享清单，分别执行 --worker <manifest> <i> <N> <stats> [log]，最后 --merge 汇总。
+ */
+class BatchProcessor {
+public:
+    // recipePath 非空时从配方文件加载模板，失败或为空则用仿真器生成标准模板
+    explicit BatchProcessor(const std::string& recipePath = "");
+
+    // 设置后粗定位改用 YOLO (检测器由调用方持有)
+    // cascade: YOLO 只给候选框，位置由框内模板匹配给出 (亚像素峰值，精定位窗口可自适应缩短)
+    void setDetector(YoloDetector* d, bool cascade = false) { detector = d; cascadeCoarse = cascade; }
+
+    // 模板匹配改用稀疏 SSDA 搜索 + 胜出位置复核，见 Localization::setSparseSearch
+    void setSparseSearch(bool enabled) { localization.setSparseSearch(enabled); }
+
+    // 16 位帧的有效位数 (默认 0 = 按帧推断)，见 Localization::setSensorBits
+    void setSensorBits(int bits) { localization.setSensorBits(bits); }
+
+    // 质量门控 (默认开启)：预检不合格的帧标记为 REJECTED，不做精定位
+    // 注意：默认阈值下测量窗口越出图像的帧判为 REJECTED (OUT_OF_VIEW)，未开门控时这类帧只裁剪窗口照常测量；
+    // 需要旧行为时调高 QualityThresholds::maxClippedWindows
+    void setQualityGate(bool enabled) { qualityGate = enabled; }
+    void setQualityThresholds(const QualityThresholds& t) { localization.setQualityThresholds(t); }
+
+    // 设置后每帧按 FrameJob::recipeId 取配方计划 (注册表由调用方持有，可跨线程共享)
+    void setRegistry(const RecipeRegistry* r) { registry = r; }
+
+    // 清单
+    static bool loadManifest(const std::string& path, std::vector<FrameJob>& jobs);
+    static bool saveManifest(const std::string& path, const std::vector<FrameJob>& jobs);
+    // 随机仿真清单 (偏移 [-maxShift, maxShift]，噪声 [0, maxNoise])，由 seed 确定
+    static std::vector<FrameJob> simulationManifest(int count, uint64_t seed, double maxShift = 2.0, double maxNoise = 5.0);
+
+    // 单帧：取得图像 (仿真或读盘) 与测量
+    cv::Mat render(const FrameJob& job);
+    FrameResult measure(const FrameJob& job, const cv::Mat& image);
+
+    // measure 的分段版本 (供 FrameScheduler 把一帧的边拆给多个线程)
+    // 粗定位 + 质量门控；返回 false 时 r 已是最终结果 (空图/无配方/被拒绝)
+    bool measureCoarse(const FrameJob& job, const cv::Mat& image, FrameResult& r, int& searchLen);
+    // 只测 edgeMask 中的边，见 Localization::fineEdges
+    void measureEdges(const FrameJob& job, const cv::Mat& image, cv::Point coarsePos,
+        unsigned edgeMask, EdgeMeasurement out[8], int searchLen);
+    // 按真值给出误差与 PASS/WARN (r.measured 无效时不变)
+    static void grade(const FrameJob& job, FrameResult& r);
+
+    // 粗定位 + 门控后取出 8 条边的投影 (帧号与真值取自 job)；被拒绝或无效的帧返回 false
+    // timing: 可选输出各阶段耗时 (coarseMs；fineMs = 门控 + 投影，不含拟合) 与拒绝原因
+    bool captureProfiles(const FrameJob& job, const cv::Mat& image, FrameProfiles& out, FrameResult* timing = nullptr);
+
+    /**
+     * @brief 渲染/读取清单中的每帧并把投影写入缓存 (相同帧号与几何的条目被覆盖)。
+     * @return int 成功取得投影的帧数。
+     */
+    int captureAll(const std::vector<FrameJob>& jobs, ProfileCache& cache);
+
+    // 对缓存中的每帧逐一用全部 ModelType 重新拟合，输出各模型的精度统计与纯拟合耗时 (不读图像)
+    static void compareModels(const ProfileCache& cache);
+
+    /**
+     * @brief 处理清单中序号 % shardCount == shardIndex 的帧。
+     * @param log 可选：逐帧结果写入二进制日志。
+     */
+    BatchStats runShard(const std::vector<FrameJob>& jobs, int shardIndex, int shardCount, ResultLog* log = nullptr);
+
+    // 结果 -> 日志记录
+    static ResultRecord toRecord(const FrameResult& r);
+
+    /**
+     * @brief 协调器：启动 shards 个工作进程 (exePath --worker ...)，等待结束后合并各分片统计。
+     * @param recipeSpecs 转发给每个工作进程的 --recipe id=path 配方列表。
+     * @param sensorBits 16 位帧的有效位数，> 0 时以 --bits 转发 (0 = 工作进程按帧推断)。
+     * @return bool 全部分片统计齐全时返回 true (缺失的分片可单独重跑 worker 后再 --merge)。
+     */
+    static bool runCoordinator(const std::string& exePath, const std::string& manifestPath,
+        int shards, const std::string& workDir, BatchStats& merged,
+        const std::vector<std::string>& recipeSpecs = std::vector<std::string>(), int sensorBits = 0);
+
+    // 分片统计 / 结果日志文件名
+    static std::string shardStatsPath(const std::string& workDir, int shardIndex);
+    static std::string shardLogPath(const std::string& workDir, int shardIndex);
+
+private:
+    ImageSimulator simulator;
+    Localization localization;
+    YoloDetector* detector = nullptr;
+    bool cascadeCoarse = false;
+    const RecipeRegistry* registry = nullptr;
+    bool qualityGate = true;
+    FrameQuality frameQuality;
+    std::vector<EdgeMeasurement> edgeBuffer;
+};
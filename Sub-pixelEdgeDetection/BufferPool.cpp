@@ -0,0 +1,229 @@
+﻿#include "BufferPool.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+    const int MIN_CLASS_SHIFT = 15;     // 第 0 档为 (32 KB, 64 KB]
+    const int CLASSES_PER_OCTAVE = 4;
+    const int MAX_CLASS_SHIFT = 32;
+    const int NUM_CLASSES = (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT) * CLASSES_PER_OCTAVE;
+    const size_t THREAD_CACHE_DEPTH = 2; // 每线程每档缓存的缓冲数 (一帧流水线通常同尺寸不超过 2 个并存)
+}
+
+// 线程私有的空闲缓冲：同线程的 释放 -> 分配 无需加锁
+struct ThreadBufferCache {
+    vector<vector<void*>> slots;
+
+    ThreadBufferCache() : slots(NUM_CLASSES) {}
+    ~ThreadBufferCache() {
+        PooledMatAllocator& pool = PooledMatAllocator::instance();
+        for (int i = 0; i < NUM_CLASSES; ++i) {
+            for (void* p : slots[i]) pool.releaseToGlobal(i, p, true);
+        }
+    }
+};
+
+namespace {
+    ThreadBufferCache& threadCache() {
+        thread_local ThreadBufferCache cache;
+        return cache;
+    }
+}
+
+PooledMatAllocator::PooledMatAllocator()
+    : minPooledBytes(64 * 1024), maxPooledBytes(256 * 1024 * 1024), maxIdleBytes(512 * 1024 * 1024),
+    freeLists(NUM_CLASSES) {
+}
+
+PooledMatAllocator& PooledMatAllocator::instance() {
+    static PooledMatAllocator* pool = new PooledMatAllocator();
+    return *pool;
+}
+
+void PooledMatAllocator::install() {
+    Mat::setDefaultAllocator(&instance());
+}
+
+void PooledMatAllocator::uninstall() {
+    Mat::setDefaultAllocator(nullptr);
+}
+
+void PooledMatAllocator::setLimits(size_t minPooled, size_t maxPooled, size_t maxIdle) {
+    // 已发出的缓冲按旧档位归还会错档，只允许在第一次分配前调整
+    CV_Assert(requests == 0 && bypassed == 0);
+    minPooledBytes = minPooled;
+    maxPooledBytes = std::min(maxPooled, classBytes(NUM_CLASSES - 1));
+    maxIdleBytes = maxIdle;
+}
+
+int PooledMatAllocator::classIndex(size_t bytes) {
+    // 取 2^k < bytes <= 2^(k+1)，再在区间内按 2^k/4 的步长向上取整
+    size_t b = std::max<size_t>(bytes, (size_t)1 << (MIN_CLASS_SHIFT + 1));
+    int k = 0;
+    while (((size_t)1 << (k + 1)) < b) ++k;
+    size_t base = (size_t)1 << k, step = base / CLASSES_PER_OCTAVE;
+    int sub = (int)((b - base + step - 1) / step);   // 1 ~ 4
+    return (k - MIN_CLASS_SHIFT) * CLASSES_PER_OCTAVE + (sub - 1);
+}
+
+size_t PooledMatAllocator::classBytes(int index) {
+    int k = MIN_CLASS_SHIFT + index / CLASSES_PER_OCTAVE;
+    int sub = index % CLASSES_PER_OCTAVE + 1;
+    size_t base = (size_t)1 << k;
+    return base + sub * (base / CLASSES_PER_OCTAVE);
+}
+
+bool PooledMatAllocator::pooled(size_t bytes) const {
+    return bytes >= minPooledBytes && bytes <= maxPooledBytes;
+}
+
+void PooledMatAllocator::notePeak(std::atomic<size_t>& peak, size_t value) const {
+    size_t cur = peak.load();
+    while (value > cur && !peak.compare_exchange_weak(cur, value)) {}
+}
+
+void* PooledMatAllocator::acquire(size_t bytes) const {
+    if (!pooled(bytes)) {
+        bypassed++;
+        return fastMalloc(bytes);
+    }
+
+    int index = classIndex(bytes);
+    size_t size = classBytes(index);
+    requests++;
+
+    void* ptr = nullptr;
+    vector<void*>& local = threadCache().slots[index];
+    if (!local.empty()) {
+        ptr = local.back();
+        local.pop_back();
+    }
+    else {
+        lock_guard<mutex> lock(mtx);
+        if (!freeLists[index].empty()) {
+            ptr = freeLists[index].back();
+            freeLists[index].pop_back();
+        }
+    }
+
+    if (ptr) {
+        hits++;
+        bytesIdle -= size;
+    }
+    else {
+        ptr = fastMalloc(size);
+    }
+    notePeak(peakInUse, bytesInUse += size);
+    notePeak(peakFootprint, bytesInUse + bytesIdle);
+    return ptr;
+}
+
+void PooledMatAllocator::release(void* ptr, size_t bytes) const {
+    if (!pooled(bytes)) {
+        fastFree(ptr);
+        return;
+    }
+
+    int index = classIndex(bytes);
+    bytesInUse -= classBytes(index);
+
+    vector<void*>& local = threadCache().slots[index];
+    if (local.size() < THREAD_CACHE_DEPTH) {
+        bytesIdle += classBytes(index);
+        local.push_back(ptr);
+        return;
+    }
+    releaseToGlobal(index, ptr, false);
+}
+
+void PooledMatAllocator::releaseToGlobal(int index, void* ptr, bool countedIdle) const {
+    size_t size = classBytes(index);
+    {
+        lock_guard<mutex> lock(mtx);
+        size_t idleAfter = bytesIdle + (countedIdle ? 0 : size);
+        if (idleAfter <= maxIdleBytes) {
+            freeLists[index].push_back(ptr);
+            if (!countedIdle) bytesIdle += size;
+            return;
+        }
+    }
+    if (countedIdle) bytesIdle -= size;
+    fastFree(ptr);
+}
+
+void PooledMatAllocator::trim() {
+    lock_guard<mutex> lock(mtx);
+    for (int i = 0; i < NUM_CLASSES; ++i) {
+        for (void* p : freeLists[i]) {
+            fastFree(p);
+            bytesIdle -= classBytes(i);
+        }
+        freeLists[i].clear();
+    }
+}
+
+BufferPoolStats PooledMatAllocator::stats() const {
+    BufferPoolStats s;
+    s.requests = requests;
+    s.hits = hits;
+    s.bypassed = bypassed;
+    s.bytesInUse = bytesInUse;
+    s.bytesIdle = bytesIdle;
+    s.peakInUse = peakInUse;
+    s.peakFootprint = peakFootprint;
+    return s;
+}
+
+void PooledMatAllocator::printStats() const {
+    BufferPoolStats s = stats();
+    const double MB = 1024.0 * 1024.0;
+    cout << "[BufferPool] requests: " << s.requests << ", hit rate: " << fixed << setprecision(1)
+        << s.hitRate() * 100.0 << "%, bypassed: " << s.bypassed
+        << ", in use: " << setprecision(2) << s.bytesInUse / MB << " MB, idle: " << s.bytesIdle / MB
+        << " MB, high-water: " << s.peakFootprint / MB << " MB (in use peak " << s.peakInUse / MB << " MB)" << endl;
+}
+
+UMatData* PooledMatAllocator::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+    AccessFlag /*flags*/, UMatUsageFlags /*usageFlags*/) const {
+    // 与 OpenCV 默认分配器相同的步长计算
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+            if (data0 && step[i] != CV_AUTOSTEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    uchar* data = data0 ? (uchar*)data0 : (uchar*)acquire(total);
+    UMatData* u = new UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if (data0) u->flags |= UMatData::USER_ALLOCATED;
+    return u;
+}
+
+bool PooledMatAllocator::allocate(UMatData* u, AccessFlag /*accessflags*/, UMatUsageFlags /*usageFlags*/) const {
+    return u != nullptr;
+}
+
+void PooledMatAllocator::deallocate(UMatData* u) const {
+    if (!u) return;
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    if (!(u->flags & UMatData::USER_ALLOCATED)) {
+        // u->size 为请求字节数，据此复原分配时的尺寸档
+        release(u->origdata, u->size);
+        u->origdata = 0;
+    }
+    delete u;
+}
@@ -0,0 +1,82 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+/**
+ * @struct BufferPoolStats
+ * @brief 缓冲池统计 (字节数只统计可入池的尺寸档)。
+ */
+struct BufferPoolStats {
+    uint64_t requests = 0;       // 可入池尺寸的分配请求数
+    uint64_t hits = 0;           // 由线程缓存或全局空闲链表直接满足的次数
+    uint64_t bypassed = 0;       // 过小/过大而直接走 fastMalloc 的次数
+    size_t bytesInUse = 0;       // 当前被 Mat 持有的池内字节
+    size_t bytesIdle = 0;        // 当前空闲 (线程缓存 + 全局链表) 的字节
+    size_t peakInUse = 0;        // bytesInUse 的历史最高值
+    size_t peakFootprint = 0;    // bytesInUse + bytesIdle 的历史最高值 (高水位)
+
+    double hitRate() const { return requests ? (double)hits / requests : 0.0; }
+};
+
+/**
+ * @class PooledMatAllocator
+ * @brief 分档 + 线程缓存的 cv::MatAllocator，稳态下整帧缓冲在各阶段之间循环复用，
+ *        避免多 MB 缓冲反复 malloc/free 及缺页。
+ *
+ * 尺寸档：每个 2 的幂区间再分 4 档 (内部碎片 < 25%)；小于 minPooledBytes 的缓冲交给 fastMalloc
+ * (小块分配器本身已足够快)，大于 maxPooledBytes 的缓冲 (如模拟器 50 倍超采样图) 不入池，防止长期占用内存。
+ * 释放时先放入当前线程缓存 (每档少量)，溢出后回到全局链表；空闲总量超过 maxIdleBytes 时直接释放。
+ *
+ * 用法：程序启动时调用 PooledMatAllocator::install()，之后新建的 Mat 均经由本分配器。
+ * 实例为进程级单例且永不析构，保证静态析构阶段释放的 Mat 仍能安全归还。
+ */
+class PooledMatAllocator : public cv::MatAllocator {
+public:
+    static PooledMatAllocator& instance();
+
+    // 设为 / 撤销 Mat 的默认分配器
+    static void install();
+    static void uninstall();
+
+    void setLimits(size_t minPooledBytes, size_t maxPooledBytes, size_t maxIdleBytes);
+
+    BufferPoolStats stats() const;
+    void printStats() const;
+
+    // 释放全局链表中的全部空闲缓冲 (各线程缓存不受影响)
+    void trim();
+
+    // cv::MatAllocator 接口
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+        cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessflags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+private:
+    PooledMatAllocator();
+
+    static int classIndex(size_t bytes);
+    static size_t classBytes(int index);
+
+    bool pooled(size_t bytes) const;
+    void* acquire(size_t bytes) const;
+    void release(void* ptr, size_t bytes) const;
+
+    // 放回全局链表 (空闲总量超限时直接释放)；countedIdle: 该缓冲是否已计入 bytesIdle (来自线程缓存)
+    // 线程缓存在线程退出时经此归还
+    friend struct ThreadBufferCache;
+    void releaseToGlobal(int index, void* ptr, bool countedIdle) const;
+
+    void notePeak(std::atomic<size_t>& peak, size_t value) const;
+
+    size_t minPooledBytes, maxPooledBytes, maxIdleBytes;
+
+    mutable std::mutex mtx;
+    mutable std::vector<std::vector<void*>> freeLists;   // 按尺寸档索引
+
+    mutable std::atomic<uint64_t> requests{ 0 }, hits{ 0 }, bypassed{ 0 };
+    mutable std::atomic<size_t> bytesInUse{ 0 }, bytesIdle{ 0 }, peakInUse{ 0 }, peakFootprint{ 0 };
+};
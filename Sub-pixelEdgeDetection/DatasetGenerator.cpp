@@ -0,0 +1,267 @@
+﻿#include "DatasetGenerator.h"
+#include "WaferConfig.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <climits>
+
+using namespace cv;
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+    struct WriteJob {
+        int index;
+        Mat image;
+        string label;
+    };
+
+    // 渲染 -> 写盘 的有界队列，队列满时渲染线程阻塞 (背压)，避免待写图像堆积占满内存
+    class WriteQueue {
+    public:
+        explicit WriteQueue(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+        void push(WriteJob&& job) {
+            unique_lock<mutex> lock(mtx);
+            notFull.wait(lock, [&] { return jobs.size() < capacity; });
+            jobs.push_back(std::move(job));
+            notEmpty.notify_one();
+        }
+
+        // 队列已关闭且为空时返回 false
+        bool pop(WriteJob& job) {
+            unique_lock<mutex> lock(mtx);
+            notEmpty.wait(lock, [&] { return !jobs.empty() || closed; });
+            if (jobs.empty()) return false;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        void close() {
+            lock_guard<mutex> lock(mtx);
+            closed = true;
+            notEmpty.notify_all();
+        }
+
+    private:
+        size_t capacity;
+        deque<WriteJob> jobs;
+        bool closed = false;
+        mutex mtx;
+        condition_variable notEmpty, notFull;
+    };
+
+    // 由全局种子与序号派生每张图像独立的随机种子 (SplitMix64)
+    uint64_t mixSeed(uint64_t seed, uint64_t index) {
+        uint64_t z = seed + 0x9E3779B97F4A7C15ULL * (index + 1);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+}
+
+DatasetGenerator::DatasetGenerator(const DatasetConfig& config) : cfg(config) {
+    if (cfg.shardCount < 1) cfg.shardCount = 1;
+    cfg.shardIndex = std::min(std::max(cfg.shardIndex, 0), cfg.shardCount - 1);
+}
+
+std::string DatasetGenerator::sampleName(int index) {
+    stringstream ss;
+    ss << "img_" << setw(6) << setfill('0') << index;
+    return ss.str();
+}
+
+bool DatasetGenerator::isComplete(int index) const {
+    // 标签文件在图像之后写入，二者都存在才视为完整
+    string name = sampleName(index);
+    return fs::exists(fs::path(cfg.imageDir) / (name + ".png")) &&
+        fs::exists(fs::path(cfg.labelDir) / (name + ".txt"));
+}
+
+int DatasetGenerator::resolveRenderThreads() const {
+    int cores = (int)std::max(1u, thread::hardware_concurrency());
+    int threads = (cfg.renderThreads > 0) ? cfg.renderThreads : cores;
+
+    // 模拟器分层渲染：每线程缓存若干张 float 覆盖率图 + 合成缓冲，另有写盘队列中的输出图像
+    double perImageMB = (double)cfg.imageSize * cfg.imageSize * 4.0 * 10.0 / (1024.0 * 1024.0);
+    int byMemory = std::max(1, (int)(cfg.memoryBudgetMB / std::max(perImageMB, 1.0)));
+
+    return std::min(threads, byMemory);
+}
+
+cv::Mat DatasetGenerator::renderSample(int index, ImageSimulator& simulator, std::string& label) const {
+    RNG rng(mixSeed(cfg.seed, (uint64_t)index));
+
+    double shiftX = rng.uniform(-cfg.maxShift, cfg.maxShift);
+    double shiftY = rng.uniform(-cfg.maxShift, cfg.maxShift);
+    double noise = rng.uniform(0.0, cfg.maxNoise);
+    double angle = (cfg.maxAngle > 0.0) ? rng.uniform(-cfg.maxAngle, cfg.maxAngle) : 0.0;
+    int dx = (cfg.maxPlacement > 0) ? rng.uniform(-cfg.maxPlacement, cfg.maxPlacement + 1) : 0;
+    int dy = (cfg.maxPlacement > 0) ? rng.uniform(-cfg.maxPlacement, cfg.maxPlacement + 1) : 0;
+
+    simulator.setSeed(rng.uniform(0, INT_MAX));
+    Mat img = simulator.generateWaferImage(cfg.imageSize, shiftX, shiftY, noise, angle);
+
+    // 模拟器总把标记放在画面中心，这里整体平移使标记位置多样化
+    // 背景是均匀灰度，用 BORDER_REPLICATE 延拓即可
+    if (dx != 0 || dy != 0) {
+        Mat M = (Mat_<double>(2, 3) << 1, 0, dx, 0, 1, dy);
+        warpAffine(img, img, M, img.size(), INTER_NEAREST, BORDER_REPLICATE);
+    }
+
+    // 标注框：以标记中心为中心、WAFER_SIZE 大小 (与模板同尺寸)，裁剪到图像内
+    double cx = cfg.imageSize / 2.0 + dx;
+    double cy = cfg.imageSize / 2.0 + dy;
+    double half = WaferConfig::WAFER_SIZE / 2.0;
+    double x0 = std::max(0.0, cx - half), y0 = std::max(0.0, cy - half);
+    double x1 = std::min((double)img.cols, cx + half), y1 = std::min((double)img.rows, cy + half);
+
+    stringstream ss;
+    ss << fixed << setprecision(6) << 0 << " "
+        << ((x0 + x1) / 2.0) / img.cols << " " << ((y0 + y1) / 2.0) / img.rows << " "
+        << (x1 - x0) / img.cols << " " << (y1 - y0) / img.rows << "\n";
+    label = ss.str();
+
+    return img;
+}
+
+DatasetReport DatasetGenerator::run() {
+    DatasetReport report;
+
+    try {
+        fs::create_directories(cfg.imageDir);
+        fs::create_directories(cfg.labelDir);
+    }
+    catch (const std::exception& e) {
+        cerr << "[Dataset] Cannot create output folders: " << e.what() << endl;
+        return report;
+    }
+
+    // 1. 确定本分片待生成的序号
+    vector<int> todo;
+    for (int i = cfg.shardIndex; i < cfg.numImages; i += cfg.shardCount) {
+        if (cfg.resume && isComplete(i)) {
+            report.skipped++;
+            continue;
+        }
+        todo.push_back(i);
+    }
+
+    int renderThreads = resolveRenderThreads();
+    int writerThreads = std::max(1, cfg.writerThreads);
+    cout << "[Dataset] Shard " << cfg.shardIndex << "/" << cfg.shardCount
+        << ": " << todo.size() << " to render, " << report.skipped << " already done, "
+        << renderThreads << " render + " << writerThreads << " writer threads" << endl;
+    if (todo.empty()) return report;
+
+    auto t0 = chrono::steady_clock::now();
+    WriteQueue queue(cfg.queueCapacity);
+    atomic<size_t> cursor{ 0 };
+    atomic<int> written{ 0 }, failed{ 0 };
+
+    // 2. 渲染线程：每线程一个模拟器，按序号领取任务
+    vector<thread> renderers;
+    for (int t = 0; t < renderThreads; ++t) {
+        renderers.emplace_back([&] {
+            ImageSimulator simulator;
+            for (size_t k = cursor++; k < todo.size(); k = cursor++) {
+                WriteJob job;
+                job.index = todo[k];
+                try {
+                    job.image = renderSample(job.index, simulator, job.label);
+                }
+                catch (const std::exception& e) {
+                    // 单张渲染失败 (如 OpenCV 异常) 只计入失败，不影响其余序号
+                    cerr << "[Dataset] Failed to render " << sampleName(job.index) << ": " << e.what() << endl;
+                    failed++;
+                    continue;
+                }
+                catch (...) {
+                    cerr << "[Dataset] Failed to render " << sampleName(job.index) << endl;
+                    failed++;
+                    continue;
+                }
+                queue.push(std::move(job));
+            }
+            });
+    }
+
+    // 3. 写盘线程：先写图像，再经临时文件 + rename 写标签 (标签即完成标记，保证断点续跑的一致性)
+    vector<thread> writers;
+    for (int t = 0; t < writerThreads; ++t) {
+        writers.emplace_back([&] {
+            WriteJob job;
+            while (queue.pop(job)) {
+                string name = sampleName(job.index);
+                fs::path imgPath = fs::path(cfg.imageDir) / (name + ".png");
+                fs::path lblPath = fs::path(cfg.labelDir) / (name + ".txt");
+                fs::path tmpPath = fs::path(cfg.labelDir) / (name + ".txt.tmp");
+                try {
+                    bool ok = imwrite(imgPath.string(), job.image);
+                    if (ok) {
+                        ofstream ofs(tmpPath, ios::binary | ios::trunc);
+                        ofs << job.label;
+                        ofs.close();
+                        ok = ofs.good();
+                        if (ok) fs::rename(tmpPath, lblPath);
+                    }
+                    if (ok) written++;
+                    else failed++;
+                }
+                catch (const std::exception& e) {
+                    cerr << "[Dataset] Failed to write " << name << ": " << e.what() << endl;
+                    failed++;
+                }
+                catch (...) {
+                    cerr << "[Dataset] Failed to write " << name << endl;
+                    failed++;
+                }
+            }
+            });
+    }
+
+    // 4. 进度线程定期报告吞吐，直到全部线程汇合 (不依赖计数达到总数，线程提前退出时也能结束)
+    int total = (int)todo.size();
+    atomic<bool> done{ false };
+    thread progress([&] {
+        auto lastReport = t0;
+        while (!done) {
+            this_thread::sleep_for(chrono::milliseconds(200));
+            auto now = chrono::steady_clock::now();
+            if (!done && chrono::duration<double>(now - lastReport).count() >= 5.0) {
+                double sec = chrono::duration<double>(now - t0).count();
+                cout << "[Dataset] " << written << "/" << total << "  "
+                    << fixed << setprecision(2) << written / sec << " images/s" << endl;
+                lastReport = now;
+            }
+        }
+        });
+
+    for (auto& th : renderers) th.join();
+    queue.close();
+    for (auto& th : writers) th.join();
+    done = true;
+    progress.join();
+
+    report.generated = written;
+    report.failed = failed;
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    report.imagesPerSecond = (report.seconds > 0) ? report.generated / report.seconds : 0.0;
+
+    cout << "[Dataset] Done: " << report.generated << " generated, " << report.skipped << " skipped, "
+        << report.failed << " failed in " << fixed << setprecision(1) << report.seconds << " s ("
+        << setprecision(2) << report.imagesPerSecond << " images/s)" << endl;
+    return report;
+}
@@ -0,0 +1,86 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include "ImageSimulator.h"
+#include <string>
+#include <cstdint>
+
+/**
+ * @struct DatasetConfig
+ * @brief YOLO 训练集生成参数。
+ */
+struct DatasetConfig {
+    int numImages = 500;             // 数据集总图像数 (全局序号 0 ~ numImages-1)
+    int imageSize = 640;             // 输出图像边长
+    std::string imageDir;            // 图像输出目录 (如 ".../train/images")
+    std::string labelDir;            // 标签输出目录 (如 ".../train/labels")
+
+    // 随机参数范围 (每张图像由 seed + 序号 确定，可复现)
+    uint64_t seed = 2025;
+    double maxShift = 2.0;           // 内外框偏移范围 [-maxShift, maxShift] (像素)
+    double maxNoise = 5.0;           // 高斯噪声标准差范围 [0, maxNoise]
+    double maxAngle = 0.0;           // 旋转角度范围 [-maxAngle, maxAngle] (度)
+    int maxPlacement = 100;          // 标记在画面中的随机平移范围 (像素)
+
+    // 分片：仅生成 index % shardCount == shardIndex 的图像，多机并行时输出可直接合并
+    int shardIndex = 0;
+    int shardCount = 1;
+
+    // 断点续跑：已存在完整 (图像 + 标签) 的序号直接跳过
+    bool resume = true;
+
+    // 并行度 (0 = 全部核心)。模拟器分层渲染每线程约需 size^2 * 40 字节 (覆盖率缓存 + 合成缓冲)，
+    // 实际渲染线程数会再受 memoryBudgetMB 约束，防止多线程同时申请导致内存耗尽
+    int renderThreads = 0;
+    int writerThreads = 2;           // 异步写盘线程数 (PNG 编码也较耗时)
+    size_t memoryBudgetMB = 8192;
+    int queueCapacity = 16;          // 渲染与写盘之间的队列长度 (背压)
+};
+
+/**
+ * @struct DatasetReport
+ * @brief 生成结果统计。
+ */
+struct DatasetReport {
+    int generated = 0;               // 本次新生成的图像数
+    int skipped = 0;                 // 断点续跑跳过的图像数
+    int failed = 0;                  // 渲染或写盘失败数
+    double seconds = 0.0;
+    double imagesPerSecond = 0.0;
+};
+
+/**
+ * @class DatasetGenerator
+ * @brief 基于 ImageSimulator 的并行 YOLO 数据集生成器。
+ *
+ * 渲染线程各自持有独立的 ImageSimulator，按全局序号设定随机种子；
+ * 渲染结果经有界队列交给异步写盘线程保存为 PNG 与 YOLO 格式标签 (class cx cy w h，归一化)。
+ * 标注框为以标记中心为中心、WAFER_SIZE 大小的方框，其左上角即 coarseLocalizationYolo 所需的粗定位点。
+ */
+class DatasetGenerator {
+public:
+    explicit DatasetGenerator(const DatasetConfig& config);
+
+    /**
+     * @brief 执行生成 (阻塞直到全部完成)，并周期性输出 images/s。
+     * @return DatasetReport 生成统计。
+     */
+    DatasetReport run();
+
+    /**
+     * @brief 生成单张图像及其 YOLO 标签行 (线程安全，供 run() 及外部调用)。
+     * @param index 全局图像序号。
+     * @param simulator 调用线程私有的模拟器。
+     * @param label [输出] 标签行文本。
+     * @return cv::Mat 渲染后的图像。
+     */
+    cv::Mat renderSample(int index, ImageSimulator& simulator, std::string& label) const;
+
+    // 由序号得到文件名主干 (如 "img_000123")
+    static std::string sampleName(int index);
+
+private:
+    DatasetConfig cfg;
+
+    bool isComplete(int index) const;
+    int resolveRenderThreads() const;
+};
@@ -0,0 +1,102 @@
+﻿#include "FrameScheduler.h"
+#include <iostream>
+#include <chrono>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+    // 外X / 内X / 外Y / 内Y：同一任务内的两条边共用一次积分图构建
+    const unsigned EDGE_GROUPS[4] = { 0x03u, 0x0Cu, 0x30u, 0xC0u };
+}
+
+FrameScheduler::FrameScheduler(const SchedulerConfig& config, const RecipeRegistry* registry) : cfg(config) {
+    scheduler.reset(new TaskScheduler(cfg.workers, cfg.pinThreads));
+    if (cfg.splitBelow <= 0) cfg.splitBelow = scheduler->workerCount();
+
+    for (int i = 0; i < scheduler->workerCount(); ++i) {
+        unique_ptr<BatchProcessor> p(new BatchProcessor());
+        p->setRegistry(registry);
+        p->setSparseSearch(cfg.sparseSearch);
+        if (cfg.sensorBits > 0) p->setSensorBits(cfg.sensorBits);
+        processors.push_back(std::move(p));
+    }
+}
+
+FrameScheduler::~FrameScheduler() {
+    wait();
+    scheduler.reset();
+}
+
+void FrameScheduler::submit(const FrameJob& job, const cv::Mat& image, Callback done) {
+    // 队列短 (在途帧不足以让每个线程分到一帧) 时拆边缩短单帧延迟，否则整帧处理换取吞吐
+    bool split = inFlight.load() < cfg.splitBelow;
+    inFlight++;
+
+    if (split) {
+        framesSplit++;
+        scheduler->submit([this, job, image, done] { measureSplit(job, image, done); });
+        return;
+    }
+
+    framesWhole++;
+    scheduler->submit([this, job, image, done] {
+        FrameResult r = workerProcessor().measure(job, image);
+        done(r);
+        inFlight--;
+    });
+}
+
+void FrameScheduler::measureSplit(const FrameJob& job, const cv::Mat& image, const Callback& done) {
+    FrameResult r;
+    int searchLen = 0;
+    if (workerProcessor().measureCoarse(job, image, r, searchLen)) {
+        auto t1 = chrono::steady_clock::now();
+
+        // 各组在执行它的线程的 BatchProcessor 上测量，结果写入本帧私有的 m[]
+        EdgeMeasurement m[8];
+        vector<TaskScheduler::Task> groups;
+        for (unsigned mask : EDGE_GROUPS) {
+            groups.push_back([this, &job, &image, &r, &m, mask, searchLen] {
+                workerProcessor().measureEdges(job, image, r.coarsePos, mask, m, searchLen);
+            });
+        }
+        scheduler->runAndWait(groups);
+
+        r.measured = Localization::overlayFromEdges(m);
+        for (int i = 0; i < 8; ++i) r.edges[i] = m[i].position;
+        r.fineMs += chrono::duration<float, milli>(chrono::steady_clock::now() - t1).count();
+        BatchProcessor::grade(job, r);
+    }
+    done(r);
+    inFlight--;
+}
+
+BatchProcessor& FrameScheduler::workerProcessor() {
+    // 所有任务都经本调度器提交、只在其工作线程上执行；runAndWait 的 tasks[0] 也由工作线程 (measureSplit) 调用
+    int index = scheduler->currentWorker();
+    CV_Assert(index >= 0 && index < (int)processors.size());
+    return *processors[index];
+}
+
+void FrameScheduler::wait() {
+    while (inFlight.load() > 0) scheduler->waitIdle();
+}
+
+SchedulerStats FrameScheduler::stats() const {
+    SchedulerStats s;
+    s.queueDepth = scheduler->queueDepth();
+    s.framesInFlight = inFlight.load();
+    s.steals = scheduler->steals();
+    s.tasks = scheduler->executed();
+    s.framesSplit = framesSplit.load();
+    s.framesWhole = framesWhole.load();
+    return s;
+}
+
+void FrameScheduler::printStats() const {
+    SchedulerStats s = stats();
+    cout << "[Scheduler] " << scheduler->workerCount() << " workers, queue " << s.queueDepth
+        << ", in flight " << s.framesInFlight << ", frames split/whole " << s.framesSplit << "/" << s.framesWhole
+        << ", tasks " << s.tasks << ", steals " << s.steals << endl;
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "BatchProcessor.h"
+#include "TaskScheduler.h"
+
+/**
+ * @struct SchedulerConfig
+ * @brief 多线程测量参数。
+ */
+struct SchedulerConfig {
+    int workers = 0;             // 工作线程数 (0 = 全部核心)
+    bool pinThreads = false;     // 工作线程绑核，OpenCV 内部线程数限制为剩余核心
+    int splitBelow = 0;          // 在途帧数低于该值时把一帧拆成边级任务 (低延迟模式)，0 = 工作线程数
+    bool sparseSearch = false;   // 见 BatchProcessor::setSparseSearch
+    int sensorBits = 0;          // 16 位帧的有效位数 (0 = 不设置)
+};
+
+/**
+ * @struct SchedulerStats
+ * @brief 调度统计快照。
+ */
+struct SchedulerStats {
+    size_t queueDepth = 0;       // 已提交未开始的任务数 (整帧 + 边级)
+    int framesInFlight = 0;      // 已提交未完成的帧数
+    uint64_t steals = 0;         // 工作线程之间的窃取次数
+    uint64_t tasks = 0;          // 已执行的任务数
+    uint64_t framesSplit = 0;    // 按低延迟模式 (拆边) 处理的帧数
+    uint64_t framesWhole = 0;    // 按吞吐模式 (整帧一个任务) 处理的帧数
+};
+
+/**
+ * @class FrameScheduler
+ * @brief 基于工作窃取调度器的多线程测量，按队列长度在两种粒度之间切换：
+ *        - 在途帧少 (低延迟)：粗定位 + 门控后，8 条边按 外X/内X/外Y/内Y 拆成 4 个任务并行拟合，空闲线程窃取；
+ *        - 在途帧多 (吞吐)：每帧一个任务，由单个线程完整测量，无拆分与合并开销。
+ *
+ * 每个工作线程持有独立的 BatchProcessor (Localization 的缓冲不可共享)；YOLO 检测器不是线程安全的，这里只支持模板匹配粗定位。
+ * 回调在工作线程上执行，图像须在回调前保持有效。
+ */
+class FrameScheduler {
+public:
+    using Callback = std::function<void(const FrameResult&)>;
+
+    // registry 非空时每帧按 FrameJob::recipeId 取配方计划 (注册表由调用方持有)
+    explicit FrameScheduler(const SchedulerConfig& config, const RecipeRegistry* registry = nullptr);
+    ~FrameScheduler();   // 等待全部在途帧完成
+
+    void submit(const FrameJob& job, const cv::Mat& image, Callback done);
+
+    // 等待全部在途帧完成
+    void wait();
+
+    SchedulerStats stats() const;
+    void printStats() const;
+
+private:
+    void measureSplit(const FrameJob& job, const cv::Mat& image, const Callback& done);
+    // 当前工作线程的 BatchProcessor (非本调度器的线程调用时断言失败，而不是以 -1 越界索引)
+    BatchProcessor& workerProcessor();
+
+    SchedulerConfig cfg;
+    std::vector<std::unique_ptr<BatchProcessor>> processors;   // 按工作线程序号索引
+    std::atomic<int> inFlight{ 0 };
+    std::atomic<uint64_t> framesSplit{ 0 }, framesWhole{ 0 };
+    std::unique_ptr<TaskScheduler> scheduler;                 // 最后声明：先于 processors 析构 (先停线程)
+};
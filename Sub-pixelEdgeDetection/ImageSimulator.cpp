@@ -2,19 +2,159 @@
 #include "WaferConfig.h" 
 #include <opencv2/imgproc.hpp>
 #include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 
 using namespace cv;
 using namespace std;
 using namespace WaferConfig;
 
-ImageSimulator::ImageSimulator() {}
+namespace {
+
+    // 超采样倍率：渲染语义等价于在 SCALE 倍网格上绘制后 INTER_AREA 下采样 (精度 1/50 = 0.02px)
+    const int SCALE = 50;
+    const size_t MAX_CACHED_LAYERS = 4;
+    const double BORDER_GRAY = 180.0;   // 旋转后画布外的填充灰度 (与原 warpAffine 的 BORDER_CONSTANT 相同)
+
+    // 将高分辨率网格上的实心矩形 r (像素 [x, x+w) x [y, y+h)) 按其在低分辨率像素上的面积覆盖率
+    // 乘以 weight 累加到 dst (CV_32F)，只访问矩形影响到的像素。
+    // rot 为空时覆盖率可分离为 cx * cy，直接解析计算；
+    // 否则按 INTER_NEAREST 旋转语义，远离边界的像素直接判定为 0/1，只对跨边界的像素逐子像素计数
+    void accumulateCoverage(Mat& dst, Rect r, const Mat& rot, double weight) {
+        const int hiSize = dst.cols * SCALE;
+        r &= Rect(0, 0, hiSize, hiSize);
+        if (r.empty() || weight == 0.0) return;
+        const Rect imageRect(0, 0, dst.cols, dst.rows);
+
+        if (rot.empty()) {
+            Rect roi = Rect(r.x / SCALE, r.y / SCALE,
+                (r.x + r.width + SCALE - 1) / SCALE - r.x / SCALE,
+                (r.y + r.height + SCALE - 1) / SCALE - r.y / SCALE) & imageRect;
+
+            auto overlap = [](int a0, int a1, int p) {
+                int lo = std::max(a0, p * SCALE), hi = std::min(a1, p * SCALE + SCALE);
+                return std::max(0, hi - lo) / (double)SCALE;
+            };
+            vector<double> cx(roi.width);
+            for (int i = 0; i < roi.width; ++i) cx[i] = overlap(r.x, r.x + r.width, roi.x + i);
+
+            for (int j = 0; j < roi.height; ++j) {
+                double cy = weight * overlap(r.y, r.y + r.height, roi.y + j);
+                float* row = dst.ptr<float>(roi.y + j) + roi.x;
+                for (int i = 0; i < roi.width; ++i) row[i] += (float)(cy * cx[i]);
+            }
+            return;
+        }
+
+        // 旋转：目标像素 (X, Y) 取源像素 round(inv * (X, Y))，落在 [x0 - 0.5, x1 - 0.5) 内即被覆盖
+        Mat invMat;
+        invertAffineTransform(rot, invMat);
+        double M[2][3], inv[2][3];
+        for (int k = 0; k < 6; ++k) {
+            M[k / 3][k % 3] = rot.at<double>(k / 3, k % 3);
+            inv[k / 3][k % 3] = invMat.at<double>(k / 3, k % 3);
+        }
+        const double ex0 = r.x - 0.5, ex1 = r.x + r.width - 0.5;
+        const double ey0 = r.y - 0.5, ey1 = r.y + r.height - 0.5;
+
+        // 低分辨率包围盒
+        double bx0 = DBL_MAX, by0 = DBL_MAX, bx1 = -DBL_MAX, by1 = -DBL_MAX;
+        for (int k = 0; k < 4; ++k) {
+            double px = (k & 1) ? ex1 : ex0, py = (k & 2) ? ey1 : ey0;
+            double qx = M[0][0] * px + M[0][1] * py + M[0][2];
+            double qy = M[1][0] * px + M[1][1] * py + M[1][2];
+            bx0 = std::min(bx0, qx); bx1 = std::max(bx1, qx);
+            by0 = std::min(by0, qy); by1 = std::max(by1, qy);
+        }
+        int rx0 = (int)std::floor(bx0 / SCALE) - 1, ry0 = (int)std::floor(by0 / SCALE) - 1;
+        int rx1 = (int)std::ceil(bx1 / SCALE) + 1, ry1 = (int)std::ceil(by1 / SCALE) + 1;
+        Rect roi = Rect(rx0, ry0, rx1 - rx0, ry1 - ry0) & imageRect;
+
+        // 像素块内子像素映射到源坐标后距块中心不超过半对角线 (+ 最近邻取整的半像素)
+        const double margin = 0.7072 * SCALE + 1.0;
+        const double half = (SCALE - 1) / 2.0;
+        const float full = (float)weight;
+
+        for (int j = 0; j < roi.height; ++j) {
+            float* row = dst.ptr<float>(roi.y + j);
+            for (int i = 0; i < roi.width; ++i) {
+                int px = roi.x + i, py = roi.y + j;
+                double cxh = px * SCALE + half, cyh = py * SCALE + half;
+                double sx = inv[0][0] * cxh + inv[0][1] * cyh + inv[0][2];
+                double sy = inv[1][0] * cxh + inv[1][1] * cyh + inv[1][2];
+
+                double inside = std::min(std::min(sx - ex0, ex1 - sx), std::min(sy - ey0, ey1 - sy));
+                if (inside > margin) { row[px] += full; continue; }
+                double outside = std::max(std::max(ex0 - sx, sx - ex1), std::max(ey0 - sy, sy - ey1));
+                if (outside > margin) continue;
+
+                int count = 0;
+                for (int y = 0; y < SCALE; ++y) {
+                    int Y = py * SCALE + y;
+                    double ux = inv[0][0] * px * SCALE + inv[0][1] * Y + inv[0][2];
+                    double uy = inv[1][0] * px * SCALE + inv[1][1] * Y + inv[1][2];
+                    for (int x = 0; x < SCALE; ++x, ux += inv[0][0], uy += inv[1][0]) {
+                        int ix = cvRound(ux), iy = cvRound(uy);
+                        if (ix >= r.x && ix < r.x + r.width && iy >= r.y && iy < r.y + r.height) ++count;
+                    }
+                }
+                row[px] += (float)(weight * count / (SCALE * SCALE));
+            }
+        }
+    }
+}
+
+ImageSimulator::ImageSimulator() : rng(0x5EED), geom(MarkGeometry::fromConfig()) {}
 
 ImageSimulator::~ImageSimulator() {}
 
+void ImageSimulator::setSeed(uint64_t seed) {
+    rng = RNG(seed);
+}
+
+const ImageSimulator::StaticLayer& ImageSimulator::staticLayer(int size, double angle) {
+    bool rotated = std::abs(angle) > 0.001;
+    if (!rotated) angle = 0.0;
+
+    for (const auto& layer : layers) {
+        if (layer.size == size && layer.outerBoxSize == geom.outerBoxSize && layer.angle == angle) return layer;
+    }
+
+    StaticLayer layer;
+    layer.size = size;
+    layer.outerBoxSize = geom.outerBoxSize;
+    layer.angle = angle;
+
+    int highResSize = size * SCALE;
+    Point2f center(highResSize / 2.0f, highResSize / 2.0f);
+    if (rotated) layer.rotation = getRotationMatrix2D(center, angle, 1.0);
+
+    int scaledOuterSize = geom.outerBoxSize * SCALE;
+    Rect outerRect(
+        (int)(center.x - scaledOuterSize / 2),
+        (int)(center.y - scaledOuterSize / 2),
+        scaledOuterSize,
+        scaledOuterSize
+    );
+    layer.outerCoverage = Mat::zeros(size, size, CV_32F);
+    accumulateCoverage(layer.outerCoverage, outerRect, layer.rotation, 1.0);
+
+    if (rotated) {
+        layer.canvasCoverage = Mat::zeros(size, size, CV_32F);
+        accumulateCoverage(layer.canvasCoverage, Rect(0, 0, highResSize, highResSize), layer.rotation, 1.0);
+    }
+
+    if (layers.size() >= MAX_CACHED_LAYERS) layers.erase(layers.begin());
+    layers.push_back(std::move(layer));
+    return layers.back();
+}
+
 Mat ImageSimulator::generateWaferImage(int size, double shiftX, double shiftY, double noiseLevel, double angle) {
     // =========================================================
-    // 终极修正：使用 100倍 超采样 (Ultra Super Sampling)
-    // 精度从 0.1px 提升至 0.01px，消除采样混叠导致的系统误差
+    // 分层渲染：等价于 50 倍超采样 (Ultra Super Sampling) 后 INTER_AREA 下采样，
+    // 下采样是线性的，故图像 = 背景 + (外框 - 背景) * 外框覆盖率 + (内芯 - 外框) * 内芯覆盖率。
+    // 前两项只与尺寸/角度有关，作为静态层缓存；扫描偏移时只需重算内芯覆盖到的像素
     // =========================================================
        
     // =========================================================
@@ -24,10 +164,11 @@ Mat ImageSimulator::generateWaferImage(int size, double shiftX, double shiftY, d
     // 逻辑：背景偏亮，外框偏暗，但保证两者有足够的对比度以便算法能检测到边缘
 
     // 背景灰度：在 [150, 240] 之间随机
-    int bgGray = 150 + rand() % 91;
+    int bgGray = rng.uniform(150, 241);
 
     // 随机对比度：在 [60, 120] 之间
-    int contrast = 60 + rand() % 61;
+    int contrast = rng.uniform(60, 121);
+    if (fixedContrast > 0) contrast = fixedContrast;
 
     // 外框灰度 = 背景 - 对比度
     int outerGray = bgGray - contrast;
@@ -36,76 +177,49 @@ Mat ImageSimulator::generateWaferImage(int size, double shiftX, double shiftY, d
     // 内芯灰度 = 背景灰度 (模拟“回”字形结构，中间空心透出背景)
     int innerGray = bgGray;
 
+    // 2. 静态层 (背景 + 外框，旋转时含画布外的填充区)
+    const StaticLayer& layer = staticLayer(size, angle);
 
-    // 1. 定义超高倍率
-    // 100倍意味着 640x640 的图会变成 64000x64000 (内存爆炸)
-    // 妥协方案：分块处理或适当降低到 20-50倍，或者优化逻辑
-    // 为了演示完美效果，我们使用 50 倍 (既保证精度又不撑爆内存)
-    const int SCALE = 50;
-    int highResSize = size * SCALE;
-
-    // 检查内存安全 (防止 size 过大导致分配失败)
-    // 640 * 50 = 32000 -> 32000^2 * 1byte ~= 1GB (可以接受)
-    Mat highResImg;
-    try {
-        highResImg.create(highResSize, highResSize, CV_8UC1);
-        highResImg.setTo(Scalar(bgGray)); // 背景
+    // 3. 合成静态层：只与灰度线性相关，一次逐像素乘加
+    if (layer.canvasCoverage.empty()) {
+        layer.outerCoverage.convertTo(composite, CV_32F, outerGray - bgGray, bgGray);
     }
-    catch (...) {
-        // 如果内存不足，回退到 10倍
-        cout << "[Warn] Memory low, fallback to 10x scale" << endl;
-        return generateWaferImage(size, shiftX, shiftY, noiseLevel, angle);
+    else {
+        addWeighted(layer.canvasCoverage, bgGray - BORDER_GRAY, layer.outerCoverage, outerGray - bgGray,
+            BORDER_GRAY, composite, CV_32F);
     }
 
+    // 4. 内芯 (高分辨率坐标，偏移量放大)：只累加其覆盖到的像素
+    int highResSize = size * SCALE;
     Point2f center(highResSize / 2.0f, highResSize / 2.0f);
-
-    // 偏移量放大 (精度 1/50 = 0.02px)
     Point2f innerCenter = center + Point2f((float)(shiftX * SCALE), (float)(shiftY * SCALE));
-
-    // 3. 绘制外框 (放大版)
-    int scaledOuterSize = OUTER_BOX_SIZE * SCALE;
-    Rect outerRect(
-        (int)(center.x - scaledOuterSize / 2),
-        (int)(center.y - scaledOuterSize / 2),
-        scaledOuterSize,
-        scaledOuterSize
-    );
-    rectangle(highResImg, outerRect, Scalar(outerGray), -1);
-
-    // 4. 绘制内芯 (放大版)
-    int scaledInnerSize = INNER_BOX_SIZE * SCALE;
+    int scaledInnerSize = geom.innerBoxSize * SCALE;
     Rect innerRect(
         (int)(innerCenter.x - scaledInnerSize / 2),
         (int)(innerCenter.y - scaledInnerSize / 2),
         scaledInnerSize,
         scaledInnerSize
     );
-    rectangle(highResImg, innerRect, Scalar(innerGray), -1);
-
-    // 5. 模拟旋转
-    if (std::abs(angle) > 0.001) {
-        Mat rotMat = getRotationMatrix2D(center, angle, 1.0);
-        // 使用 Nearest Neighbor 在超高分辨率下旋转，避免边缘模糊
-        warpAffine(highResImg, highResImg, rotMat, highResImg.size(), INTER_NEAREST, BORDER_CONSTANT, Scalar(180));
-    }
+    accumulateCoverage(composite, innerRect, layer.rotation, innerGray - outerGray);
 
-    // 6. 下采样 (Downsampling)
+    // 5. 量化 (与 8 位 INTER_AREA 下采样一样四舍五入)
     Mat finalImg;
-    resize(highResImg, finalImg, Size(size, size), 0, 0, INTER_AREA);
+    composite.convertTo(finalImg, CV_8U);
 
-    // 7. 模拟光学模糊
+    // 6. 模拟光学模糊
     // sigma=1.0 对应约 3-5 像素的边缘宽度，适合 Sigmoid 拟合
     GaussianBlur(finalImg, finalImg, Size(5, 5), 1.0);
 
-    // 8. 添加噪声
+    // 7. 添加零均值高斯噪声：在浮点中生成，相加后四舍五入并饱和到 8 位
+    // (在 8 位矩阵中生成时负半部分被截为 0、其余取整，噪声只剩正偏的半高斯)
     if (noiseLevel > 0) {
-        Mat noise(finalImg.size(), finalImg.type());
-        randn(noise, 0, noiseLevel);
-        add(finalImg, noise, finalImg, noArray(), CV_8UC1);
+        Mat noise(finalImg.size(), CV_32F);
+        rng.fill(noise, RNG::NORMAL, 0, noiseLevel);
+        add(finalImg, noise, finalImg, noArray(), CV_8U);
     }
 
     // =========================================================
-    // 9. [新增] 添加椒盐噪声 (Salt-and-Pepper Noise)
+    // 8. [新增] 添加椒盐噪声 (Salt-and-Pepper Noise)
     // =========================================================
     // 椒盐噪声模拟灰尘(黑点)或坏点(白点)
     // 密度：假设 1% 的像素受到污染 (0.01)
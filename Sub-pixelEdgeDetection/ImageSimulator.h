@@ -1,6 +1,8 @@
 #pragma once
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <cstdint>
+#include "MarkGeometry.h"
 
 class ImageSimulator {
 public:
@@ -8,9 +10,43 @@ public:
     ~ImageSimulator();
 
     // ɾԲͼ
+    // Ϊ̬㰴 (ߴ, ߴ, Ƕ) 渲ʣÿͼֻڿ򸲸ǵأ
+    //  50  + INTER_AREA ²һ£߷ֱʻ
     // size: ͼС
-    // shiftX, shiftY: ƫ (Truth)
-    // noiseLevel: ȼ
+    // shiftX, shiftY: ƫ (Truth)
+    // noiseLevel: ֵ˹ı׼ (Ҷȼ)Ӻ󱥺͵ [0, 255]
     // angle: תǶ
     cv::Mat generateWaferImage(int size, double shiftX, double shiftY, double noiseLevel, double angle);
-};
\ No newline at end of file
+
+    //  (/Աȶɴ˲)
+    // ߳ʱÿ̳߳жģͼӼɱ֤ɸ
+    void setSeed(uint64_t seed);
+
+    // ñǼ (Ĭ WaferConfig)Ϊͬ䷽ģ/ͼ
+    void setGeometry(const MarkGeometry& geometry) { geom = geometry; }
+
+    // ̶뱳ĻҶȲ (0 = ÿͼ [60, 120] Ĭ)Ĳ䣬Կɸ
+    void setContrast(int contrast) { fixedContrast = contrast; }
+
+    // վ̬㻺
+    void clearLayerCache() { layers.clear(); }
+
+private:
+    // ̬㣺 (Լתʱ) ڵͷֱϵ (CV_32F, 0~1)
+    struct StaticLayer {
+        int size = 0;
+        int outerBoxSize = 0;
+        double angle = 0.0;
+        cv::Mat rotation;          // ߷ֱʻϵת (תʱΪ)
+        cv::Mat outerCoverage;
+        cv::Mat canvasCoverage;    // תԭڵı (תʱΪգȫΪ 1)
+    };
+
+    const StaticLayer& staticLayer(int size, double angle);
+
+    cv::RNG rng;
+    MarkGeometry geom;
+    int fixedContrast = 0;
+    std::vector<StaticLayer> layers;   // ʹõľ̬ (FIFO ̭)
+    cv::Mat composite;                 // ϳɻ (CV_32F)ͼ
+};
@@ -1,6 +1,8 @@
 #include "ImageUtils.h"
+#include "Utilities.h"
 #include <opencv2/imgproc.hpp>
 #include <iostream>
+#include <algorithm>
 
 // () ʱļͷļ
 #include <chrono>      // ʱ
@@ -28,35 +30,261 @@ cv::Mat EnhancementUtils::applyHistogramEqualization(const cv::Mat& input) {
 
 // --- ImagePreprocessor ʵ ---
 
-cv::Mat ImagePreprocessor::ensureGrayscale(const cv::Mat& input) {
+namespace {
+    // ໥صϲΪӾΣֱ֤ͼÿֻͳһ
+    std::vector<cv::Rect> mergeOverlapping(std::vector<cv::Rect> rects) {
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            for (size_t i = 0; i < rects.size() && !merged; ++i) {
+                for (size_t j = i + 1; j < rects.size(); ++j) {
+                    if ((rects[i] & rects[j]).area() > 0) {
+                        rects[i] = rects[i] | rects[j];
+                        rects.erase(rects.begin() + j);
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return rects;
+    }
+
+    //  cv::equalizeHist ȫһµĲұ
+    void buildEqualizeLut(const int* hist, int total, uchar* lut) {
+        int i = 0;
+        while (i < 255 && !hist[i]) ++i;
+
+        if (total == 0 || hist[i] == total) {
+            // ֻһֻҶȣequalizeHist Ľǳ i
+            for (int k = 0; k < 256; ++k) lut[k] = (uchar)i;
+            return;
+        }
+
+        float scale = 255.0f / (total - hist[i]);
+        int sum = 0;
+        for (lut[i++] = 0; i < 256; ++i) {
+            sum += hist[i];
+            lut[i] = cv::saturate_cast<uchar>(sum * scale);
+        }
+    }
+
+    // Եִзֵֿ˲ (д output ͬһ)hist ǿʱ˳ۼֱͼ
+    // дչ ksize/2 ȡʵͼ߽紦 medianBlur  BORDER_REPLICATE
+    // ڽ medianBlur ȫһ
+    void bandMedian(const cv::Mat& gray, cv::Mat& output, const cv::Rect& region, int ksize,
+        int tileRows, cv::Mat& bandBuffer, int* hist) {
+        const int border = ksize / 2;
+        const cv::Rect imageRect(0, 0, gray.cols, gray.rows);
+
+        // д߶ȣд + ֵ +  Լռ 256KB ( L2)
+        int band = tileRows;
+        if (band <= 0) band = std::max(16, (256 * 1024) / std::max(1, 3 * region.width));
+
+        for (int y = region.y; y < region.y + region.height; y += band) {
+            int rows = std::min(band, region.y + region.height - y);
+            cv::Rect target(region.x, y, region.width, rows);
+
+            cv::Rect context(target.x - border, target.y - border,
+                target.width + 2 * border, target.height + 2 * border);
+            context &= imageRect;
+
+            cv::medianBlur(gray(context), bandBuffer, ksize);
+
+            cv::Rect inner(target.x - context.x, target.y - context.y, target.width, target.height);
+            cv::Mat dst = output(target);
+            bandBuffer(inner).copyTo(dst);
+
+            if (!hist) continue;
+
+            // ڻУ˳ͳֱͼ
+            for (int r = 0; r < dst.rows; ++r) {
+                const uchar* p = dst.ptr<uchar>(r);
+                for (int c = 0; c < dst.cols; ++c) hist[p[c]]++;
+            }
+        }
+    }
+
+    void accumulateHistogram(const cv::Mat& img, int* hist) {
+        for (int r = 0; r < img.rows; ++r) {
+            const uchar* p = img.ptr<uchar>(r);
+            for (int c = 0; c < img.cols; ++c) hist[p[c]]++;
+        }
+    }
+
+    void applyLut(const cv::Mat& src, cv::Mat& dst, const uchar* lut) {
+        for (int r = 0; r < src.rows; ++r) {
+            const uchar* ps = src.ptr<uchar>(r);
+            uchar* pd = dst.ptr<uchar>(r);
+            for (int c = 0; c < src.cols; ++c) pd[c] = lut[ps[c]];
+        }
+    }
+
+    // üͼڲϲص
+    std::vector<cv::Rect> normalizeRects(const std::vector<cv::Rect>& rects, cv::Size size, int expand) {
+        const cv::Rect imageRect(0, 0, size.width, size.height);
+        std::vector<cv::Rect> out;
+        for (const cv::Rect& r : rects) {
+            cv::Rect e(r.x - expand, r.y - expand, r.width + 2 * expand, r.height + 2 * expand);
+            e &= imageRect;
+            if (e.area() > 0) out.push_back(e);
+        }
+        return mergeOverlapping(out);
+    }
+}
+
+const cv::Mat& ImagePreprocessor::ensureGrayscale(const cv::Mat& input, cv::Mat& buffer) {
     if (input.channels() == 3 || input.channels() == 4) {
-        cv::Mat gray;
-        cv::cvtColor(input, gray, cv::COLOR_BGR2GRAY);
-        return gray;
+        cv::cvtColor(input, buffer, cv::COLOR_BGR2GRAY);
+        return buffer;
+    }
+    else if (input.depth() == CV_16U) {
+        // ֱ convertTo(CV_8UC1)  >255  12/16 λȫضΪ 255ﰴ
+        int bits = sourceBits;
+        if (bits <= 0) bits = observedBits = Utilities::observedBits(input, observedBits);
+        input.convertTo(buffer, CV_8UC1, 255.0 / ((1 << bits) - 1));
+        return buffer;
     }
     else if (input.type() != CV_8UC1) {
-        cv::Mat gray8;
-        input.convertTo(gray8, CV_8UC1);
-        return gray8;
+        input.convertTo(buffer, CV_8UC1);
+        return buffer;
     }
-    return input.clone();
+    //  8 λҶȣ׶ζд壬 clone
+    return input;
 }
 
-cv::Mat ImagePreprocessor::preprocess(const cv::Mat& inputImage) {
+void ImagePreprocessor::preprocess(const cv::Mat& inputImage, cv::Mat& output, const std::vector<cv::Rect>& rois) {
     // 1. Ҷȿռ任 ( 3.2.1)
-    cv::Mat grayImg = ensureGrayscale(inputImage);
+    const cv::Mat& grayImg = ensureGrayscale(inputImage, grayBuffer);
+    const cv::Rect imageRect(0, 0, grayImg.cols, grayImg.rows);
+
+    // ֵ˲Ҫȡԭʼ빲ڴ
+    if (!output.empty() && output.datastart == grayImg.datastart) output.release();
+    output.create(grayImg.size(), CV_8UC1);
+
+    std::vector<cv::Rect> regions = rois.empty() ? std::vector<cv::Rect>{ imageRect }
+        : normalizeRects(rois, grayImg.size(), 0);
 
-    // 2. ˲ ( 3.2.2) - ѡֵ˲
-    cv::Mat filteredImg = FilterUtils::applyMedianFilter(grayImg, 3);
+    // 2. ˲ ( 3.2.2) + ֱͼͳƣдں
+    int hist[256] = { 0 };
+    int total = 0;
+    for (const cv::Rect& region : regions) {
+        bandMedian(grayImg, output, region, medianKernel, tileRows, bandBuffer, hist);
+        total += region.area();
+    }
 
-    // 3. ͼǿ ( 3.2.3) - ᵽֱͼ⻯
-    cv::Mat enhancedImg = EnhancementUtils::applyHistogramEqualization(filteredImg);
+    // 3. ͼǿ ( 3.2.3) - ֱͼ⻯ұԭ
+    uchar lut[256];
+    buildEqualizeLut(hist, total, lut);
+    for (const cv::Rect& region : regions) {
+        cv::Mat dst = output(region);
+        applyLut(dst, dst, lut);
+    }
+}
+
+cv::Mat ImagePreprocessor::preprocess(const cv::Mat& inputImage) {
+    cv::Mat enhancedImg;
+    preprocess(inputImage, enhancedImg);
 
     // std::cout << "[Preprocessor] ͼԤɡ" << std::endl;
     return enhancedImg;
 }
 
 
+// --- RoiPreprocessor ʵ ---
+
+RoiPreprocessor::RoiPreprocessor(int maxSobelKsize) : border(std::max(1, maxSobelKsize / 2)) {}
+
+void RoiPreprocessor::beginFrame(const cv::Mat& image, const std::vector<cv::Rect>& rois) {
+    // ÿεöΪ֡BufferPool / SharedFrameRing Ĳλͬһָأ
+    // ޷ƾ image.data жǷͬһ֡˻һ
+    frameSize = image.size();
+    baseRois = normalizeRects(rois, frameSize, 0);
+    workRois = normalizeRects(baseRois, frameSize, border);
+    hasMedian = hasEqualized = false;
+    for (SobelEntry& e : sobelCache) e.valid = false;
+
+    // ҶתҲֻ  + ֵ 
+    if (image.type() == CV_8UC1) {
+        gray = image;
+        return;
+    }
+    grayBuffer.create(frameSize, CV_8UC1);
+    for (const cv::Rect& r : normalizeRects(workRois, frameSize, 1)) {
+        cv::Mat dst = grayBuffer(r);
+        if (image.channels() == 3 || image.channels() == 4) cv::cvtColor(image(r), dst, cv::COLOR_BGR2GRAY);
+        else image(r).convertTo(dst, CV_8UC1);
+    }
+    gray = grayBuffer;
+}
+
+const cv::Mat& RoiPreprocessor::median() {
+    if (hasMedian) return medianImg;
+    CV_Assert(!gray.empty());
+
+    medianImg.create(frameSize, CV_8UC1);
+    for (const cv::Rect& r : workRois) {
+        bandMedian(gray, medianImg, r, 3, 0, bandBuffer, nullptr);
+    }
+    hasMedian = true;
+    return medianImg;
+}
+
+const cv::Mat& RoiPreprocessor::equalized() {
+    if (hasEqualized) return equalizedImg;
+    const cv::Mat& med = median();
+
+    // ֱͼֻͳƲڱұļ
+    int hist[256] = { 0 };
+    int total = 0;
+    for (const cv::Rect& r : baseRois) {
+        accumulateHistogram(med(r), hist);
+        total += r.area();
+    }
+    uchar lut[256];
+    buildEqualizeLut(hist, total, lut);
+
+    equalizedImg.create(frameSize, CV_8UC1);
+    for (const cv::Rect& r : workRois) {
+        cv::Mat dst = equalizedImg(r);
+        applyLut(med(r), dst, lut);
+    }
+    hasEqualized = true;
+    return equalizedImg;
+}
+
+const cv::Mat& RoiPreprocessor::sobel(int dx, int dy, int ksize) {
+    CV_Assert(ksize / 2 <= border);
+
+    SobelEntry* entry = nullptr;
+    for (SobelEntry& e : sobelCache) {
+        if (e.dx == dx && e.dy == dy && e.ksize == ksize) { entry = &e; break; }
+    }
+    if (!entry) {
+        sobelCache.push_back({ dx, dy, ksize, cv::Mat(), false });
+        entry = &sobelCache.back();
+    }
+    if (entry->valid) return entry->grad;
+
+    const cv::Mat& eq = equalized();
+    entry->grad.create(frameSize, CV_16S);
+    for (const cv::Rect& r : baseRois) {
+        // Ӿϵ Sobel ȡͼ ROI  ksize/2 򣬸 workRois ڼ
+        cv::Mat dst = entry->grad(r);
+        cv::Sobel(eq(r), dst, CV_16S, dx, dy, ksize);
+    }
+    entry->valid = true;
+    return entry->grad;
+}
+
+double RoiPreprocessor::workFraction() const {
+    if (frameSize.area() == 0) return 0.0;
+    double area = 0.0;
+    for (const cv::Rect& r : workRois) area += r.area();
+    return area / frameSize.area();
+}
+
+
 // --- () ImageIOUtils ʵ ---
 
 void ImageIOUtils::saveImageWithTimestamp(const cv::Mat& image, const std::string& outputFolder) {
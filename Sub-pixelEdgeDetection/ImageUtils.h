@@ -2,6 +2,9 @@
 
 #include <opencv2/opencv.hpp>
 #include <string> // ()  string ͷļ
+#include <vector>
+#include <deque>
+#include <algorithm>
 
 /**
  * @class FilterUtils
@@ -47,13 +50,96 @@ public:
      */
     cv::Mat preprocess(const cv::Mat& inputImage);
 
+    /**
+     * @brief ںϵķֿԤֵ˲ֱͼͳưд (band) У L2 ڣ
+     *        òұԭɾ⻯κмͼ
+     * @param inputImage ԭʼͼ ( 8 λҶʱκο)
+     * @param output [] ṩĻ壬ߴ/ƥʱֱӸڴ (빲)
+     * @param rois ǿʱֻЩ (ֵ˲Զȡ)
+     *             ֱͼҲֻͳЩز֤Ч
+     */
+    void preprocess(const cv::Mat& inputImage, cv::Mat& output, const std::vector<cv::Rect>& rois = std::vector<cv::Rect>());
+
+    /**
+     * @brief ÷ֿ (0 =  L2 ԤԶѡ)
+     */
+    void setTileRows(int rows) { tileRows = rows; }
+
+    /**
+     * @brief øλЧλ ( 12 λݴ 16 λ)
+     *        ת 8 λʱ (2^bits - 1) Ŷǽضϡ
+     *        bits <= 0 (Ĭ) ʾδ֪֡Ҷƶ (Utilities::observedBits)
+     */
+    void setSourceBits(int bits) { sourceBits = (bits <= 0) ? 0 : std::max(9, std::min(16, bits)); }
+
 private:
     /**
      * @brief ȷͼ8λҶͼ (3.2.1)
+     * Ԥ (ֵ + 256 ֱͼ⻯)  8 λƣ· (Localization) ֱӶȡ 16 λ֡
      * @param input ͼ
-     * @return cv::Mat 8λҶͼ
+     * @param buffer Ҫתʱʹõĸû塣
+     * @return const cv::Mat& 8λҶͼ ( CV_8UC1 ʱֱӷ input )
+     */
+    const cv::Mat& ensureGrayscale(const cv::Mat& input, cv::Mat& buffer);
+
+    int tileRows = 0;
+    int medianKernel = 3;   // 3.2.2ڵֵ˲
+    int sourceBits = 0;     // 16 λЧλ (0 = δ֪֡ƶ)
+    int observedBits = 0;   // λδ֪ʱ۲쵽λ
+    cv::Mat grayBuffer;     // ɫ/λת (֡)
+    cv::Mat bandBuffer;     // дֵ˲ (֡)
+};
+
+
+/**
+ * @class RoiPreprocessor
+ * @brief Ե ROI ԤֻھλʵʶȡĴ (ϸ˲ı߿) ϼ㣬
+ *        ֡档
+ *
+ * ÷ÿ֡ beginFrame(image, Localization::edgeRois(coarsePos))ٰȡ
+ * median() / equalized() / sobel() beginFrame ֮ظֱӷػ棻Ϊߴ
+ * û壬 ROI ڵЧֱӽ fineLocalization ʹá
+ * ⻯ֱͼֻͳ ROI ڵ (⻯Ĳұͬ)
+ */
+class RoiPreprocessor {
+public:
+    /**
+     * @param maxSobelKsize ֮ Sobel ˣ ROI 
      */
-    cv::Mat ensureGrayscale(const cv::Mat& input);
+    explicit RoiPreprocessor(int maxSobelKsize = 3);
+
+    /**
+     * @brief ʼµһ֡һ֡ȫ (֡)
+     * @param image ԭʼͼ
+     * @param rois λ (ͨɴֶλλõõ)
+     */
+    void beginFrame(const cv::Mat& image, const std::vector<cv::Rect>& rois);
+
+    // ֵ˲ (8λ)
+    const cv::Mat& median();
+
+    // ֵ˲ + ֱͼ⻯ (8λ)
+    const cv::Mat& equalized();
+
+    //  equalized() ֮ϵ Sobel ݶ (CV_16S GradientUtils::applySobel һ)
+    const cv::Mat& sobel(int dx, int dy, int ksize = 3);
+
+    // ʵʲռı
+    double workFraction() const;
+
+private:
+    int border;                       // Sobel  (maxSobelKsize / 2)
+    cv::Size frameSize;
+    std::vector<cv::Rect> baseRois;   // ϲĲ
+    std::vector<cv::Rect> workRois;   //  border ϲļ
+
+    cv::Mat gray, grayBuffer;
+    cv::Mat medianImg, equalizedImg, bandBuffer;
+    bool hasMedian = false, hasEqualized = false;
+
+    // deque ׷ԪزʹѷصʧЧ
+    struct SobelEntry { int dx, dy, ksize; cv::Mat grad; bool valid; };
+    std::deque<SobelEntry> sobelCache;
 };
 
 
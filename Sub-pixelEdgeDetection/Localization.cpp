@@ -1,15 +1,128 @@
 #include "Localization.h"
 #include "WaferConfig.h"   
 #include "ImageSimulator.h"
+#include "Utilities.h"
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <numeric>
+#include <limits>
 
 using namespace cv;
 using namespace std;
 using namespace WaferConfig;
 
-Localization::Localization() {
+namespace {
+    // βֵ˸ȥ trimRatio ȡƽ (trimRatio ӽ 0.5 ʱ˻Ϊλ)
+    double trimmedMean(vector<double> v, double trimRatio) {
+        sort(v.begin(), v.end());
+        int n = (int)v.size();
+        int cut = std::min((int)(n * trimRatio), (n - 1) / 2);
+        double sum = 0.0;
+        for (int i = cut; i < n - cut; ++i) sum += v[i];
+        return sum / (n - 2 * cut);
+    }
+
+    // ³ɢȣ1.4826 * MAD (˹µȼڱ׼)
+    double robustSpread(vector<double> v) {
+        if (v.size() < 2) return 0.0;
+        auto median = [](vector<double>& a) {
+            size_t h = a.size() / 2;
+            nth_element(a.begin(), a.begin() + h, a.end());
+            double m = a[h];
+            if (a.size() % 2 == 0) m = (m + *max_element(a.begin(), a.begin() + h)) / 2.0;
+            return m;
+            };
+        double med = median(v);
+        for (double& x : v) x = std::abs(x - med);
+        return 1.4826 * median(v);
+    }
+
+    // ڵԤͳ
+    // ͶӰ (رԵȡֵ) ļԱȶȣرԵֻ֮ռ
+    // ֻѴﵽ̵ؼΪͣҶΪ 0 İ񣬲
+    template <typename T>
+    double windowStats(const Mat& image, const Rect& roi, int direction, int satLevel, int& saturated,
+        vector<double>& profile, vector<float>& diffs) {
+        int len = (direction == 0) ? roi.width : roi.height;
+        if (len <= 0) return 0.0;
+        profile.assign(len, 0.0);
+
+        for (int y = roi.y; y < roi.y + roi.height; ++y) {
+            const T* row = image.ptr<T>(y);
+            const T* prev = (y > roi.y) ? image.ptr<T>(y - 1) : nullptr;
+            for (int x = roi.x; x < roi.x + roi.width; ++x) {
+                int v = row[x];
+                if (v >= satLevel) saturated++;
+                if (direction == 0) {
+                    profile[x - roi.x] += v;
+                    if (prev) diffs.push_back((float)(v - prev[x]));
+                }
+                else {
+                    profile[y - roi.y] += v;
+                    if (x > roi.x) diffs.push_back((float)(v - row[x - 1]));
+                }
+            }
+        }
+
+        auto range = minmax_element(profile.begin(), profile.end());
+        int across = (direction == 0) ? roi.height : roi.width;
+        return (*range.second - *range.first) / across;
+    }
+
+    // SSDA ɨ裺λ (x, y) Դھֵ/׼һͼһģϡۼӾ
+    // ֺ >= ǰʱۼλñȻ (ȫȡСֵȫһ)
+    template <typename T>
+    bool ssdaScan(const Mat& image, const Rect& region, Size templSize, const vector<int>& offsets,
+        const vector<float>& values, const Mat& sum, const Mat& sqsum, Point& best) {
+        const int cols = region.width - templSize.width + 1;
+        const int rows = region.height - templSize.height + 1;
+        const double n = (double)templSize.area();
+        const size_t count = offsets.size();
+        float bestErr = numeric_limits<float>::max();
+        bool found = false;
+
+        for (int y = 0; y < rows; ++y) {
+            const double* s0 = sum.ptr<double>(y);
+            const double* s1 = sum.ptr<double>(y + templSize.height);
+            const double* q0 = sqsum.ptr<double>(y);
+            const double* q1 = sqsum.ptr<double>(y + templSize.height);
+            const T* base = image.ptr<T>(region.y + y) + region.x;
+
+            for (int x = 0; x < cols; ++x) {
+                int xe = x + templSize.width;
+                double s = s1[xe] - s1[x] - s0[xe] + s0[x];
+                double q = q1[xe] - q1[x] - q0[xe] + q0[x];
+                double mean = s / n;
+                double var = q / n - mean * mean;
+                if (!(var > 0.0)) continue;   // ƽ̹ڣ޶
+
+                float inv = (float)(1.0 / std::sqrt(var));
+                float off = (float)(mean / std::sqrt(var));
+                const T* p = base + x;
+                float err = 0.f;
+                size_t k = 0;
+                for (; k < count; ++k) {
+                    err += std::abs(p[offsets[k]] * inv - off - values[k]);
+                    if (err >= bestErr) break;
+                }
+                if (k == count) {
+                    bestErr = err;
+                    best = Point(region.x + x, region.y + y);
+                    found = true;
+                }
+            }
+        }
+        return found;
+    }
+}
+
+Localization::Localization() : subStrips(ROI_SUB_STRIPS) {
     model = new SubPixelModel();
+    // ĬϼƻWaferConfig Σģ״δֶλʱ
+    plan = RecipeRegistry::buildPlan(0, "WaferConfig", MarkGeometry::fromConfig());
 }
 
 Localization::~Localization() {
@@ -17,110 +130,501 @@ Localization::~Localization() {
 }
 
 void Localization::createTemplate(const cv::Mat& image, cv::Rect roi) {
+    templFloatSource = nullptr;
+    sparseSource = nullptr;
     if (roi.area() > 0 && (roi.x + roi.width <= image.cols) && (roi.y + roi.height <= image.rows)) {
         this->templ = image(roi).clone();
     }
     else {
         ImageSimulator sim;
-        this->templ = sim.generateWaferImage(WaferConfig::WAFER_SIZE, 0, 0, 0, 0);
+        sim.setGeometry(plan->geometry);
+        this->templ = sim.generateWaferImage(plan->geometry.waferSize, 0, 0, 0, 0);
     }
 }
 
-cv::Point Localization::coarseLocalization(const cv::Mat& image) {
+bool Localization::loadRecipe(const std::string& path) {
+    auto t0 = chrono::steady_clock::now();
+    auto loaded = RecipeRegistry::buildFromFile(0, path);
+    if (!loaded) return false;
+
+    setPlan(loaded);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    cout << "[Recipe] Loaded '" << plan->name << "' (" << templ.cols << "x" << templ.rows << ") in " << ms << " ms" << endl;
+    return true;
+}
+
+void Localization::setPlan(std::shared_ptr<const RecipePlan> p) {
+    if (!p || p == plan) return;
+    plan = p;
+    // ģƻ滻ƻģʱգ coarsePeak ¼ƻļɣ
+    // һ䷽ģȥƥ¼
+    templ = plan->templ;
+    templFloatSource = nullptr;
+    sparseSource = nullptr;
+    subStrips = std::max(1, plan->geometry.subStrips);
+    // 尴ƻһԤ֮֡
+    if ((int)profileBuffer.capacity() < plan->profileCapacity) profileBuffer.reserve(plan->profileCapacity);
+}
+
+cv::Point Localization::coarseLocalization(const cv::Mat& image, double* score) {
+    CoarsePeak peak = coarsePeak(image);
+    if (score) *score = peak.score;
+    return peak.location;
+}
+
+CoarsePeak Localization::coarsePeak(const cv::Mat& image) {
+    if (templ.empty()) createTemplate(image, Rect(0, 0, 0, 0));
+    return matchRegion(image, Rect(0, 0, image.cols, image.rows));
+}
+
+CoarsePeak Localization::coarseLocalizationCascade(const cv::Mat& image, YoloDetector* detector) {
     if (templ.empty()) createTemplate(image, Rect(0, 0, 0, 0));
+    if (!detector) return coarsePeak(image);
+
+    vector<Detection> candidates = detector->detectAll(image);
+    if (candidates.empty()) return coarsePeak(image);
+
+    // ѡ   (ѵעԱΪĵģС)
+    // ÿѡֻƥ (2*PAD+1)^2 λãȫͼƥ (W-400+1)*(H-400+1) 
+    // ŷŴ (320 롢ʱ 1 س 12 ͼ)PAD űȡ
+    const Rect imageRect(0, 0, image.cols, image.rows);
+    const int basePad = std::max(CASCADE_SEARCH_PAD, (int)std::ceil(CASCADE_BOX_ERROR_NET_PX * detector->imageScale(image)));
+
+    // ֵڲ߽ (ñ߲ͼ߽) ʱֵ
+    auto onBorder = [&](const CoarsePeak& p, const Rect& region) {
+        Point off = p.location - region.tl();
+        return (off.x <= 0 && region.x > 0) || (off.y <= 0 && region.y > 0) ||
+            (off.x >= region.width - templ.cols && region.br().x < image.cols) ||
+            (off.y >= region.height - templ.rows && region.br().y < image.rows);
+        };
+
+    CoarsePeak best;
+    bool found = false;
+    int n = std::min((int)candidates.size(), CASCADE_MAX_CANDIDATES);
+    for (int i = 0; i < n; ++i) {
+        const Rect& box = candidates[i].box;
+        Point tl(box.x + box.width / 2 - templ.cols / 2, box.y + box.height / 2 - templ.rows / 2);
+        int pad = basePad;
+
+        for (int step = 0; step <= CASCADE_WIDEN_STEPS; ++step) {
+            Rect region = Rect(tl.x - pad, tl.y - pad, templ.cols + 2 * pad, templ.rows + 2 * pad) & imageRect;
+            if (region.width < templ.cols || region.height < templ.rows) break;
+
+            CoarsePeak peak = matchRegion(image, region);
+            if (!onBorder(peak, region)) {
+                if (!found || peak.score > best.score) best = peak;
+                found = true;
+                break;
+            }
+            // Աֵ߽ΪġPAD ӱƥ
+            tl = peak.location;
+            pad *= 2;
+        }
+    }
+    // ѡ򶼷Ųģ (ͼԵ) ֵʼڱ߽ʱ˻ȫͼ
+    return found ? best : coarsePeak(image);
+}
+
+void Localization::buildSparseTemplate() {
+    sparseSource = templ.data;
+    sparsePoints.clear();
+    sparseValues.clear();
+
+    Mat f;
+    templ.convertTo(f, CV_32F);
+    Scalar mean, stddev;
+    meanStdDev(f, mean, stddev);
+    if (stddev[0] <= 0.0) return;
 
-    int result_cols = image.cols - templ.cols + 1;
-    int result_rows = image.rows - templ.rows + 1;
-    if (result_cols <= 0 || result_rows <= 0) return Point(0, 0);
+    // ǵĴ󲿷ƽ̹򣬶λûϢֻݶȽϴıԵ (ԵĹɴ)
+    Mat gx, gy, mag;
+    Sobel(f, gx, CV_32F, 1, 0);
+    Sobel(f, gy, CV_32F, 0, 1);
+    magnitude(gx, gy, mag);
+    double maxMag = 0.0;
+    minMaxLoc(mag, nullptr, &maxMag);
+    if (maxMag <= 0.0) return;
 
-    Mat result;
+    float thresh = (float)(SPARSE_EDGE_FRACTION * maxMag);
+    for (int y = 0; y < mag.rows; ++y) {
+        const float* m = mag.ptr<float>(y);
+        for (int x = 0; x < mag.cols; ++x) {
+            if (m[x] >= thresh) sparsePoints.emplace_back(x, y);
+        }
+    }
+
+    // ˳ (̶)ǰĲֺ;ܴ壬λþ糬ֵʱȳ
+    RNG shuffle(0x55DA);
+    for (int i = (int)sparsePoints.size() - 1; i > 0; --i) {
+        std::swap(sparsePoints[i], sparsePoints[shuffle.uniform(0, i + 1)]);
+    }
+    if ((int)sparsePoints.size() > SPARSE_MATCH_POINTS) sparsePoints.resize(SPARSE_MATCH_POINTS);
+
+    sparseValues.reserve(sparsePoints.size());
+    for (const Point& p : sparsePoints) {
+        sparseValues.push_back((float)((f.at<float>(p) - mean[0]) / stddev[0]));
+    }
+}
+
+bool Localization::sparseCandidate(const cv::Mat& image, const cv::Rect& region, cv::Point& best) {
+    if (image.channels() != 1 || (image.depth() != CV_8U && image.depth() != CV_16U)) return false;
+    if (sparseSource != templ.data) buildSparseTemplate();
+    if (sparsePoints.empty()) return false;
+
+    integral(image(region), integralSum, integralSqSum, CV_64F, CV_64F);
+
+    size_t step = image.step1();
+    sparseOffsets.resize(sparsePoints.size());
+    for (size_t k = 0; k < sparsePoints.size(); ++k) {
+        sparseOffsets[k] = (int)(sparsePoints[k].y * step + sparsePoints[k].x);
+    }
+
+    if (image.depth() == CV_8U) {
+        return ssdaScan<uchar>(image, region, templ.size(), sparseOffsets, sparseValues, integralSum, integralSqSum, best);
+    }
+    return ssdaScan<ushort>(image, region, templ.size(), sparseOffsets, sparseValues, integralSum, integralSqSum, best);
+}
+
+CoarsePeak Localization::matchRegion(const cv::Mat& image, const cv::Rect& searchRegion) {
+    CoarsePeak peak;
+    Rect region = searchRegion;
+
+    // ϡSSDA ѡʤλãֻ PAD  ( + طֵ)
+    const int verifySide = 2 * SPARSE_VERIFY_PAD + 1;
+    if (sparseSearch && region.width >= templ.cols && region.height >= templ.rows &&
+        (region.width - templ.cols + 1) * (region.height - templ.rows + 1) > verifySide * verifySide) {
+        Point best;
+        if (sparseCandidate(image, region, best)) {
+            region = Rect(best.x - SPARSE_VERIFY_PAD, best.y - SPARSE_VERIFY_PAD,
+                templ.cols + 2 * SPARSE_VERIFY_PAD, templ.rows + 2 * SPARSE_VERIFY_PAD) & searchRegion;
+        }
+    }
+
+    int result_cols = region.width - templ.cols + 1;
+    int result_rows = region.height - templ.rows + 1;
+    if (result_cols <= 0 || result_rows <= 0) return peak;
+
+    Mat& result = matchBuffer;
     result.create(result_rows, result_cols, CV_32FC1);
-    matchTemplate(image, templ, result, TM_CCOEFF_NORMED);
+    if (image.depth() == CV_8U && templ.depth() == CV_8U) {
+        matchTemplate(image(region), templ, result, TM_CCOEFF_NORMED);
+    }
+    else {
+        // TM_CCOEFF_NORMED ȵŲ䣬8 λģ 16 λͼͳһ
+        if (templFloatSource != templ.data || templFloat.empty()) {
+            templ.convertTo(templFloat, CV_32F);
+            templFloatSource = templ.data;
+        }
+        image(region).convertTo(regionFloat, CV_32F);
+        matchTemplate(regionFloat, templFloat, result, TM_CCOEFF_NORMED);
+    }
 
     double minVal, maxVal;
     Point minLoc, maxLoc;
     minMaxLoc(result, &minVal, &maxVal, &minLoc, &maxLoc);
 
-    return maxLoc;
+    peak.location = maxLoc + region.tl();
+    peak.position = Point2d(peak.location);
+    peak.score = maxVal;
+    if (maxLoc.x < 1 || maxLoc.y < 1 || maxLoc.x >= result_cols - 1 || maxLoc.y >= result_rows - 1) return peak;
+
+    // 3x3 x / y ֱ f(d) = c + b d - k/2 d^2
+    auto at = [&](int dx, int dy) { return (double)result.at<float>(maxLoc.y + dy, maxLoc.x + dx); };
+    double c = at(0, 0);
+    double kx = 2.0 * c - at(-1, 0) - at(1, 0);
+    double ky = 2.0 * c - at(0, -1) - at(0, 1);
+    if (kx <= 1e-9 || ky <= 1e-9) return peak;
+
+    double dx = (at(1, 0) - at(-1, 0)) / (2.0 * kx);
+    double dy = (at(0, 1) - at(0, -1)) / (2.0 * ky);
+    peak.position = Point2d(peak.location.x + std::max(-0.5, std::min(0.5, dx)), peak.location.y + std::max(-0.5, std::min(0.5, dy)));
+
+    // ȷȣߴӷֵ½ (1 - score) λƣˮƽӦλö
+    // ȡϴ (ƽķ)
+    double noise = std::max(1.0 - maxVal, 1e-4);
+    peak.uncertainty = std::sqrt(2.0 * noise / std::min(kx, ky));
+    return peak;
+}
+
+int Localization::adaptiveSearchLen(const CoarsePeak& peak) const {
+    int full = plan->geometry.roiSearchLen;
+    int minLen = std::min(ROI_MIN_SEARCH_LEN, full);
+    if (!(peak.uncertainty < full)) return full;
+
+    int len = minLen + 2 * (int)std::ceil(COARSE_UNCERTAINTY_SIGMAS * peak.uncertainty);
+    return std::max(minLen, std::min(full, len));
 }
 
-cv::Point Localization::coarseLocalizationYolo(const cv::Mat& image, YoloDetector* detector) {
+cv::Point Localization::coarseLocalizationYolo(const cv::Mat& image, YoloDetector* detector, double* score) {
+    if (score) *score = 0.0;
     if (!detector) return Point(0, 0);
-    Rect box = detector->detect(image);
+    float confidence = 0.f;
+    Rect box = detector->detect(image, &confidence);
+    if (score) *score = confidence;
     return box.tl();
 }
 
-cv::Point2d Localization::fineLocalization(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type) {
-    Point centerPos = coarsePos + Point(WaferConfig::WAFER_SIZE / 2, WaferConfig::WAFER_SIZE / 2);
+bool Localization::assessQuality(const cv::Mat& image, cv::Point coarsePos, double matchScore, FrameQuality& q) const {
+    q = FrameQuality();
+    q.matchScore = matchScore;
 
-    if (centerPos.x < 0 || centerPos.x >= image.cols || centerPos.y < 0 || centerPos.y >= image.rows) {
-        return Point2d(-999.0, -999.0);
+    // 1. ÷֣˵ļ飬
+    if (matchScore >= 0.0 && matchScore < gate.minMatchScore) {
+        q.verdict = QUALITY_LOW_SCORE;
+        return false;
     }
 
-    int outerRadius = OUTER_BOX_SIZE / 2;
-    int innerRadius = INNER_BOX_SIZE / 2;
+    // 2. Խͼ񣺳 gate.maxClippedWindows ڱüܾ (õһֵı߲)
+    //    ΧڵĴڰüĲͳƣ뾫λĲüʽһ
+    const MarkGeometry& g = plan->geometry;
+    vector<Rect> rois = edgeRois(coarsePos, g);
+    const Rect imageRect(0, 0, image.cols, image.rows);
+    int clipped = 0;
+    for (Rect& r : rois) {
+        Rect inside = r & imageRect;
+        if (inside != r) {
+            clipped++;
+            r = inside;
+        }
+    }
+    if (clipped > gate.maxClippedWindows) {
+        q.verdict = QUALITY_OUT_OF_VIEW;
+        return false;
+    }
 
-    auto measureEdge = [&](int offset, int direction) -> double {
-        Point roiCenter;
-        Rect roiRect;
+    // ֵֻ֧ͨͼıжʽؼ
+    if (image.channels() != 1 || (image.depth() != CV_8U && image.depth() != CV_16U)) return true;
+    const double scale = fullScale(image);
+    const int satLevel = (int)scale;
 
-        // ȷ ROI 㹻Աþطʱ㹻ıο
-        int searchLen = ROI_SEARCH_LEN;
+    // 3. ÿһαͶӰԱȶȡؼرԵĲ
+    double contrast[8];
+    int saturated = 0, total = 0;
+    vector<float>& diffs = gateDiffs;   // ֡ãȶٷ
+    diffs.clear();
+    for (int i = 0; i < 8; ++i) {
+        int direction = plan->edges[i].direction;
+        contrast[i] = (image.depth() == CV_8U)
+            ? windowStats<uchar>(image, rois[i], direction, satLevel, saturated, gateProfile, diffs)
+            : windowStats<ushort>(image, rois[i], direction, satLevel, saturated, gateProfile, diffs);
+        total += rois[i].area();
+    }
 
-        if (direction == 0) { // X
-            roiCenter = centerPos + Point(offset, 0);
-            roiRect = Rect(roiCenter.x - searchLen / 2, roiCenter.y - ROI_SEARCH_WID / 2,
-                searchLen, ROI_SEARCH_WID);
-        }
-        else { // Y
-            roiCenter = centerPos + Point(0, offset);
-            roiRect = Rect(roiCenter.x - ROI_SEARCH_WID / 2, roiCenter.y - searchLen / 2,
-                ROI_SEARCH_WID, searchLen);
-        }
+    // ǰ棺λʧܵıߣʧʱ˳
+    std::iota(q.edgeOrder, q.edgeOrder + 8, 0);
+    std::sort(q.edgeOrder, q.edgeOrder + 8, [&](int a, int b) { return contrast[a] < contrast[b]; });
+    q.minContrast = contrast[q.edgeOrder[0]];
+    q.saturation = total > 0 ? (double)saturated / total : 0.0;
 
-        roiRect = roiRect & Rect(0, 0, image.cols, image.rows);
-        if (roiRect.area() == 0) return -999.0;
+    // ֵ MADԵӰλ֮ķΪ 2 sigma^2
+    if (!diffs.empty()) {
+        for (float& d : diffs) d = std::abs(d);
+        size_t h = diffs.size() / 2;
+        nth_element(diffs.begin(), diffs.begin() + h, diffs.end());
+        q.noiseSigma = 1.4826 * diffs[h] / std::sqrt(2.0);
+    }
+    //  (1/sqrt(12) Ҷȼ)ͼõ SNR
+    q.snr = q.minContrast / std::max(q.noiseSigma, 0.29);
+
+    if (q.minContrast < g.edgeGradientThreshold * scale / 255.0) q.verdict = QUALITY_LOW_CONTRAST;
+    else if (q.saturation > gate.maxSaturation) q.verdict = QUALITY_SATURATED;
+    else if (q.snr < gate.minSnr) q.verdict = QUALITY_LOW_SNR;
+    return q.verdict == QUALITY_OK;
+}
+
+cv::Rect Localization::edgeRoi(cv::Point centerPos, int offset, int direction, const MarkGeometry& geometry) {
+    Point roiCenter;
+
+    // ȷ ROI 㹻Աþطʱ㹻ıο
+    int searchLen = geometry.roiSearchLen;
+    int searchWid = geometry.roiSearchWid;
+
+    if (direction == 0) { // X
+        roiCenter = centerPos + Point(offset, 0);
+        return Rect(roiCenter.x - searchLen / 2, roiCenter.y - searchWid / 2,
+            searchLen, searchWid);
+    }
+    else { // Y
+        roiCenter = centerPos + Point(0, offset);
+        return Rect(roiCenter.x - searchWid / 2, roiCenter.y - searchLen / 2,
+            searchWid, searchLen);
+    }
+}
+
+std::vector<cv::Rect> Localization::edgeRois(cv::Point coarsePos, const MarkGeometry& geometry) {
+    Point centerPos = coarsePos + Point(geometry.waferSize / 2, geometry.waferSize / 2);
+    int outerRadius = geometry.outerBoxSize / 2;
+    int innerRadius = geometry.innerBoxSize / 2;
 
-        Mat roi = image(roiRect);
-        Mat projectionMat;
-        vector<double> profile;
+    return {
+        edgeRoi(centerPos, -outerRadius, 0, geometry), edgeRoi(centerPos, outerRadius, 0, geometry),
+        edgeRoi(centerPos, -innerRadius, 0, geometry), edgeRoi(centerPos, innerRadius, 0, geometry),
+        edgeRoi(centerPos, -outerRadius, 1, geometry), edgeRoi(centerPos, outerRadius, 1, geometry),
+        edgeRoi(centerPos, -innerRadius, 1, geometry), edgeRoi(centerPos, innerRadius, 1, geometry)
+    };
+}
+
+double Localization::fullScale(const cv::Mat& image) const {
+    if (image.depth() != CV_16U) return 255.0;
+    int bits = sensorBits;
+    if (bits <= 0) bits = observedBits = Utilities::observedBits(image, observedBits);
+    return (double)((1 << bits) - 1);
+}
+
+double Localization::fitProfile(const std::vector<double>& profile, SubPixelModel::ModelType type) const {
+    if (profile.empty()) return -999.0;
+
+    // ݶȼ
+    auto range = minmax_element(profile.begin(), profile.end());
+    double pMin = *range.first, pMax = *range.second;
+    // Աȶ̫ͣΪЧ (ֵ 8 λ궨λ֡ȱ)
+    if ((pMax - pMin) < plan->geometry.edgeGradientThreshold * thresholdScale) return -999.0;
+
+    // λ ( ROI )
+    // ˮߴ SpatialMoment (ݶ)ͼ SubPixelModel::calculateEdge
+    return model->calculateEdge(profile, type);
+}
+
+double Localization::fitWindow(const cv::Rect& win, int direction, SubPixelModel::ModelType type) {
+    // ͶӰ (ͼȼ reduce ֵ)
+    if (!projector.profile(win, direction, profileBuffer)) return -999.0;
+    return fitProfile(profileBuffer, type);
+}
 
-        // ͶӰ
-        if (direction == 0) reduce(roi, projectionMat, 0, REDUCE_AVG, CV_64F);
-        else                reduce(roi, projectionMat, 1, REDUCE_AVG, CV_64F);
+bool Localization::prepareFine(const cv::Mat& image, cv::Point coarsePos, int searchLen, unsigned edgeMask,
+    MarkGeometry& g, cv::Point& centerPos) {
+    // Ӧֻ̲ĳȣͶӰϵĹ֮
+    g = plan->geometry;
+    bool shrunk = searchLen > 0 && searchLen < g.roiSearchLen;
+    if (shrunk) g.roiSearchLen = searchLen;
+    centerPos = coarsePos + Point(g.waferSize / 2, g.waferSize / 2);
+    thresholdScale = fullScale(image) / 255.0;
 
-        if (projectionMat.isContinuous()) {
-            profile.assign((double*)projectionMat.datastart, (double*)projectionMat.dataend);
+    if (centerPos.x < 0 || centerPos.x >= image.cols || centerPos.y < 0 || centerPos.y >= image.rows) return false;
+
+    // ÿֻ֡ () Ϲһλͼ֮ͶӰΪ O(1) 
+    // ䷽ƻģãֻƽƵֶλλã̵Ĵڰͬ
+    regionBuffer.clear();
+    if (shrunk) {
+        vector<Rect> rois = edgeRois(coarsePos, g);
+        int m = g.projectionMargin;
+        for (int i = 0; i < 8; ++i) {
+            if (edgeMask & (1u << i)) regionBuffer.push_back(Rect(rois[i].x - m, rois[i].y - m, rois[i].width + 2 * m, rois[i].height + 2 * m));
         }
-        else {
-            return -999.0;
+    }
+    else {
+        for (int i = 0; i < (int)plan->projectionRegions.size(); ++i) {
+            if (edgeMask & (1u << i)) regionBuffer.push_back(plan->projectionRegions[i] + coarsePos);
         }
+    }
+    projector.build(image, regionBuffer);
+    return true;
+}
 
-        // ݶȼ
-        double pMin, pMax;
-        minMaxLoc(projectionMat, &pMin, &pMax);
-        // Աȶ̫ͣΪЧ
-        if ((pMax - pMin) < EDGE_GRADIENT_THRESHOLD) return -999.0;
+int Localization::edgeStrips(const cv::Mat& image, cv::Point centerPos, int edgeIndex, const MarkGeometry& g,
+    std::vector<cv::Rect>& strips) const {
+    strips.clear();
+    int direction = plan->edges[edgeIndex].direction;
+    Rect roiRect = edgeRoi(centerPos, plan->edges[edgeIndex].offset, direction, g) & Rect(0, 0, image.cols, image.rows);
+    if (roiRect.area() == 0) return 0;
 
-        // λ ( ROI )
-        //  model->calculateEdge ѾΪ momentMethod
-        double subPixelRel = model->calculateEdge(profile, type);
+    int across = (direction == 0) ? roiRect.height : roiRect.width;
+    int k = std::max(1, std::min(subStrips, across));
+    for (int s = 0; s < k; ++s) {
+        int a0 = across * s / k, a1 = across * (s + 1) / k;
+        strips.push_back((direction == 0)
+            ? Rect(roiRect.x, roiRect.y + a0, roiRect.width, a1 - a0)
+            : Rect(roiRect.x + a0, roiRect.y, a1 - a0, roiRect.height));
+    }
+    return (direction == 0) ? roiRect.x : roiRect.y;
+}
 
-        if (subPixelRel == -999.0) return -999.0;
+EdgeMeasurement Localization::reduceStrips(std::vector<double>& positions, int k, double trimRatio) {
+    // һʧ (ڵ/ͶԱȶ) ΪЧ
+    EdgeMeasurement result;
+    if (k == 0 || (int)positions.size() * 2 < k) return result;
 
-        return (direction == 0) ? (roiRect.x + subPixelRel) : (roiRect.y + subPixelRel);
-        };
+    result.position = trimmedMean(positions, trimRatio);
+    result.straightness = robustSpread(positions);
+    result.validStrips = (int)positions.size();
+    return result;
+}
+
+EdgeMeasurement Localization::measureEdge(const cv::Mat& image, cv::Point centerPos, int edgeIndex,
+    const MarkGeometry& g, SubPixelModel::ModelType type) {
+    // ߣرԵг K λúβֵ
+    // ͶӰȫͬһŻͼظȡͼ
+    int origin = edgeStrips(image, centerPos, edgeIndex, g, stripBuffer);
+    int direction = plan->edges[edgeIndex].direction;
+
+    vector<double> positions;
+    for (const Rect& strip : stripBuffer) {
+        double rel = fitWindow(strip, direction, type);
+        if (rel != -999.0) positions.push_back(origin + rel);
+    }
+    return reduceStrips(positions, (int)stripBuffer.size(), g.stripTrimRatio);
+}
+
+bool Localization::captureProfiles(const cv::Mat& image, cv::Point coarsePos, FrameProfiles& out, int searchLen) {
+    MarkGeometry g;
+    Point centerPos;
+    bool inside = prepareFine(image, coarsePos, searchLen, 0xFFu, g, centerPos);
+
+    out.geometryKey = FrameProfiles::geometryKeyOf(g, plan->edges);
+    out.coarseX = coarsePos.x;
+    out.coarseY = coarsePos.y;
+    out.threshold = g.edgeGradientThreshold * thresholdScale;
+    out.stripTrimRatio = g.stripTrimRatio;
+    out.origins.clear();
+    out.samples.clear();
+    out.offsets.assign(1, 0);
+    std::fill(out.strips, out.strips + 8, 0);
+    if (!inside) return false;
+
+    for (int i = 0; i < 8; ++i) {
+        int origin = edgeStrips(image, centerPos, i, g, stripBuffer);
+        int direction = plan->edges[i].direction;
+        out.strips[i] = (int32_t)stripBuffer.size();
+        for (const Rect& strip : stripBuffer) {
+            // ͶӰʧܵΪ (һΪʧ)
+            if (projector.profile(strip, direction, profileBuffer)) out.samples.insert(out.samples.end(), profileBuffer.begin(), profileBuffer.end());
+            out.origins.push_back(origin);
+            out.offsets.push_back((uint32_t)out.samples.size());
+        }
+    }
+    return true;
+}
+
+cv::Point2d Localization::fitProfiles(const FrameProfiles& p, SubPixelModel::ModelType type, std::vector<EdgeMeasurement>* edges) {
+    // ⲿ𻵵ͶӰţԽǰܾ
+    if (!p.consistent()) return Point2d(-999.0, -999.0);
+
+    EdgeMeasurement m[8];
+    size_t s = 0;
+    for (int i = 0; i < 8; ++i) {
+        vector<double> positions;
+        for (int k = 0; k < p.strips[i]; ++k, ++s) {
+            profileBuffer.assign(p.samples.begin() + p.offsets[s], p.samples.begin() + p.offsets[s + 1]);
+            if (profileBuffer.empty()) continue;
 
-    double x_out_L = measureEdge(-outerRadius, 0);
-    double x_out_R = measureEdge(outerRadius, 0);
-    double x_in_L = measureEdge(-innerRadius, 0);
-    double x_in_R = measureEdge(innerRadius, 0);
+            //  fitProfile ͬĶԱȶȼ飬ֵȡɼʱֵ
+            auto range = minmax_element(profileBuffer.begin(), profileBuffer.end());
+            if ((*range.second - *range.first) < p.threshold) continue;
+
+            double rel = model->calculateEdge(profileBuffer, type);
+            if (rel != -999.0) positions.push_back(p.origins[s] + rel);
+        }
+        m[i] = reduceStrips(positions, p.strips[i], p.stripTrimRatio);
+    }
+    if (edges) edges->assign(m, m + 8);
+    return overlayFromEdges(m);
+}
 
-    // Y 
-    double y_out_T = measureEdge(-outerRadius, 1);
-    double y_out_B = measureEdge(outerRadius, 1);
-    double y_in_T = measureEdge(-innerRadius, 1);
-    double y_in_B = measureEdge(innerRadius, 1);
+cv::Point2d Localization::overlayFromEdges(const EdgeMeasurement m[8]) {
+    double x_out_L = m[0].position, x_out_R = m[1].position;
+    double x_in_L = m[2].position, x_in_R = m[3].position;
+    double y_out_T = m[4].position, y_out_B = m[5].position;
+    double y_in_T = m[6].position, y_in_B = m[7].position;
 
     if (x_out_L < 0 || x_out_R < 0 || x_in_L < 0 || x_in_R < 0 ||
         y_out_T < 0 || y_out_B < 0 || y_in_T < 0 || y_in_B < 0) {
@@ -135,5 +639,109 @@ cv::Point2d Localization::fineLocalization(const cv::Mat& image, cv::Point coars
     double innerCenterY = (y_in_T + y_in_B) / 2.0;
     double errorY = innerCenterY - outerCenterY;
 
+    return Point2d(errorX, errorY);
+}
+
+cv::Point2d Localization::fineLocalization(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type,
+    std::vector<EdgeMeasurement>* edges, const FrameQuality* quality, int searchLen) {
+    if (edges) edges->assign(8, EdgeMeasurement());
+
+    MarkGeometry g;
+    Point centerPos;
+    if (!prepareFine(image, coarsePos, searchLen, 0xFFu, g, centerPos)) return Point2d(-999.0, -999.0);
+
+    // ˳ͬ edgeRoisX, X, X, X, Y, Y, Y, Y
+    // ԤʱȲԱȶ͵ıߣһʧ֡Чʣı߲
+    static const int defaultOrder[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    const int* order = quality ? quality->edgeOrder : defaultOrder;
+    EdgeMeasurement m[8];
+    for (int k = 0; k < 8; ++k) {
+        int i = order[k];
+        m[i] = measureEdge(image, centerPos, i, g, type);
+        if (m[i].position < 0) break;
+    }
+    if (edges) edges->assign(m, m + 8);
+
+    return overlayFromEdges(m);
+}
+
+void Localization::fineEdges(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type,
+    unsigned edgeMask, EdgeMeasurement out[8], int searchLen) {
+    MarkGeometry g;
+    Point centerPos;
+    if (!prepareFine(image, coarsePos, searchLen, edgeMask, g, centerPos)) return;
+
+    for (int i = 0; i < 8; ++i) {
+        if (edgeMask & (1u << i)) out[i] = measureEdge(image, centerPos, i, g, type);
+    }
+}
+
+double Localization::estimateRotation(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type) {
+    const MarkGeometry& g = plan->geometry;
+    Point centerPos = coarsePos + Point(g.waferSize / 2, g.waferSize / 2);
+    int outerRadius = g.outerBoxSize / 2;
+    int span = plan->rotationProbeSpan;
+    thresholdScale = fullScale(image) / 255.0;
+
+    //  4 ߣÿرԵ -span / +span һ̽ⴰ
+    // ͬһߵڲͬλ֮Եб
+    vector<Rect> probes;
+    for (int side : { -outerRadius, outerRadius }) {
+        probes.push_back(edgeRoi(centerPos + Point(0, -span), side, 0, g));
+        probes.push_back(edgeRoi(centerPos + Point(0, span), side, 0, g));
+    }
+    for (int side : { -outerRadius, outerRadius }) {
+        probes.push_back(edgeRoi(centerPos + Point(-span, 0), side, 1, g));
+        probes.push_back(edgeRoi(centerPos + Point(span, 0), side, 1, g));
+    }
+    projector.build(image, probes);
+
+    vector<double> angles;
+    for (int e = 0; e < 4; ++e) {
+        int direction = (e < 2) ? 0 : 1;
+        double pa = fitWindow(probes[2 * e], direction, type);
+        double pb = fitWindow(probes[2 * e + 1], direction, type);
+        if (pa == -999.0 || pb == -999.0) continue;
+
+        // ʱת theta:  dx/dy = tan(theta) dy/dx = -tan(theta)
+        double delta = pb - pa;
+        angles.push_back(direction == 0 ? std::atan2(delta, 2.0 * span) : std::atan2(-delta, 2.0 * span));
+    }
+    if (angles.size() < 2) return -999.0;
+
+    double sum = 0.0;
+    for (double a : angles) sum += a;
+    return sum / angles.size() * 180.0 / CV_PI;
+}
+
+cv::Point2d Localization::fineLocalizationOriented(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type,
+    double* angleDeg) {
+    Point centerPos = coarsePos + Point(plan->geometry.waferSize / 2, plan->geometry.waferSize / 2);
+
+    double angle = estimateRotation(image, coarsePos, type);
+    if (angleDeg) *angleDeg = angle;
+    if (angle == -999.0) return Point2d(-999.0, -999.0);
+
+    //  0 Ͱʱ˻Ϊ봰ڣֱ߻ͼ· ()
+    if (std::abs(angle) < OrientedSampler::ANGLE_BUCKET_DEG / 2) {
+        return fineLocalization(image, coarsePos, type);
+    }
+
+    //  (ǶͰ, ) ȫֻ棬ÿֻ֡ 8 Լ 8*60*20 ˫Բֵ
+    auto tables = OrientedSampler::tables(angle, plan->oriented);
+
+    // λΪϵĵ꣬ĵ֮е
+    double u[8];
+    for (int i = 0; i < 8; ++i) {
+        const OrientedRoiTable& table = (*tables)[i];
+        if (!OrientedSampler::sample(image, centerPos, table, profileBuffer)) return Point2d(-999.0, -999.0);
+
+        double rel = fitProfile(profileBuffer, type);
+        if (rel == -999.0) return Point2d(-999.0, -999.0);
+        u[i] = table.startU + rel;
+    }
+
+    double errorX = (u[2] + u[3]) / 2.0 - (u[0] + u[1]) / 2.0;
+    double errorY = (u[6] + u[7]) / 2.0 - (u[4] + u[5]) / 2.0;
     return Point2d(errorX, errorY);
 }
\ No newline at end of file
@@ -1,7 +1,60 @@
 #pragma once
 #include <opencv2/opencv.hpp>
+#include <vector>
+#include <algorithm>
 #include "SubPixelModel.h"
 #include "YoloDetector.h"
+#include "ProjectionEngine.h"
+#include "OrientedSampler.h"
+#include "RecipeRegistry.h"
+#include "ProfileCache.h"
+#include "WaferConfig.h"
+#include <memory>
+#include <string>
+
+// ſؽ (׸ļ)
+enum QualityVerdict {
+    QUALITY_OK = 0,
+    QUALITY_OUT_OF_VIEW = 1,     // ԽͼĲڶ maxClippedWindows
+    QUALITY_LOW_SCORE = 2,       // ֶλ÷ֹ (ڵ/ޱ)
+    QUALITY_LOW_CONTRAST = 3,    // ĳԱȶȲ (뽹/ڵ)
+    QUALITY_SATURATED = 4,       // ع
+    QUALITY_LOW_SNR = 5          // Աȶ
+};
+
+// ſֵ (߶Աȶֵȡ䷽ƻ edgeGradientThreshold)
+struct QualityThresholds {
+    double minMatchScore = WaferConfig::GATE_MIN_MATCH_SCORE;
+    double maxSaturation = WaferConfig::GATE_MAX_SATURATION;
+    double minSnr = WaferConfig::GATE_MIN_SNR;
+    int maxClippedWindows = WaferConfig::GATE_MAX_CLIPPED_WINDOWS;
+};
+
+// ֡Ԥ
+struct FrameQuality {
+    QualityVerdict verdict = QUALITY_OK;
+    double matchScore = -1.0;    // ֶλ÷ (<0 ʾδ֪ж)
+    double minContrast = 0.0;    // 8 ͶӰԱȶȵСֵ
+    double saturation = 0.0;     // ڴﵽ̵ر
+    double noiseSigma = 0.0;     // ׼ (رԵز MAD)
+    double snr = 0.0;            // minContrast / noiseSigma
+    int edgeOrder[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };   // Աȶı
+};
+
+// ֶλط
+struct CoarsePeak {
+    cv::Point location;          // ֵ (ģϽ)
+    cv::Point2d position;        // 3x3 Ϻطֵ
+    double score = 0.0;          // ֵ÷ (TM_CCOEFF_NORMED)
+    double uncertainty = 1e9;    // λòȷ ()Խ⡢÷ԽԽСڱ߽ǼֵʱΪ 1e9
+};
+
+// ߵĲ
+struct EdgeMeasurement {
+    double position = -999.0;    // Եλ (ͼ)-999 ʾЧ
+    double straightness = 0.0;   // λõ³ɢ (1.4826*MAD, )ԽСԵԽֱ
+    int validStrips = 0;         // ƵЧ
+};
 
 class Localization {
 public:
@@ -11,17 +64,148 @@ public:
     // /ģ
     void createTemplate(const cv::Mat& image, cv::Rect roi);
 
+    // ䷽ļģ뼸 (ֻӳ䣬ʱ÷)
+    bool loadRecipe(const std::string& path);
+
+    // лָ䷽ƻ (滻ָ룻ͬһƻظ޿)
+    // ģƻ滻ƻģʱգ״δֶλüƻļ
+    void setPlan(std::shared_ptr<const RecipePlan> plan);
+    const RecipePlan& currentPlan() const { return *plan; }
+
     // [ͳ] ֶλ
-    cv::Point coarseLocalization(const cv::Mat& image);
+    // score: ѡƥ÷ (TM_CCOEFF_NORMED ֵ)
+    cv::Point coarseLocalization(const cv::Mat& image, double* score = nullptr);
+
+    // [ͳ] ֶλ + طֵ벻ȷ
+    // 16 λ֡ĳȫͼƥתΪ 32Fλ֡ϡ (ֱ 16 λɨ) 
+    CoarsePeak coarsePeak(const cv::Mat& image);
+
+    // [ϡ] ȫͼģƥΪ SSDAÿλðھֵ/һ ( TM_CCOEFF_NORMED ͬ)
+    // ֻԼ SPARSE_MATCH_POINTS ģԵۼӾֺͳǰż
+    // ʤλ SPARSE_VERIFY_PAD ظˣ÷طֵ岻
+    void setSparseSearch(bool enabled) { sparseSearch = enabled; }
+
+    // ɴֶλȷȾλڳȣԽŴԽ ( ROI_MIN_SEARCH_LENΪ䷽ڳ)
+    int adaptiveSearchLen(const CoarsePeak& peak) const;
+
+    // [] YOLO Һѡֻڸѡ ( PAD) ģƥ䣬ȡ÷
+    // PAD ȡ CASCADE_SEARCH_PAD  CASCADE_BOX_ERROR_NET_PX x ű Ľϴߣֵڲ߽
+    // (ʵ) ʱԷֵΪļӱ PAD ƥ䣬 CASCADE_WIDEN_STEPS 
+    // ɱӳ޹أģƥɱֻѡйأ޺ѡֵʼڱ߽ʱ˻ȫͼģƥ
+    CoarsePeak coarseLocalizationCascade(const cv::Mat& image, YoloDetector* detector);
 
     // [YOLO] ֶλ
-    cv::Point coarseLocalizationYolo(const cv::Mat& image, YoloDetector* detector);
+    // score: ѡŶ (δ⵽Ϊ 0)
+    cv::Point coarseLocalizationYolo(const cv::Mat& image, YoloDetector* detector, double* score = nullptr);
+
+    // [ſ] λǰĿԤ죺ֶλ÷֡Աȶȡͱ SNR
+    // ֻȡ 8 ڵ (ԼΪλȡһ) false ʱӦλ
+    // matchScore < 0 ʾ÷δ֪
+    bool assessQuality(const cv::Mat& image, cv::Point coarsePos, double matchScore, FrameQuality& quality) const;
+    void setQualityThresholds(const QualityThresholds& t) { gate = t; }
 
     // [λ] 
     // ޸ģֵΪ cv::Point2dx洢Xy洢Y
-    cv::Point2d fineLocalization(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type);
+    // edges: ѡ8 ߵĲ (˳ͬ edgeRois)
+    // quality: ѡʱ edgeOrder Ȳıߣһʧأ߲
+    // searchLen: ڳ (0 = ䷽Ĭϣͨȡ adaptiveSearchLen Ľ)
+    cv::Point2d fineLocalization(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type,
+        std::vector<EdgeMeasurement>* edges = nullptr, const FrameQuality* quality = nullptr, int searchLen = 0);
+
+    // [λ-ֱ] ֻ edgeMask еı ( i λӦ edgeRois ˳ĵ i )д out[i]಻
+    // ͼֻЩߵĴڣ̸߳һ Localization ɷֵͬһ֡ 8 
+    void fineEdges(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type,
+        unsigned edgeMask, EdgeMeasurement out[8], int searchLen = 0);
+
+    // [ͶӰ] һλͼȡ 8 ȫͶӰ (ֵ뼸ιϣ)
+    // ֵ֡ɵ÷дĲͼʱ false (out )
+    bool captureProfiles(const cv::Mat& image, cv::Point coarsePos, FrameProfiles& out, int searchLen = 0);
+
+    // [ͶӰ]  ModelType ԻͶӰϣ fineLocalization ͬ (βֵ -> ϳ)ͼ
+    cv::Point2d fitProfiles(const FrameProfiles& profiles, SubPixelModel::ModelType type,
+        std::vector<EdgeMeasurement>* edges = nullptr);
+
+    //  8  (edgeRois ˳) ϳ׿ڿ - ģһЧ -999
+    static cv::Point2d overlayFromEdges(const EdgeMeasurement m[8]);
+
+    // [ת]  4 ߸̽ⴰڵλòƱת (ȣԼͬ ImageSimulator)
+    // Ч 2 ʱ -999
+    double estimateRotation(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type);
+
+    // [λ-ת] ȹתǣתĲ (˫Բ)  8 
+    // رϵµ׿angleDeg: ѡƵת
+    cv::Point2d fineLocalizationOriented(const cv::Mat& image, cv::Point coarsePos, SubPixelModel::ModelType type,
+        double* angleDeg = nullptr);
+
+    // 16 λЧλ ( 12 λ)̣ŶԱȶֵ뱥ж
+    // ֵ 8 λҶȱ궨16 λ֡ (2^bits - 1) / 255 ȱ㣬ͼκת
+    // bits <= 0 (Ĭ) ʾδ֪Ѵ֡Ҷƶ (Utilities::observedBits)ٶ 16 λ
+    void setSensorBits(int bits) { sensorBits = (bits <= 0) ? 0 : std::max(9, std::min(16, bits)); }
+
+    // ÿߵ K (1 = ڵͶӰΪ)
+    void setSubStrips(int k) { subStrips = std::max(1, k); }
+
+    // [ROI ] ߵĲ
+    // centerPos: ; offset: ĵƫ; direction: 0 = XԵ, 1 = YԵ
+    static cv::Rect edgeRoi(cv::Point centerPos, int offset, int direction,
+        const MarkGeometry& geometry = MarkGeometry::fromConfig());
+
+    // [ROI ] λȡȫ 8  (δüͼ)
+    // ˳: X, X, X, X, Y, Y, Y, Y
+    static std::vector<cv::Rect> edgeRois(cv::Point coarsePos, const MarkGeometry& geometry = MarkGeometry::fromConfig());
 
 private:
+    //  image(region) ģƥ䣬طֵ (Ϊͼ)
+    // matchTemplate ֻ֧ 8U/32F16 λֻ֡תΪ 32F ()ģ 32F 渴
+    CoarsePeak matchRegion(const cv::Mat& image, const cv::Rect& searchRegion);
+
+    // ӵǰģѡȡϡ (ݶȷֵϴıԵأ˳) һҶ
+    void buildSparseTemplate();
+    // SSDA ɨ image(region)СģϽ (ͼ)ֵ֧λϡʱ false
+    bool sparseCandidate(const cv::Mat& image, const cv::Rect& region, cv::Point& best);
+
+    // λ׼ڼ (Ӧ)ģԼ edgeMask иߵĻͼĲͼʱ false
+    bool prepareFine(const cv::Mat& image, cv::Point coarsePos, int searchLen, unsigned edgeMask,
+        MarkGeometry& g, cv::Point& centerPos);
+    // ߵ (üͼ)ز
+    int edgeStrips(const cv::Mat& image, cv::Point centerPos, int edgeIndex, const MarkGeometry& g,
+        std::vector<cv::Rect>& strips) const;
+    // λ -> ߽ (ЧһΪЧ)
+    static EdgeMeasurement reduceStrips(std::vector<double>& positions, int k, double trimRatio);
+    // ߣ + βֵ (ͼ prepareFine )
+    EdgeMeasurement measureEdge(const cv::Mat& image, cv::Point centerPos, int edgeIndex,
+        const MarkGeometry& g, SubPixelModel::ModelType type);
+
+    // ͼ (8 λΪ 25516 λΪ 2^sensorBits - 1sensorBits δ֪ʱ۲쵽λ)
+    double fullScale(const cv::Mat& image) const;
+
+    // Աȶȼ + ϣ profile λ (ʧΪ -999)
+    double fitProfile(const std::vector<double>& profile, SubPixelModel::ModelType type) const;
+    // ͼͶӰ + fitProfile
+    double fitWindow(const cv::Rect& win, int direction, SubPixelModel::ModelType type);
+
     SubPixelModel* model;
     cv::Mat templ;
+    cv::Mat matchBuffer;          // ͼ (֡)
+    cv::Mat regionFloat;          // 16 λ֡ 32F  (֡)
+    cv::Mat templFloat;           // ģ 32F 
+    const uchar* templFloatSource = nullptr;
+    bool sparseSearch = false;
+    std::vector<cv::Point> sparsePoints;   // ϡģе
+    std::vector<float> sparseValues;       // ӦĹһҶ (T - mean) / std
+    std::vector<int> sparseOffsets;        // ǰͼвչƫ (֡)
+    const uchar* sparseSource = nullptr;
+    cv::Mat integralSum, integralSqSum;    // Ļͼ (ھֵ/֡)
+    int sensorBits = 0;           // 0 = δ֪֡ƶ
+    mutable int observedBits = 0; // λδ֪ʱ۲쵽λ
+    double thresholdScale = 1.0;  // ǰֵ֡ (fullScale / 255)
+    std::shared_ptr<const RecipePlan> plan;   // ǰ䷽ (Ρڱģָӳҳ)
+    ProjectionEngine projector;   // ÿ֡ ROI ͼ (֡)
+    int subStrips;
+    QualityThresholds gate;
+    std::vector<double> profileBuffer;
+    std::vector<cv::Rect> regionBuffer;
+    std::vector<cv::Rect> stripBuffer;
+    mutable std::vector<double> gateProfile;   // assessQuality ͶӰֻ (֡)
+    mutable std::vector<float> gateDiffs;
 };
\ No newline at end of file
@@ -0,0 +1,45 @@
+﻿#pragma once
+#include <cstdint>
+#include "WaferConfig.h"
+
+/**
+ * @struct MarkGeometry
+ * @brief 标记几何与精定位参数 (运行时按配方设置，默认值即 WaferConfig 中的常量)。
+ *
+ * 作为配方文件 GEOM 块按字节存储，字段顺序与类型不可随意调整 (改动需提升配方主版本)。
+ */
+struct MarkGeometry {
+    int32_t waferSize;
+    int32_t outerBoxSize;
+    int32_t innerBoxSize;
+    int32_t lineWidth;
+    int32_t roiSearchLen;
+    int32_t roiSearchWid;
+    int32_t projectionMargin;
+    int32_t subStrips;
+    double stripTrimRatio;
+    double edgeGradientThreshold;
+
+    static MarkGeometry fromConfig() {
+        MarkGeometry g;
+        g.waferSize = WaferConfig::WAFER_SIZE;
+        g.outerBoxSize = WaferConfig::OUTER_BOX_SIZE;
+        g.innerBoxSize = WaferConfig::INNER_BOX_SIZE;
+        g.lineWidth = WaferConfig::LINE_WIDTH;
+        g.roiSearchLen = WaferConfig::ROI_SEARCH_LEN;
+        g.roiSearchWid = WaferConfig::ROI_SEARCH_WID;
+        g.projectionMargin = WaferConfig::PROJECTION_MARGIN;
+        g.subStrips = WaferConfig::ROI_SUB_STRIPS;
+        g.stripTrimRatio = WaferConfig::STRIP_TRIM_RATIO;
+        g.edgeGradientThreshold = WaferConfig::EDGE_GRADIENT_THRESHOLD;
+        return g;
+    }
+
+    bool operator==(const MarkGeometry& o) const {
+        return waferSize == o.waferSize && outerBoxSize == o.outerBoxSize && innerBoxSize == o.innerBoxSize &&
+            lineWidth == o.lineWidth && roiSearchLen == o.roiSearchLen && roiSearchWid == o.roiSearchWid &&
+            projectionMargin == o.projectionMargin && subStrips == o.subStrips &&
+            stripTrimRatio == o.stripTrimRatio && edgeGradientThreshold == o.edgeGradientThreshold;
+    }
+    bool operator!=(const MarkGeometry& o) const { return !(*this == o); }
+};
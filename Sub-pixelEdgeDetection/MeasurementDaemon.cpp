@@ -0,0 +1,261 @@
+﻿#include "MeasurementDaemon.h"
+#include "BatchProcessor.h"
+#include "YoloDetector.h"
+#include "ImageSimulator.h"
+#include "FrameScheduler.h"
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <cstring>
+
+using namespace cv;
+using namespace std;
+
+// ---------------------------------------------------------------- MeasurementDaemon
+
+MeasurementDaemon::MeasurementDaemon(const DaemonConfig& config) : cfg(config) {}
+
+int MeasurementDaemon::serve() {
+    auto t0 = chrono::steady_clock::now();
+
+    // 1. 一次性初始化：配方 0 (配方文件或按 WaferConfig 仿真生成)、--recipe 指定的其他配方与可选的 YOLO 模型
+    vector<string> specs;
+    if (!cfg.recipePath.empty()) specs.push_back("0=" + cfg.recipePath);
+    specs.insert(specs.end(), cfg.recipes.begin(), cfg.recipes.end());
+    if (!registry.loadSpecs(specs)) return 1;
+
+    BatchProcessor processor;
+    processor.setRegistry(&registry);
+    if (cfg.sensorBits > 8) processor.setSensorBits(cfg.sensorBits);
+    processor.setSparseSearch(cfg.sparse);
+    unique_ptr<YoloDetector> detector;
+    if (!cfg.yoloModel.empty()) {
+        detector.reset(new YoloDetector(cfg.yoloModel));
+        if (cfg.sensorBits > 8) detector->setSensorBits(cfg.sensorBits);
+        if (cfg.cascade) detector->setInputSize(WaferConfig::CASCADE_YOLO_INPUT);
+        if (cfg.tiled) {
+            // 块重叠按启动时已注册配方中最大的标记尺寸取 (运行中加载的更大标记需重启服务)
+            int markSize = 0;
+            for (int id : registry.ids()) markSize = std::max(markSize, registry.find(id)->geometry.waferSize);
+            if (!detector->setTiling(markSize)) cerr << "[Daemon] Tiled inference disabled" << endl;
+        }
+        processor.setDetector(detector.get(), cfg.cascade);
+    }
+
+    // 多线程：结果在工作线程上写回槽位，槽位状态本身保证客户端按提交顺序取回
+    unique_ptr<FrameScheduler> pool;
+    if (cfg.workers > 1 && detector) {
+        cerr << "[Daemon] YOLO detector is not thread-safe, serving single-threaded" << endl;
+    }
+    else if (cfg.workers > 1) {
+        SchedulerConfig sc;
+        sc.workers = cfg.workers;
+        sc.pinThreads = cfg.pinThreads;
+        sc.sparseSearch = cfg.sparse;
+        if (cfg.sensorBits > 8) sc.sensorBits = cfg.sensorBits;
+        pool.reset(new FrameScheduler(sc, &registry));
+    }
+
+    // 2. 创建共享内存环
+    SharedFrameRing ring;
+    if (!ring.create(cfg.ringName, cfg.slots, cfg.maxWidth, cfg.maxHeight, cfg.sensorBits > 8 ? 2 : 1)) return 1;
+
+    double initMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    cout << "[Daemon] Ready on '" << cfg.ringName << "': " << cfg.slots << " slots, max "
+        << cfg.maxWidth << "x" << cfg.maxHeight << ", " << registry.ids().size() << " recipes, init "
+        << fixed << setprecision(1) << initMs << " ms" << endl;
+
+    // 配方控制线程：响应客户端的加载请求，后台构建后发布，服务循环继续使用旧快照
+    SharedFrameRing::RingHeader* header = ring.header();
+    thread control([this, header] {
+        while (!header->shutdown.load(memory_order_relaxed)) {
+            if (header->recipeRequest.load(memory_order_acquire) != SharedFrameRing::RECIPE_PENDING) {
+                this_thread::sleep_for(chrono::milliseconds(20));
+                continue;
+            }
+            int id = header->recipeRequestId;
+            string path(header->recipeRequestPath, strnlen(header->recipeRequestPath, SharedFrameRing::RECIPE_PATH_MAX));
+            bool ok = registry.loadAsync(id, path).get();
+            if (!ok) cerr << "[Daemon] Cannot load recipe " << id << " from " << path << endl;
+            header->recipeRequest.store(ok ? SharedFrameRing::RECIPE_LOADED : SharedFrameRing::RECIPE_FAILED, memory_order_release);
+        }
+        });
+
+    // 3. 服务循环：按序号轮转槽位，帧在共享内存中原地测量
+    uint64_t served = 0;
+    auto lastReport = chrono::steady_clock::now();
+    for (uint64_t seq = 0;; ++seq) {
+        if (!ring.waitState(seq, SharedFrameRing::SLOT_FILLED, -1)) break;   // 仅在 shutdown 时返回
+
+        SharedFrameRing::SlotHeader* s = ring.slot(seq);
+        s->state.store(SharedFrameRing::SLOT_PROCESSING, memory_order_relaxed);
+
+        FrameJob job;
+        job.id = (int)s->frameId;
+        job.recipeId = s->recipeId;
+        job.shiftX = s->trueShiftX;
+        job.shiftY = s->trueShiftY;
+
+        auto complete = [s, job](FrameResult r) {
+            r.id = job.id;
+            // 采集端没有真值时只区分成功/失败
+            if (!s->hasTruth && r.status == FRAME_WARN) r.status = FRAME_PASS;
+
+            ResultRecord rec = BatchProcessor::toRecord(r);
+            rec.frameId = s->frameId;
+            s->result = rec;
+            s->state.store(SharedFrameRing::SLOT_DONE, memory_order_release);
+            };
+
+        bool valid = s->width > 0 && s->height > 0 && (size_t)s->width * s->height * CV_ELEM_SIZE(s->type) <= ring.maxFrameBytes();
+        if (!valid) complete(FrameResult());
+        else if (pool) pool->submit(job, ring.pixels(seq, s->width, s->height, s->type), complete);
+        else complete(processor.measure(job, ring.pixels(seq, s->width, s->height, s->type)));
+        served++;
+
+        auto now = chrono::steady_clock::now();
+        if (chrono::duration<double>(now - lastReport).count() >= 10.0) {
+            cout << "[Daemon] " << served << " frames served" << endl;
+            if (pool) pool->printStats();
+            lastReport = now;
+        }
+    }
+    if (pool) pool->wait();
+    control.join();
+
+    cout << "[Daemon] Shutdown requested, " << served << " frames served." << endl;
+    return 0;
+}
+
+// ---------------------------------------------------------------- MeasurementClient
+
+bool MeasurementClient::connect(const std::string& ringName, int timeoutMs) {
+    submitSeq = fetchSeq = 0;
+    return ring.connect(ringName, timeoutMs);
+}
+
+cv::Mat MeasurementClient::acquire(int width, int height, int type) {
+    if ((size_t)width * height * CV_ELEM_SIZE(type) > ring.maxFrameBytes()) return Mat();
+    if (!ring.waitState(submitSeq, SharedFrameRing::SLOT_EMPTY, -1)) return Mat();
+
+    SharedFrameRing::SlotHeader* s = ring.slot(submitSeq);
+    s->state.store(SharedFrameRing::SLOT_WRITING, memory_order_relaxed);
+    s->width = width;
+    s->height = height;
+    s->type = type;
+    s->step = (uint64_t)width * CV_ELEM_SIZE(type);
+    return ring.pixels(submitSeq, width, height, type);
+}
+
+void MeasurementClient::submit(int64_t frameId, const cv::Point2d* trueShift, int recipeId) {
+    SharedFrameRing::SlotHeader* s = ring.slot(submitSeq);
+    s->frameId = frameId;
+    s->recipeId = recipeId;
+    s->hasTruth = trueShift ? 1 : 0;
+    s->trueShiftX = trueShift ? trueShift->x : 0.0;
+    s->trueShiftY = trueShift ? trueShift->y : 0.0;
+    // release：像素与元数据先于状态对服务端可见
+    s->state.store(SharedFrameRing::SLOT_FILLED, memory_order_release);
+    submitSeq++;
+}
+
+bool MeasurementClient::fetch(ResultRecord& result, int timeoutMs) {
+    if (fetchSeq == submitSeq) return false;
+    if (!ring.waitState(fetchSeq, SharedFrameRing::SLOT_DONE, timeoutMs)) return false;
+
+    SharedFrameRing::SlotHeader* s = ring.slot(fetchSeq);
+    result = s->result;
+    s->state.store(SharedFrameRing::SLOT_EMPTY, memory_order_release);
+    fetchSeq++;
+    return true;
+}
+
+bool MeasurementClient::loadRecipe(int recipeId, const std::string& path, int timeoutMs) {
+    SharedFrameRing::RingHeader* h = ring.header();
+    if (path.size() >= (size_t)SharedFrameRing::RECIPE_PATH_MAX) return false;
+    if (h->recipeRequest.load(memory_order_acquire) == SharedFrameRing::RECIPE_PENDING) return false;
+
+    h->recipeRequestId = recipeId;
+    memcpy(h->recipeRequestPath, path.c_str(), path.size() + 1);
+    h->recipeRequest.store(SharedFrameRing::RECIPE_PENDING, memory_order_release);
+
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    for (;;) {
+        uint32_t state = h->recipeRequest.load(memory_order_acquire);
+        if (state != SharedFrameRing::RECIPE_PENDING) return state == SharedFrameRing::RECIPE_LOADED;
+        if (h->shutdown.load(memory_order_relaxed) || chrono::steady_clock::now() > deadline) return false;
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+}
+
+void MeasurementClient::requestShutdown() {
+    ring.header()->shutdown.store(1, memory_order_release);
+}
+
+int MeasurementClient::runSimulatedAcquisition(const std::string& ringName, int frames, bool shutdownAfter) {
+    MeasurementClient client;
+    if (!client.connect(ringName)) return 1;
+
+    // 预渲染一小组帧循环使用，避免 50 倍超采样的渲染时间掩盖服务吞吐
+    const int IMAGE_SIZE = 640;
+    int distinct = std::max(1, std::min(frames, 16));
+    ImageSimulator simulator;
+    RNG rng(2025);
+    vector<Mat> images;
+    vector<Point2d> truths;
+    cout << "[Client] Rendering " << distinct << " simulated frames..." << endl;
+    for (int i = 0; i < distinct; ++i) {
+        Point2d shift(rng.uniform(-2.0, 2.0), rng.uniform(-2.0, 2.0));
+        images.push_back(simulator.generateWaferImage(IMAGE_SIZE, shift.x, shift.y, 1.0, 0));
+        truths.push_back(shift);
+    }
+
+    BatchStats stats;
+    deque<chrono::steady_clock::time_point> submitted;
+    double latencySum = 0.0, latencyMax = 0.0;
+    auto collect = [&]() {
+        ResultRecord rec;
+        if (!client.fetch(rec)) return false;
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - submitted.front()).count();
+        submitted.pop_front();
+        latencySum += ms;
+        latencyMax = std::max(latencyMax, ms);
+
+        FrameResult r;
+        r.id = (int)rec.frameId;
+        r.status = (FrameStatus)rec.status;
+        r.measured = Point2d(rec.overlayX, rec.overlayY);
+        if (r.status == FRAME_PASS || r.status == FRAME_WARN) {
+            const Point2d& t = truths[rec.frameId % distinct];
+            r.errX = std::abs(rec.overlayX - t.x);
+            r.errY = std::abs(rec.overlayY - t.y);
+        }
+        stats.add(r);
+        return true;
+        };
+
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        // 槽位全部在途时先取回最早的结果，保持流水线满载
+        if (client.inFlight() == client.slotCount() && !collect()) break;
+
+        const Mat& src = images[i % distinct];
+        Mat slotMat = client.acquire(src.cols, src.rows, src.type());
+        if (slotMat.empty()) break;
+        src.copyTo(slotMat);   // 真实采集时相机直接写入 slotMat，此拷贝不存在
+        submitted.push_back(chrono::steady_clock::now());
+        client.submit(i, &truths[i % distinct]);
+    }
+    while (client.inFlight() > 0 && collect()) {}
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    stats.printSummary();
+    cout << "[Client] " << stats.total << " frames in " << fixed << setprecision(2) << sec << " s ("
+        << (sec > 0 ? stats.total / sec : 0.0) << " frames/s), latency mean "
+        << (stats.total ? latencySum / stats.total : 0.0) << " ms, max " << latencyMax << " ms" << endl;
+
+    if (shutdownAfter) client.requestShutdown();
+    return 0;
+}
@@ -0,0 +1,91 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include "SharedFrameRing.h"
+#include "RecipeRegistry.h"
+
+/**
+ * @struct DaemonConfig
+ * @brief 常驻测量服务参数。
+ */
+struct DaemonConfig {
+    std::string ringName = "OverlayMeasure";   // 共享内存名
+    int slots = 8;                              // 环形缓冲槽位数 (在途帧上限)
+    int maxWidth = 2048;                        // 单帧最大尺寸 (决定每槽位像素区大小)
+    int maxHeight = 2048;
+    std::string recipePath;                     // 配方 0 的文件 (空则按 WaferConfig 几何生成模板)
+    std::vector<std::string> recipes;           // 启动时加载的其他配方 "id=path" (命令行 --recipe，可重复)
+    std::string yoloModel;                      // 非空时启动即加载，粗定位改用 YOLO
+    bool cascade = false;                       // YOLO 以 CASCADE_YOLO_INPUT 输入找候选框，再在框内模板匹配
+    int sensorBits = 8;                         // 相机位深：>8 时按 16 位帧分配槽位并设置 Localization 满量程
+    bool tiled = false;                         // 大幅面帧按网络输入尺寸分块推理 (重叠 = 标记尺寸 + YOLO_TILE_MARGIN)
+    bool sparse = false;                        // 模板匹配改用稀疏 SSDA 搜索 (SPARSE_MATCH_POINTS)
+    int workers = 1;                            // >1 时帧交给 FrameScheduler 多线程测量 (仅模板匹配粗定位)
+    bool pinThreads = false;                    // 多线程时工作线程绑核
+};
+
+/**
+ * @class MeasurementDaemon
+ * @brief 常驻测量服务：启动时一次性完成模板生成与模型加载，之后从共享内存环读取帧、原地测量并写回结果。
+ *        进程启动、50 倍超采样模板与 ONNX 加载的开销只在服务启动时支付一次。
+ */
+class MeasurementDaemon {
+public:
+    explicit MeasurementDaemon(const DaemonConfig& config);
+
+    /**
+     * @brief 阻塞运行，直到客户端请求关闭。
+     * @return int 进程返回码。
+     */
+    int serve();
+
+    // 运行中可随时加载/替换配方 (后台构建，服务循环不停顿)；客户端经 MeasurementClient::loadRecipe 请求
+    RecipeRegistry& recipes() { return registry; }
+
+private:
+    DaemonConfig cfg;
+    RecipeRegistry registry;
+};
+
+/**
+ * @class MeasurementClient
+ * @brief 采集端：把帧写入共享槽位 (可直接作为采集缓冲，零拷贝) 并按提交顺序取回结果。
+ */
+class MeasurementClient {
+public:
+    bool connect(const std::string& ringName, int timeoutMs = 5000);
+
+    // 取得下一个空槽位的像素区 (槽位全部在途时阻塞)，返回的 Mat 直接指向共享内存
+    cv::Mat acquire(int width, int height, int type);
+    // 发布 acquire 得到的帧；trueShift 非空时附带真值 (测试用)
+    void submit(int64_t frameId, const cv::Point2d* trueShift = nullptr, int recipeId = 0);
+    // 按提交顺序取回下一条结果
+    bool fetch(ResultRecord& result, int timeoutMs = -1);
+
+    int inFlight() const { return (int)(submitSeq - fetchSeq); }
+    int slotCount() const { return (int)ring.header()->slotCount; }
+
+    /**
+     * @brief 请求服务加载/替换配方 (服务端后台构建，不打断测量)。
+     * @param path 服务端进程可访问的配方文件路径。
+     * @return bool 服务端加载成功时返回 true；之后以该 id 提交的帧使用新配方。
+     */
+    bool loadRecipe(int recipeId, const std::string& path, int timeoutMs = 30000);
+
+    // 通知服务退出
+    void requestShutdown();
+
+    /**
+     * @brief 本地测试客户端：预渲染若干仿真帧，循环送入服务并统计精度、吞吐与延迟 (不需要真实相机)。
+     */
+    static int runSimulatedAcquisition(const std::string& ringName, int frames, bool shutdownAfter);
+
+private:
+    SharedFrameRing ring;
+    uint64_t submitSeq = 0;
+    uint64_t fetchSeq = 0;
+};
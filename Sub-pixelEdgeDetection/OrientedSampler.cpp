@@ -0,0 +1,125 @@
+﻿#include "OrientedSampler.h"
+#include <map>
+#include <list>
+#include <mutex>
+#include <cmath>
+#include <tuple>
+#include <climits>
+
+using namespace cv;
+using namespace std;
+
+bool OrientedGeometry::operator<(const OrientedGeometry& o) const {
+    return tie(outerBoxSize, innerBoxSize, searchLen, searchWid) <
+        tie(o.outerBoxSize, o.innerBoxSize, o.searchLen, o.searchWid);
+}
+
+OrientedRoiTable OrientedSampler::buildTable(double angleRad, int offset, int direction, const OrientedGeometry& g) {
+    OrientedRoiTable t;
+    t.length = g.searchLen;
+    t.width = g.searchWid;
+    t.startU = offset - g.searchLen / 2;
+    t.taps.reserve((size_t)t.length * t.width);
+
+    const double c = std::cos(angleRad), s = std::sin(angleRad);
+    int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
+
+    for (int k = 0; k < t.length; ++k) {
+        // 与轴对齐窗口的像素网格一致：角度为 0 时权重退化为 (1,0,0,0)，结果与 edgeRoi 投影相同
+        double along = offset - g.searchLen / 2 + k;
+        for (int v = 0; v < t.width; ++v) {
+            double across = -g.searchWid / 2 + v;
+            double u = (direction == 0) ? along : across;
+            double w = (direction == 0) ? across : along;
+
+            double x = u * c + w * s;
+            double y = -u * s + w * c;
+            int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+            float fx = (float)(x - x0), fy = (float)(y - y0);
+
+            OrientedRoiTable::Tap tap;
+            tap.dx = x0;
+            tap.dy = y0;
+            tap.w00 = (1.f - fx) * (1.f - fy);
+            tap.w01 = fx * (1.f - fy);
+            tap.w10 = (1.f - fx) * fy;
+            tap.w11 = fx * fy;
+            t.taps.push_back(tap);
+
+            minX = std::min(minX, x0); maxX = std::max(maxX, x0 + 1);
+            minY = std::min(minY, y0); maxY = std::max(maxY, y0 + 1);
+        }
+    }
+    t.bounds = Rect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+    return t;
+}
+
+std::shared_ptr<const std::vector<OrientedRoiTable>> OrientedSampler::tables(double angleDeg, const OrientedGeometry& geometry) {
+    typedef pair<int, OrientedGeometry> Key;
+    typedef pair<Key, shared_ptr<const vector<OrientedRoiTable>>> Entry;
+    // LRU：表头为最近使用；已返回的 shared_ptr 在淘汰后仍然有效
+    static list<Entry> lru;
+    static map<Key, list<Entry>::iterator> cache;
+    static mutex cacheMutex;
+
+    int bucket = (int)std::lround(angleDeg / ANGLE_BUCKET_DEG);
+    Key key(bucket, geometry);
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+    }
+
+    // 在锁外构建 (8 x searchLen x searchWid 个样本)，并发重复构建时以先插入者为准
+    double angleRad = bucket * ANGLE_BUCKET_DEG * CV_PI / 180.0;
+    int outerRadius = geometry.outerBoxSize / 2;
+    int innerRadius = geometry.innerBoxSize / 2;
+    auto set = make_shared<vector<OrientedRoiTable>>();
+    const int offsets[4] = { -outerRadius, outerRadius, -innerRadius, innerRadius };
+    for (int direction = 0; direction < 2; ++direction) {
+        for (int offset : offsets) set->push_back(buildTable(angleRad, offset, direction, geometry));
+    }
+
+    lock_guard<mutex> lock(cacheMutex);
+    auto it = cache.find(key);
+    if (it != cache.end()) return it->second->second;
+
+    lru.emplace_front(key, set);
+    cache[key] = lru.begin();
+    while (cache.size() > CACHE_CAPACITY) {
+        cache.erase(lru.back().first);
+        lru.pop_back();
+    }
+    return set;
+}
+
+namespace {
+    // 按像素类型特化的双线性采样；step 以元素计
+    template <typename T>
+    void sampleTaps(const T* origin, size_t step, const OrientedRoiTable& table, std::vector<double>& profile) {
+        profile.resize(table.length);
+        const OrientedRoiTable::Tap* tap = table.taps.data();
+        for (int k = 0; k < table.length; ++k) {
+            float acc = 0.f;
+            for (int v = 0; v < table.width; ++v, ++tap) {
+                const T* p = origin + (ptrdiff_t)tap->dy * (ptrdiff_t)step + tap->dx;
+                acc += tap->w00 * p[0] + tap->w01 * p[1] + tap->w10 * p[step] + tap->w11 * p[step + 1];
+            }
+            profile[k] = (double)acc / table.width;
+        }
+    }
+}
+
+bool OrientedSampler::sample(const cv::Mat& image, cv::Point center, const OrientedRoiTable& table, std::vector<double>& profile) {
+    CV_Assert(image.type() == CV_8UC1 || image.type() == CV_16UC1);
+
+    Rect needed(center.x + table.bounds.x, center.y + table.bounds.y, table.bounds.width, table.bounds.height);
+    if ((needed & Rect(0, 0, image.cols, image.rows)) != needed) return false;
+
+    if (image.depth() == CV_8U) sampleTaps(image.ptr<uchar>(center.y) + center.x, image.step1(), table, profile);
+    else sampleTaps(image.ptr<ushort>(center.y) + center.x, image.step1(), table, profile);
+    return true;
+}
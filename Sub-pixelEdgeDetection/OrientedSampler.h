@@ -0,0 +1,75 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <memory>
+
+/**
+ * @struct OrientedGeometry
+ * @brief 生成旋转采样表所需的标记几何 (单位: 像素)。
+ */
+struct OrientedGeometry {
+    int outerBoxSize;
+    int innerBoxSize;
+    int searchLen;   // 沿测量方向的采样数
+    int searchWid;   // 平行于边缘的采样数 (取平均)
+
+    bool operator<(const OrientedGeometry& o) const;
+};
+
+/**
+ * @struct OrientedRoiTable
+ * @brief 单个旋转窗口的双线性采样表。
+ *
+ * 样本按 (沿测量方向 k, 横向 v) 行优先存放；偏移相对标记中心 (整数像素)，
+ * 因此同一张表可用于任意整数中心位置。
+ */
+struct OrientedRoiTable {
+    struct Tap {
+        int dx, dy;              // 左上邻点相对中心的偏移
+        float w00, w01, w10, w11; // 双线性权重 (左上, 右上, 左下, 右下)
+    };
+
+    int length = 0;              // profile 长度
+    int width = 0;               // 每个 bin 平均的样本数
+    double startU = 0.0;         // profile 第 0 个 bin 在标记坐标系测量轴上的坐标 (相对中心)
+    std::vector<Tap> taps;
+    cv::Rect bounds;             // 全部样本 (含右下邻点) 相对中心的外接矩形，用于一次性越界检查
+};
+
+/**
+ * @class OrientedSampler
+ * @brief 旋转 ROI 采样：按 (角度桶, 几何) 缓存 8 个测量窗口的采样表，只对实际使用的像素重采样，
+ *        避免对整幅图像做 warpAffine。
+ *
+ * 角度约定与 getRotationMatrix2D / ImageSimulator 相同 (正值为图像中逆时针)，
+ * 标记坐标系 (u, v) 到图像坐标：x = cx + u*cos + v*sin, y = cy - u*sin + v*cos。
+ * 窗口顺序与 Localization::edgeRois 相同。缓存全局共享、线程安全，按最近使用淘汰，
+ * 常驻进程中角度与配方几何不断变化时内存不会无限增长。
+ */
+class OrientedSampler {
+public:
+    // 角度桶宽度 (度)：桶内角度误差引起的边缘位移 < 100px * 0.005° ≈ 0.009px
+    static constexpr double ANGLE_BUCKET_DEG = 0.01;
+
+    // 缓存的 (角度桶, 几何) 组数上限：每组约 8 x searchLen x searchWid x sizeof(Tap) (24 字节)，
+    // 默认几何 (60 x 20) 约 230KB，缓存满时约 29MB
+    static constexpr size_t CACHE_CAPACITY = 128;
+
+    /**
+     * @brief 取得指定角度与几何的 8 个窗口采样表，首次请求时构建。
+     */
+    static std::shared_ptr<const std::vector<OrientedRoiTable>> tables(double angleDeg, const OrientedGeometry& geometry);
+
+    /**
+     * @brief 按采样表从图像中得到 profile。
+     * @param image 单通道图像 (CV_8U 或 CV_16U，按位深分别特化)。
+     * @param center 标记中心 (整数像素)。
+     * @param table 采样表。
+     * @param profile [输出] 长度为 table.length 的投影。
+     * @return bool 窗口越界时返回 false。
+     */
+    static bool sample(const cv::Mat& image, cv::Point center, const OrientedRoiTable& table, std::vector<double>& profile);
+
+private:
+    static OrientedRoiTable buildTable(double angleRad, int offset, int direction, const OrientedGeometry& g);
+};
@@ -0,0 +1,231 @@
+﻿#include "ParetoHarness.h"
+#include "BatchProcessor.h"
+#include "YoloDetector.h"
+#include "WaferConfig.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+    struct CoarseMode {
+        string name;
+        unique_ptr<BatchProcessor> processor;
+    };
+
+    // 有符号误差的均值与方差 (Welford)
+    struct Accumulator {
+        int n = 0;
+        double mean = 0.0, m2 = 0.0;
+        void add(double x) {
+            n++;
+            double d = x - mean;
+            mean += d / n;
+            m2 += d * (x - mean);
+        }
+        double sigma3() const { return n > 1 ? 3.0 * std::sqrt(m2 / (n - 1)) : 0.0; }
+    };
+
+    struct Cell {
+        Accumulator x, y;
+        double coarseMs = 0.0, projectUs = 0.0, fitUs = 0.0;
+        int frames = 0;
+    };
+
+    bool sameCondition(const ParetoPoint& a, const ParetoPoint& b) {
+        return a.noise == b.noise && a.contrast == b.contrast;
+    }
+}
+
+std::vector<ParetoPoint> ParetoHarness::run(const ParetoConfig& cfg) {
+    // 1. 粗定位方式：全图模板匹配、稀疏 SSDA，以及可选的 YOLO 级联
+    vector<CoarseMode> modes;
+    modes.push_back({ "template", unique_ptr<BatchProcessor>(new BatchProcessor()) });
+    modes.push_back({ "sparse", unique_ptr<BatchProcessor>(new BatchProcessor()) });
+    modes.back().processor->setSparseSearch(true);
+
+    unique_ptr<YoloDetector> detector;
+    if (!cfg.yoloModel.empty()) {
+        detector.reset(new YoloDetector(cfg.yoloModel));
+        detector->setInputSize(WaferConfig::CASCADE_YOLO_INPUT);
+        modes.push_back({ "cascade", unique_ptr<BatchProcessor>(new BatchProcessor()) });
+        modes.back().processor->setDetector(detector.get(), true);
+    }
+
+    const vector<SubPixelModel::ModelType>& types = SubPixelModel::allTypes();
+    Localization fitter;
+    ImageSimulator simulator;
+    vector<ParetoPoint> points;
+
+    cout << "[Pareto] " << cfg.noiseLevels.size() << " noise x " << cfg.contrasts.size() << " contrast levels, "
+        << modes.size() << " coarse modes x " << types.size() << " models, " << cfg.framesPerCell << " frames each" << endl;
+
+    // 2. 每个条件生成同一批帧，所有组合共用
+    for (double noise : cfg.noiseLevels) {
+        for (int contrast : cfg.contrasts) {
+            simulator.setContrast(contrast);
+            vector<vector<Cell>> cells(modes.size(), vector<Cell>(types.size()));
+            // identical[m][t][u]: 粗定位方式 m 下类型 t 与 u 在每一帧的结果都完全相同 (互为别名)
+            vector<vector<vector<bool>>> identical(modes.size(),
+                vector<vector<bool>>(types.size(), vector<bool>(types.size(), true)));
+            vector<Point2d> fitted(types.size());
+            RNG rng(cfg.seed);
+
+            for (int f = 0; f < cfg.framesPerCell; ++f) {
+                FrameJob job;
+                job.id = f;
+                job.imageSize = cfg.imageSize;
+                job.shiftX = rng.uniform(-cfg.maxShift, cfg.maxShift);
+                job.shiftY = rng.uniform(-cfg.maxShift, cfg.maxShift);
+                job.noise = noise;
+                simulator.setSeed(cfg.seed + (uint64_t)f + 1);
+                Mat image = simulator.generateWaferImage(job.imageSize, job.shiftX, job.shiftY, noise, 0);
+
+                for (size_t m = 0; m < modes.size(); ++m) {
+                    FrameProfiles profiles;
+                    FrameResult timing;
+                    bool ok = modes[m].processor->captureProfiles(job, image, profiles, &timing);
+
+                    for (size_t t = 0; t < types.size(); ++t) {
+                        Cell& c = cells[m][t];
+                        c.frames++;
+                        c.coarseMs += timing.coarseMs;
+                        c.projectUs += timing.fineMs * 1000.0;
+                        if (!ok) continue;
+
+                        auto t0 = chrono::steady_clock::now();
+                        Point2d measured = fitter.fitProfiles(profiles, types[t]);
+                        c.fitUs += chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+                        fitted[t] = measured;
+                        for (size_t u = 0; u < t; ++u) {
+                            if (fitted[u] != measured) identical[m][t][u] = identical[m][u][t] = false;
+                        }
+                        if (measured.x == -999.0) continue;
+
+                        c.x.add(measured.x - job.shiftX);
+                        c.y.add(measured.y - job.shiftY);
+                    }
+                }
+            }
+
+            for (size_t m = 0; m < modes.size(); ++m) {
+                for (size_t t = 0; t < types.size(); ++t) {
+                    // 与更早类型逐帧结果相同的类型是同一估计器的别名，并入那一行，不作为独立测量参与前沿与推荐
+                    bool alias = false;
+                    for (size_t u = 0; u < t && !alias; ++u) alias = identical[m][t][u];
+                    if (alias) continue;
+
+                    const Cell& c = cells[m][t];
+                    ParetoPoint p;
+                    p.noise = noise;
+                    p.contrast = contrast;
+                    p.coarse = modes[m].name;
+                    p.model = SubPixelModel::typeName(types[t]);
+                    for (size_t u = t + 1; u < types.size(); ++u) {
+                        if (identical[m][t][u]) p.model += string("=") + SubPixelModel::typeName(types[u]);
+                    }
+                    p.frames = c.frames;
+                    p.valid = c.x.n;
+                    p.biasX = c.x.mean;
+                    p.biasY = c.y.mean;
+                    p.sigma3X = c.x.sigma3();
+                    p.sigma3Y = c.y.sigma3();
+                    p.coarseMs = c.frames ? c.coarseMs / c.frames : 0.0;
+                    p.edgeUs = c.frames ? (c.projectUs + c.fitUs) / c.frames / 8.0 : 0.0;
+                    points.push_back(p);
+                }
+            }
+        }
+    }
+    simulator.setContrast(0);
+
+    markPareto(points, cfg.precisionSpec);
+    printTable(points);
+    if (!cfg.jsonPath.empty() && writeJson(cfg.jsonPath, cfg, points)) {
+        cout << "[Pareto] JSON written to " << cfg.jsonPath << endl;
+    }
+    return points;
+}
+
+void ParetoHarness::markPareto(std::vector<ParetoPoint>& points, double precisionSpec) {
+    for (ParetoPoint& p : points) {
+        p.meetsSpec = p.frames > 0 && p.valid == p.frames && p.precision() <= precisionSpec;
+
+        // 失败帧的组合精度无从比较，不进入前沿
+        p.pareto = p.valid > 1;
+        for (const ParetoPoint& q : points) {
+            if (!p.pareto) break;
+            if (&q == &p || !sameCondition(p, q) || q.valid <= 1 || q.valid < p.valid) continue;
+            bool noWorse = q.precision() <= p.precision() && q.frameMs() <= p.frameMs();
+            bool better = q.precision() < p.precision() || q.frameMs() < p.frameMs() || q.valid > p.valid;
+            if (noWorse && better) p.pareto = false;
+        }
+    }
+}
+
+void ParetoHarness::printTable(const std::vector<ParetoPoint>& points) {
+    cout << setfill('-') << setw(118) << "-" << setfill(' ') << endl;
+    cout << "| Noise | Contr | Coarse   | Model         | Valid   | Bias X  | Bias Y  | 3s X    | 3s Y    | Coarse ms | Edge us | P | S |" << endl;
+    cout << setfill('-') << setw(118) << "-" << setfill(' ') << endl;
+    for (const ParetoPoint& p : points) {
+        cout << "| " << fixed << setprecision(2) << setw(5) << p.noise << " | " << setw(5) << p.contrast << " | "
+            << left << setw(8) << p.coarse << " | " << setw(13) << p.model << right << " | "
+            << setw(3) << p.valid << "/" << setw(3) << p.frames << " | " << setprecision(4)
+            << setw(7) << p.biasX << " | " << setw(7) << p.biasY << " | "
+            << setw(7) << p.sigma3X << " | " << setw(7) << p.sigma3Y << " | "
+            << setprecision(3) << setw(9) << p.coarseMs << " | " << setprecision(2) << setw(7) << p.edgeUs << " | "
+            << (p.pareto ? "*" : " ") << " | " << (p.meetsSpec ? "*" : " ") << " |" << endl;
+    }
+    cout << setfill('-') << setw(118) << "-" << setfill(' ') << endl;
+
+    // 每个条件下满足规格的最快组合 (即该条件应启用的快速路径)
+    for (size_t i = 0; i < points.size(); ++i) {
+        bool first = true;
+        for (size_t j = 0; j < i; ++j) {
+            if (sameCondition(points[i], points[j])) first = false;
+        }
+        if (!first) continue;
+
+        const ParetoPoint* best = nullptr;
+        for (const ParetoPoint& q : points) {
+            if (sameCondition(points[i], q) && q.meetsSpec && (!best || q.frameMs() < best->frameMs())) best = &q;
+        }
+        cout << "[Pareto] noise " << setprecision(2) << points[i].noise << ", contrast " << points[i].contrast << ": ";
+        if (best) cout << best->coarse << " + " << best->model << " (" << setprecision(3) << best->frameMs() << " ms/frame)" << endl;
+        else cout << "no combination meets spec" << endl;
+    }
+}
+
+bool ParetoHarness::writeJson(const std::string& path, const ParetoConfig& cfg, const std::vector<ParetoPoint>& points) {
+    ofstream ofs(path, ios::trunc);
+    if (!ofs) return false;
+
+    ofs << setprecision(10);
+    ofs << "{\n"
+        << "  \"framesPerCell\": " << cfg.framesPerCell << ",\n"
+        << "  \"imageSize\": " << cfg.imageSize << ",\n"
+        << "  \"maxShift\": " << cfg.maxShift << ",\n"
+        << "  \"seed\": " << cfg.seed << ",\n"
+        << "  \"precisionSpec\": " << cfg.precisionSpec << ",\n"
+        << "  \"points\": [\n";
+    for (size_t i = 0; i < points.size(); ++i) {
+        const ParetoPoint& p = points[i];
+        ofs << "    { \"noise\": " << p.noise << ", \"contrast\": " << p.contrast
+            << ", \"coarse\": \"" << p.coarse << "\", \"model\": \"" << p.model << "\""
+            << ", \"frames\": " << p.frames << ", \"valid\": " << p.valid
+            << ", \"biasX\": " << p.biasX << ", \"biasY\": " << p.biasY
+            << ", \"sigma3X\": " << p.sigma3X << ", \"sigma3Y\": " << p.sigma3Y
+            << ", \"coarseMs\": " << p.coarseMs << ", \"edgeUs\": " << p.edgeUs
+            << ", \"pareto\": " << (p.pareto ? "true" : "false")
+            << ", \"meetsSpec\": " << (p.meetsSpec ? "true" : "false") << " }"
+            << (i + 1 < points.size() ? ",\n" : "\n");
+    }
+    ofs << "  ]\n}\n";
+    return ofs.good();
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * @struct ParetoConfig
+ * @brief 精度-延迟扫描参数：噪声 x 对比度 的每个条件下，所有 (粗定位方式, ModelType) 组合共用同一批帧。
+ */
+struct ParetoConfig {
+    std::vector<double> noiseLevels = { 0.1, 1.0, 2.0, 5.0 };   // 高斯噪声标准差
+    std::vector<int> contrasts = { 30, 60, 120 };               // 外框与背景的灰度差
+    int framesPerCell = 50;          // 每个 (噪声, 对比度) 条件的帧数
+    double maxShift = 2.0;           // 真值偏移范围 [-maxShift, maxShift]
+    int imageSize = 640;
+    uint64_t seed = 7;               // 偏移与图像噪声均由 seed + 序号确定
+    std::string yoloModel;           // 非空时加入级联粗定位 (YOLO 候选框 + 框内模板匹配)
+    double precisionSpec = 0.05;     // 3σ 精度规格 (像素)
+    std::string jsonPath = "pareto.json";
+};
+
+/**
+ * @struct ParetoPoint
+ * @brief 单个 (条件, 粗定位方式, ModelType) 的统计。误差为 测量 - 真值 (有符号)。
+ */
+struct ParetoPoint {
+    double noise = 0.0;
+    int contrast = 0;
+    std::string coarse;              // "template" / "sparse" / "cascade"
+    std::string model;               // SubPixelModel::typeName，逐帧结果完全相同的别名类型以 "=" 连接 (如 "A=B")
+    int frames = 0;
+    int valid = 0;                   // 门控通过且 8 条边均有效的帧数
+    double biasX = 0.0, biasY = 0.0;     // 平均误差
+    double sigma3X = 0.0, sigma3Y = 0.0; // 3 倍标准差
+    double coarseMs = 0.0;           // 每帧粗定位耗时
+    double edgeUs = 0.0;             // 每条边的精定位耗时 (投影 + 拟合，含门控分摊)
+    bool pareto = false;             // 同一条件下不被其他组合同时在精度和延迟上支配
+    bool meetsSpec = false;          // max(|bias|) + max(3σ) 不超过 precisionSpec，且无失败帧
+
+    double precision() const { return std::max(std::abs(biasX), std::abs(biasY)) + std::max(sigma3X, sigma3Y); }
+    double frameMs() const { return coarseMs + 8.0 * edgeUs / 1000.0; }
+};
+
+/**
+ * @class ParetoHarness
+ * @brief 估计器精度-延迟的 Pareto 扫描。
+ *
+ * 每帧对每种粗定位方式只做一次粗定位与投影 (BatchProcessor::captureProfiles)，
+ * 各 ModelType 在同一份投影上拟合 (Localization::fitProfiles)，拟合耗时单独计时，
+ * 因此不同模型之间的差异只来自估计器本身。逐帧结果完全相同的类型视为同一估计器，合并为一行，
+ * 避免重复行被当作独立测量进入前沿或推荐。结果输出为表格与 JSON，并给出每个条件下满足规格的最快组合。
+ */
+class ParetoHarness {
+public:
+    static std::vector<ParetoPoint> run(const ParetoConfig& cfg);
+
+    // 按条件分组标记 Pareto 前沿与规格达标
+    static void markPareto(std::vector<ParetoPoint>& points, double precisionSpec);
+
+    static void printTable(const std::vector<ParetoPoint>& points);
+    static bool writeJson(const std::string& path, const ParetoConfig& cfg, const std::vector<ParetoPoint>& points);
+};
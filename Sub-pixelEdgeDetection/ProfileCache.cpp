@@ -0,0 +1,156 @@
+﻿#include "ProfileCache.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+    const char FILE_MAGIC[4] = { 'O', 'P', 'R', 'F' };
+    const uint32_t FILE_VERSION = 1;
+    // 单帧子条带数 / 样本数上限：远大于实际 (8 条边 x 数十子条带 x 数百样本)，防止损坏的长度字段触发巨量分配
+    const uint32_t MAX_FRAME_ELEMENTS = 1u << 24;
+
+    uint64_t fnv1a64(const void* data, size_t n, uint64_t h = 1469598103934665603ULL) {
+        const unsigned char* p = (const unsigned char*)data;
+        for (size_t i = 0; i < n; ++i) {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    template <typename T>
+    void putRaw(ostream& out, const T& v) { out.write((const char*)&v, sizeof(T)); }
+
+    template <typename T>
+    bool getRaw(istream& in, T& v) { return (bool)in.read((char*)&v, sizeof(T)); }
+
+    template <typename T>
+    void putVec(ostream& out, const vector<T>& v) {
+        if (!v.empty()) out.write((const char*)v.data(), v.size() * sizeof(T));
+    }
+
+    template <typename T>
+    bool getVec(istream& in, vector<T>& v, size_t n) {
+        v.resize(n);
+        return n == 0 || (bool)in.read((char*)v.data(), n * sizeof(T));
+    }
+}
+
+size_t FrameProfiles::bytes() const {
+    return sizeof(FrameProfiles) + origins.size() * sizeof(int32_t) + offsets.size() * sizeof(uint32_t) + samples.size() * sizeof(float);
+}
+
+bool FrameProfiles::consistent() const {
+    if (origins.empty() && offsets.empty() && samples.empty()) return true;
+
+    size_t total = 0;
+    for (int i = 0; i < 8; ++i) {
+        if (strips[i] < 0) return false;
+        total += (size_t)strips[i];
+    }
+    if (total != origins.size() || offsets.size() != origins.size() + 1) return false;
+    if (offsets.front() != 0 || offsets.back() != samples.size()) return false;
+    for (size_t k = 1; k < offsets.size(); ++k) {
+        if (offsets[k] < offsets[k - 1]) return false;
+    }
+    return true;
+}
+
+uint64_t FrameProfiles::geometryKeyOf(const MarkGeometry& g, const RecipeFile::EdgeWindow edges[8]) {
+    uint64_t h = fnv1a64(&g, sizeof(MarkGeometry));
+    return fnv1a64(edges, 8 * sizeof(RecipeFile::EdgeWindow), h);
+}
+
+void ProfileCache::put(FrameProfiles&& profiles) {
+    auto key = make_pair(profiles.frameId, profiles.geometryKey);
+    auto it = index.find(key);
+    if (it != index.end()) {
+        entries[it->second] = std::move(profiles);
+        return;
+    }
+    index[key] = entries.size();
+    entries.push_back(std::move(profiles));
+}
+
+const FrameProfiles* ProfileCache::find(int64_t frameId, uint64_t geometryKey) const {
+    auto it = index.find(make_pair(frameId, geometryKey));
+    return (it == index.end()) ? nullptr : &entries[it->second];
+}
+
+size_t ProfileCache::bytes() const {
+    size_t total = 0;
+    for (const FrameProfiles& p : entries) total += p.bytes();
+    return total;
+}
+
+void ProfileCache::clear() {
+    entries.clear();
+    index.clear();
+}
+
+bool ProfileCache::save(const std::string& path) const {
+    ofstream ofs(path, ios::binary | ios::trunc);
+    if (!ofs) {
+        cerr << "[Profiles] Cannot write " << path << endl;
+        return false;
+    }
+
+    ofs.write(FILE_MAGIC, 4);
+    putRaw(ofs, FILE_VERSION);
+    putRaw(ofs, (uint64_t)entries.size());
+    for (const FrameProfiles& p : entries) {
+        putRaw(ofs, p.frameId);
+        putRaw(ofs, p.geometryKey);
+        putRaw(ofs, p.coarseX);
+        putRaw(ofs, p.coarseY);
+        putRaw(ofs, p.truthX);
+        putRaw(ofs, p.truthY);
+        putRaw(ofs, p.threshold);
+        putRaw(ofs, p.stripTrimRatio);
+        ofs.write((const char*)p.strips, sizeof(p.strips));
+        putRaw(ofs, (uint32_t)p.origins.size());
+        putRaw(ofs, (uint32_t)p.samples.size());
+        putVec(ofs, p.origins);
+        if (p.offsets.empty()) putRaw(ofs, (uint32_t)0);
+        else putVec(ofs, p.offsets);
+        putVec(ofs, p.samples);
+    }
+    return ofs.good();
+}
+
+bool ProfileCache::load(const std::string& path) {
+    ifstream ifs(path, ios::binary);
+    char magic[4] = {};
+    uint32_t version = 0;
+    uint64_t count = 0;
+    if (!ifs || !ifs.read(magic, 4) || memcmp(magic, FILE_MAGIC, 4) != 0 || !getRaw(ifs, version) || version != FILE_VERSION || !getRaw(ifs, count)) {
+        cerr << "[Profiles] Not a profile cache: " << path << endl;
+        return false;
+    }
+
+    for (uint64_t i = 0; i < count; ++i) {
+        FrameProfiles p;
+        uint32_t n = 0, m = 0;
+        bool ok = getRaw(ifs, p.frameId) && getRaw(ifs, p.geometryKey) && getRaw(ifs, p.coarseX) && getRaw(ifs, p.coarseY) &&
+            getRaw(ifs, p.truthX) && getRaw(ifs, p.truthY) && getRaw(ifs, p.threshold) && getRaw(ifs, p.stripTrimRatio) &&
+            ifs.read((char*)p.strips, sizeof(p.strips)) && getRaw(ifs, n) && getRaw(ifs, m);
+        if (ok && (n > MAX_FRAME_ELEMENTS || m > MAX_FRAME_ELEMENTS)) {
+            cerr << "[Profiles] Corrupt cache " << path << " at frame " << i << ": " << n << " strips, " << m << " samples" << endl;
+            return false;
+        }
+        ok = ok && getVec(ifs, p.origins, n) && getVec(ifs, p.offsets, (size_t)n + 1) && getVec(ifs, p.samples, m);
+        if (!ok) {
+            cerr << "[Profiles] Truncated cache " << path << " at frame " << i << endl;
+            return false;
+        }
+        if (!p.consistent()) {
+            cerr << "[Profiles] Corrupt cache " << path << " at frame " << i << ": strip index does not match samples" << endl;
+            return false;
+        }
+        put(std::move(p));
+    }
+    return true;
+}
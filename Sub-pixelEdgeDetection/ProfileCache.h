@@ -0,0 +1,67 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstdint>
+#include "MarkGeometry.h"
+#include "RecipeFile.h"
+
+/**
+ * @struct FrameProfiles
+ * @brief 单帧 8 条边全部子条带的投影 (精定位拟合的全部输入)，可脱离图像对任意 ModelType 重新拟合。
+ *
+ * 子条带按边顺序 (同 Localization::edgeRois) 拼接存放；投影失败的子条带长度为 0 (重拟合时同样视为失败)。
+ * 投影均值以 float 存放，约为原图 8 个窗口像素量的 1/20。
+ */
+struct FrameProfiles {
+    int64_t frameId = 0;
+    uint64_t geometryKey = 0;        // 窗口几何哈希，见 geometryKeyOf
+    int32_t coarseX = 0, coarseY = 0;
+    double truthX = 0.0, truthY = 0.0;   // 真值偏移 (仿真输入 / 标注，无真值时为 0)
+    double threshold = 0.0;          // 对比度阈值 (edgeGradientThreshold 已按位深缩放)
+    double stripTrimRatio = 0.0;
+    int32_t strips[8] = {};          // 每条边的子条带数 (0 = 窗口在图像外)
+    std::vector<int32_t> origins;    // 各子条带投影起点 (图像坐标，测量方向)
+    std::vector<uint32_t> offsets;   // 各子条带在 samples 中的起点，长度 = 子条带总数 + 1
+    std::vector<float> samples;      // 投影均值
+
+    size_t stripCount() const { return origins.size(); }
+    size_t bytes() const;
+
+    // 索引自洽：strips 之和 = 子条带数，offsets 从 0 单调不减且末项 = samples 长度 (空缓存视为自洽)
+    bool consistent() const;
+
+    // 测量窗口几何 (含自适应缩短后的窗口长度) 与窗口表的 FNV-1a 哈希：几何不同的投影不可混用
+    static uint64_t geometryKeyOf(const MarkGeometry& g, const RecipeFile::EdgeWindow edges[8]);
+};
+
+/**
+ * @class ProfileCache
+ * @brief 按 (帧号, 窗口几何) 索引的投影缓存，支持整体写盘/读回以便离线分析。
+ *
+ * 文件格式 (小端)：读入时逐帧校验长度上限与索引自洽 (见 FrameProfiles::consistent)，损坏文件整体拒绝
+ *   "OPRF" | uint32 版本 | uint64 帧数
+ *   每帧  int64 frameId | uint64 geometryKey | int32 coarseX, coarseY | double truthX, truthY, threshold, stripTrimRatio
+ *         | int32 strips[8] | uint32 子条带数 n | uint32 样本数 m | int32 origins[n] | uint32 offsets[n+1] | float samples[m]
+ */
+class ProfileCache {
+public:
+    // 同一 (帧号, 几何) 已存在时覆盖
+    void put(FrameProfiles&& profiles);
+    const FrameProfiles* find(int64_t frameId, uint64_t geometryKey) const;
+
+    const std::vector<FrameProfiles>& frames() const { return entries; }
+    size_t size() const { return entries.size(); }
+    size_t bytes() const;
+    void clear();
+
+    bool save(const std::string& path) const;
+    // 读入并合并到当前缓存
+    bool load(const std::string& path);
+
+private:
+    std::vector<FrameProfiles> entries;
+    std::map<std::pair<int64_t, uint64_t>, size_t> index;
+};
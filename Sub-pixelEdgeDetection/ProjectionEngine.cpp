@@ -0,0 +1,84 @@
+﻿#include "ProjectionEngine.h"
+
+using namespace cv;
+using namespace std;
+
+void ProjectionEngine::build(const cv::Mat& image, const std::vector<cv::Rect>& regions) {
+    CV_Assert(image.channels() == 1);
+    const Rect imageRect(0, 0, image.cols, image.rows);
+
+    used = 0;
+    for (const Rect& r : regions) {
+        Rect area = r & imageRect;
+        if (area.area() == 0) continue;
+
+        if (used == blocks.size()) blocks.emplace_back();
+        Block& b = blocks[used++];
+        b.area = area;
+        // 积分图缓冲尺寸不变时 integral 直接复用内存
+        integral(image(area), b.sum, CV_64F);
+    }
+}
+
+void ProjectionEngine::build(const cv::Mat& image, const cv::Rect& region) {
+    build(image, vector<Rect>{ region });
+}
+
+const ProjectionEngine::Block* ProjectionEngine::find(const cv::Rect& roi) const {
+    for (size_t k = 0; k < used; ++k) {
+        if ((roi & blocks[k].area) == roi) return &blocks[k];
+    }
+    return nullptr;
+}
+
+bool ProjectionEngine::contains(const cv::Rect& roi) const {
+    return roi.area() > 0 && find(roi) != nullptr;
+}
+
+double ProjectionEngine::sumIn(const Block& b, const cv::Rect& roi) {
+    int x0 = roi.x - b.area.x, y0 = roi.y - b.area.y;
+    int x1 = x0 + roi.width, y1 = y0 + roi.height;
+    const double* r0 = b.sum.ptr<double>(y0);
+    const double* r1 = b.sum.ptr<double>(y1);
+    return r1[x1] - r1[x0] - r0[x1] + r0[x0];
+}
+
+double ProjectionEngine::rectSum(const cv::Rect& roi) const {
+    const Block* b = find(roi);
+    CV_Assert(b != nullptr);
+    return sumIn(*b, roi);
+}
+
+double ProjectionEngine::bin(const cv::Rect& roi, int direction, int i) const {
+    if (direction == 0) return rectSum(Rect(roi.x + i, roi.y, 1, roi.height)) / roi.height;
+    else                return rectSum(Rect(roi.x, roi.y + i, roi.width, 1)) / roi.width;
+}
+
+bool ProjectionEngine::profile(const cv::Rect& roi, int direction, std::vector<double>& out) const {
+    const Block* b = find(roi);
+    if (!b || roi.area() == 0) return false;
+
+    int x0 = roi.x - b->area.x, y0 = roi.y - b->area.y;
+    const double* top = b->sum.ptr<double>(y0);
+    const double* bottom = b->sum.ptr<double>(y0 + roi.height);
+
+    if (direction == 0) {
+        // 第 j 列之和 = 列前缀差分：(B[j+1]-T[j+1]) - (B[j]-T[j])
+        out.resize(roi.width);
+        double prev = bottom[x0] - top[x0];
+        for (int j = 0; j < roi.width; ++j) {
+            double cur = bottom[x0 + j + 1] - top[x0 + j + 1];
+            out[j] = (cur - prev) / roi.height;
+            prev = cur;
+        }
+    }
+    else {
+        out.resize(roi.height);
+        for (int i = 0; i < roi.height; ++i) {
+            const double* r0 = b->sum.ptr<double>(y0 + i);
+            const double* r1 = b->sum.ptr<double>(y0 + i + 1);
+            out[i] = (r1[x0 + roi.width] - r1[x0] - r0[x0 + roi.width] + r0[x0]) / roi.width;
+        }
+    }
+    return true;
+}
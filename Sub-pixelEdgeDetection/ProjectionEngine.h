@@ -0,0 +1,60 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * @class ProjectionEngine
+ * @brief 基于积分图的 ROI 投影引擎。
+ *
+ * 每帧只在标记相关的区域上构建一次二维积分图 (CV_64F)，之后任意轴对齐 ROI 的
+ * 投影 bin 都是 O(1) 的四次查表；滑动/缩放 ROI、每条边测量多个子条带、
+ * 更换 ROI_SEARCH_WID 重新测量都不必再读取图像。
+ */
+class ProjectionEngine {
+public:
+    /**
+     * @brief 在若干区域上分别构建积分图 (区域会被裁剪到图像内)，缓冲跨帧复用。
+     * @param image 输入图像 (单通道)。
+     * @param regions 需要支持查询的区域 (如各测量窗口外扩一定余量)。
+     */
+    void build(const cv::Mat& image, const std::vector<cv::Rect>& regions);
+
+    // 单区域版本
+    void build(const cv::Mat& image, const cv::Rect& region);
+
+    /**
+     * @brief ROI 是否完全落在某个已构建的区域内。
+     */
+    bool contains(const cv::Rect& roi) const;
+
+    /**
+     * @brief ROI 内像素之和 (O(1))。ROI 必须被某个区域包含。
+     */
+    double rectSum(const cv::Rect& roi) const;
+
+    /**
+     * @brief 投影中的单个 bin (O(1))。
+     * @param roi 投影窗口。
+     * @param direction 0 = 沿列平均 (返回第 i 列的均值)，1 = 沿行平均 (返回第 i 行的均值)。
+     * @param i bin 序号。
+     */
+    double bin(const cv::Rect& roi, int direction, int i) const;
+
+    /**
+     * @brief 整个 ROI 的投影，等价于 reduce(REDUCE_AVG, CV_64F)。
+     * @param out [输出] 投影向量 (容量足够时不重新分配)。
+     * @return bool ROI 不在已构建区域内时返回 false。
+     */
+    bool profile(const cv::Rect& roi, int direction, std::vector<double>& out) const;
+
+private:
+    struct Block {
+        cv::Rect area;   // 图像坐标下的区域
+        cv::Mat sum;     // (h+1) x (w+1) 积分图
+    };
+    std::vector<Block> blocks;
+    size_t used = 0;     // 本帧有效的 block 数 (其余为复用缓冲)
+
+    const Block* find(const cv::Rect& roi) const;
+    static double sumIn(const Block& b, const cv::Rect& roi);
+};
@@ -0,0 +1,257 @@
+﻿#include "RecipeFile.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace {
+    const char FILE_MAGIC[4] = { 'O', 'V', 'R', 'C' };
+    const size_t CHUNK_ALIGN = 64;
+
+    constexpr uint32_t fourcc(char a, char b, char c, char d) {
+        return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+    }
+    const uint32_t TAG_NAME = fourcc('N', 'A', 'M', 'E');
+    const uint32_t TAG_GEOM = fourcc('G', 'E', 'O', 'M');
+    const uint32_t TAG_TMPL = fourcc('T', 'M', 'P', 'L');
+    const uint32_t TAG_EDGE = fourcc('E', 'D', 'G', 'E');
+
+#pragma pack(push, 1)
+    struct FileHeader {
+        char magic[4];
+        uint16_t versionMajor;
+        uint16_t versionMinor;
+        uint32_t chunkCount;
+        uint64_t fileSize;
+    };
+    struct ChunkHeader {
+        uint32_t tag;
+        uint32_t checksum;
+        uint64_t length;
+    };
+    struct TemplateHeader {
+        int32_t rows, cols, type, step;
+    };
+#pragma pack(pop)
+
+    uint32_t fnv1a(const char* data, size_t n) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < n; ++i) h = (h ^ (uint8_t)data[i]) * 16777619u;
+        return h;
+    }
+
+    size_t alignUp(size_t v) { return (v + CHUNK_ALIGN - 1) / CHUNK_ALIGN * CHUNK_ALIGN; }
+
+    // 偏移均相对文件起点 (前 sizeof(FileHeader) 字节预留给文件头)
+    struct ChunkWriter {
+        vector<char> bytes = vector<char>(sizeof(FileHeader));
+        uint32_t count = 0;
+
+        void add(uint32_t tag, const vector<char>& payload) {
+            // 负载起点按 64 字节对齐 (映射基址按页对齐，模板像素可直接用于 SIMD 读取)
+            bytes.resize(alignUp(bytes.size() + sizeof(ChunkHeader)) - sizeof(ChunkHeader));
+            ChunkHeader ch = { tag, fnv1a(payload.data(), payload.size()), payload.size() };
+            const char* p = (const char*)&ch;
+            bytes.insert(bytes.end(), p, p + sizeof(ch));
+            bytes.insert(bytes.end(), payload.begin(), payload.end());
+            count++;
+        }
+    };
+
+    template<typename T>
+    void append(vector<char>& v, const T& value) {
+        const char* p = (const char*)&value;
+        v.insert(v.end(), p, p + sizeof(T));
+    }
+}
+
+// ---------------------------------------------------------------- 只读文件映射
+
+struct RecipeFile::Mapping {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE map = nullptr;
+
+    bool open(const string& path) {
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER len;
+        if (!GetFileSizeEx(file, &len) || len.QuadPart == 0) return false;
+        map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!map) return false;
+        data = (const char*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)len.QuadPart;
+        return data != nullptr;
+    }
+    ~Mapping() {
+        if (data) UnmapViewOfFile(data);
+        if (map) CloseHandle(map);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+#else
+    bool open(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        data = (const char*)p;
+        size = (size_t)st.st_size;
+        return true;
+    }
+    ~Mapping() {
+        if (data) munmap((void*)data, size);
+    }
+#endif
+};
+
+// ---------------------------------------------------------------- RecipeFile
+
+RecipeFile::RecipeFile() : geom(MarkGeometry::fromConfig()) {}
+
+RecipeFile::~RecipeFile() {
+    close();
+}
+
+bool RecipeFile::save(const std::string& path, const std::string& name, const MarkGeometry& geometry, const cv::Mat& templ) {
+    if (templ.empty() || templ.dims != 2) return false;
+    Mat t = templ.isContinuous() ? templ : templ.clone();
+
+    ChunkWriter w;
+    w.add(TAG_NAME, vector<char>(name.begin(), name.end()));
+
+    vector<char> geomBytes;
+    append(geomBytes, geometry);
+    w.add(TAG_GEOM, geomBytes);
+
+    // 测量窗口表：与 Localization::edgeRois 相同的顺序
+    int outerRadius = geometry.outerBoxSize / 2, innerRadius = geometry.innerBoxSize / 2;
+    const EdgeWindow table[8] = {
+        { -outerRadius, 0 }, { outerRadius, 0 }, { -innerRadius, 0 }, { innerRadius, 0 },
+        { -outerRadius, 1 }, { outerRadius, 1 }, { -innerRadius, 1 }, { innerRadius, 1 }
+    };
+    vector<char> edgeBytes;
+    for (const EdgeWindow& e : table) append(edgeBytes, e);
+    w.add(TAG_EDGE, edgeBytes);
+
+    // 模板：头部 16 字节，像素紧随其后，填充使像素起点同样 64 字节对齐
+    vector<char> tmplBytes;
+    TemplateHeader th = { t.rows, t.cols, t.type(), (int32_t)t.step[0] };
+    append(tmplBytes, th);
+    tmplBytes.resize(CHUNK_ALIGN);
+    tmplBytes.insert(tmplBytes.end(), (const char*)t.data, (const char*)t.data + t.step[0] * t.rows);
+    w.add(TAG_TMPL, tmplBytes);
+
+    FileHeader fh;
+    memcpy(fh.magic, FILE_MAGIC, 4);
+    fh.versionMajor = VERSION_MAJOR;
+    fh.versionMinor = VERSION_MINOR;
+    fh.chunkCount = w.count;
+    fh.fileSize = w.bytes.size();
+    vector<char>& out = w.bytes;
+    memcpy(out.data(), &fh, sizeof(fh));
+
+    string tmp = path + ".tmp";
+    {
+        ofstream ofs(tmp, ios::binary | ios::trunc);
+        if (!ofs.write(out.data(), out.size())) return false;
+    }
+    std::remove(path.c_str());
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool RecipeFile::open(const std::string& path) {
+    close();
+
+    unique_ptr<Mapping> m(new Mapping());
+    if (!m->open(path)) {
+        cerr << "[Recipe] Cannot map " << path << endl;
+        return false;
+    }
+
+    FileHeader fh;
+    if (m->size < sizeof(fh)) return false;
+    memcpy(&fh, m->data, sizeof(fh));
+    if (memcmp(fh.magic, FILE_MAGIC, 4) != 0 || fh.fileSize != m->size) {
+        cerr << "[Recipe] Not a recipe file or truncated: " << path << endl;
+        return false;
+    }
+    if (fh.versionMajor != VERSION_MAJOR) {
+        cerr << "[Recipe] Unsupported version " << fh.versionMajor << "." << fh.versionMinor << endl;
+        return false;
+    }
+
+    if (!parseChunks(m->data, m->size, fh.chunkCount)) {
+        cerr << "[Recipe] Corrupted or incomplete recipe: " << path << endl;
+        close();
+        return false;
+    }
+    mapping = std::move(m);
+    return true;
+}
+
+bool RecipeFile::parseChunks(const char* data, size_t size, uint32_t chunkCount) {
+    bool hasGeom = false, hasTmpl = false;
+    const char* p = data + sizeof(FileHeader);
+    const char* end = data + size;
+    for (uint32_t i = 0; i < chunkCount; ++i) {
+        p = data + alignUp((size_t)(p - data) + sizeof(ChunkHeader)) - sizeof(ChunkHeader);
+        ChunkHeader ch;
+        if (p + sizeof(ch) > end) return false;
+        memcpy(&ch, p, sizeof(ch));
+        const char* payload = p + sizeof(ch);
+        if (ch.length > (uint64_t)(end - payload) || fnv1a(payload, (size_t)ch.length) != ch.checksum) return false;
+
+        if (ch.tag == TAG_NAME) {
+            recipeName.assign(payload, (size_t)ch.length);
+        }
+        else if (ch.tag == TAG_GEOM && ch.length == sizeof(MarkGeometry)) {
+            memcpy(&geom, payload, sizeof(MarkGeometry));
+            hasGeom = true;
+        }
+        else if (ch.tag == TAG_EDGE && ch.length == 8 * sizeof(EdgeWindow)) {
+            edgeTable = (const EdgeWindow*)payload;
+        }
+        else if (ch.tag == TAG_TMPL && ch.length >= CHUNK_ALIGN) {
+            TemplateHeader th;
+            memcpy(&th, payload, sizeof(th));
+            if ((uint64_t)th.step * th.rows + CHUNK_ALIGN != ch.length) return false;
+            // 只读映射页：调用方不得写入该 Mat
+            templateMat = Mat(th.rows, th.cols, th.type, (void*)(payload + CHUNK_ALIGN), (size_t)th.step);
+            hasTmpl = true;
+        }
+        p = payload + ch.length;
+    }
+
+    return hasGeom && hasTmpl && edgeTable != nullptr;
+}
+
+void RecipeFile::close() {
+    templateMat = Mat();
+    edgeTable = nullptr;
+    recipeName.clear();
+    geom = MarkGeometry::fromConfig();
+    mapping.reset();
+}
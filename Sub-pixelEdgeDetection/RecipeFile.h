@@ -0,0 +1,58 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <cstdint>
+#include <memory>
+#include "MarkGeometry.h"
+
+/**
+ * @class RecipeFile
+ * @brief 版本化二进制配方文件：模板、由其派生的预计算数据与标记几何，整文件只读映射 (mmap) 加载。
+ *
+ * 格式 (小端)：
+ *   文件头  "OVRC" | uint16 主版本 | uint16 次版本 | uint32 块数 | uint64 文件长度
+ *   块      uint32 标签 | uint32 FNV-1a 校验 | uint64 负载长度 | 负载 (按 64 字节对齐)
+ * 标签：NAME 配方名；GEOM MarkGeometry；TMPL 模板 (int32 rows/cols/type/step + 像素)；
+ *       EDGE 8 个测量窗口 (int32 offset, int32 direction，顺序同 Localization::edgeRois)。
+ * 主版本不同拒绝加载；未知标签跳过，便于增加新的预计算块而保持向后兼容。
+ * 模板像素直接以 cv::Mat 头包装映射页，不拷贝，启动耗时与文件大小基本无关。
+ */
+class RecipeFile {
+public:
+    static const uint16_t VERSION_MAJOR = 1;
+    static const uint16_t VERSION_MINOR = 0;
+
+    struct EdgeWindow {
+        int32_t offset;
+        int32_t direction;   // 0 = X方向边缘, 1 = Y方向边缘
+    };
+
+    RecipeFile();
+    ~RecipeFile();
+    RecipeFile(const RecipeFile&) = delete;
+    RecipeFile& operator=(const RecipeFile&) = delete;
+
+    // 生成配方：按几何计算测量窗口表并与模板一起写出
+    static bool save(const std::string& path, const std::string& name, const MarkGeometry& geometry, const cv::Mat& templ);
+
+    // 映射并校验文件；成功后各访问函数有效，直到 close()
+    bool open(const std::string& path);
+    void close();
+
+    const std::string& name() const { return recipeName; }
+    const MarkGeometry& geometry() const { return geom; }
+    const EdgeWindow* edges() const { return edgeTable; }
+    // 模板 (只读，指向映射页)
+    const cv::Mat& templ() const { return templateMat; }
+
+private:
+    bool parseChunks(const char* data, size_t size, uint32_t chunkCount);
+
+    struct Mapping;
+    std::unique_ptr<Mapping> mapping;
+
+    std::string recipeName;
+    MarkGeometry geom;
+    const EdgeWindow* edgeTable = nullptr;
+    cv::Mat templateMat;
+};
@@ -0,0 +1,167 @@
+﻿#include "RecipeRegistry.h"
+#include "ImageSimulator.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+    // 几何合法性：尺寸为正、内框 < 外框 <= 模板，测量窗口 (含积分图外扩) 不超出模板、不宽于内框边
+    bool checkGeometry(const MarkGeometry& g, string& error) {
+        if (g.waferSize <= 0 || g.outerBoxSize <= 0 || g.innerBoxSize <= 0 || g.lineWidth <= 0 ||
+            g.roiSearchLen <= 0 || g.roiSearchWid <= 0 || g.projectionMargin < 0) {
+            error = "non-positive size";
+        }
+        else if (g.innerBoxSize >= g.outerBoxSize || g.outerBoxSize > g.waferSize) {
+            error = "boxes must satisfy inner < outer <= waferSize";
+        }
+        else if (g.subStrips < 1 || g.subStrips > g.roiSearchWid) {
+            error = "subStrips must be in [1, roiSearchWid]";
+        }
+        else if (g.outerBoxSize / 2 + g.roiSearchLen / 2 + g.projectionMargin > g.waferSize / 2) {
+            error = "measurement windows extend beyond the mark";
+        }
+        else if (g.roiSearchWid > g.innerBoxSize) {
+            error = "measurement windows are wider than the inner box edge";
+        }
+        else if (!(g.stripTrimRatio >= 0.0 && g.stripTrimRatio < 0.5) || !(g.edgeGradientThreshold >= 0.0)) {
+            error = "stripTrimRatio must be in [0, 0.5) and edgeGradientThreshold >= 0";
+        }
+        return error.empty();
+    }
+}
+
+RecipeRegistry::RecipeRegistry() : snapshot(make_shared<const PlanMap>()) {}
+
+std::shared_ptr<const RecipePlan> RecipeRegistry::buildPlan(int id, const std::string& name, const MarkGeometry& geometry,
+    const cv::Mat& templ, std::shared_ptr<RecipeFile> source) {
+    string error;
+    if (!checkGeometry(geometry, error)) {
+        cerr << "[Recipe] Rejected plan " << id << " ('" << name << "'): " << error << endl;
+        return nullptr;
+    }
+
+    auto plan = make_shared<RecipePlan>();
+    plan->id = id;
+    plan->name = name;
+    plan->geometry = geometry;
+    plan->source = source;
+    plan->templ = templ;
+
+    int outerRadius = geometry.outerBoxSize / 2, innerRadius = geometry.innerBoxSize / 2;
+    const RecipeFile::EdgeWindow table[8] = {
+        { -outerRadius, 0 }, { outerRadius, 0 }, { -innerRadius, 0 }, { innerRadius, 0 },
+        { -outerRadius, 1 }, { outerRadius, 1 }, { -innerRadius, 1 }, { innerRadius, 1 }
+    };
+    std::copy(table, table + 8, plan->edges);
+
+    plan->oriented = { geometry.outerBoxSize, geometry.innerBoxSize, geometry.roiSearchLen, geometry.roiSearchWid };
+    // 探测窗口位于外框边的 1/4 处 (标准几何下即 ROTATION_PROBE_SPAN)，不越过内框
+    plan->rotationProbeSpan = std::min(WaferConfig::ROTATION_PROBE_SPAN, geometry.outerBoxSize / 4);
+    plan->profileCapacity = geometry.roiSearchLen + 2 * geometry.projectionMargin;
+
+    // 积分图区域 (相对模板左上角)，与 Localization::fineLocalization 中的外扩方式一致
+    Point center(geometry.waferSize / 2, geometry.waferSize / 2);
+    int m = geometry.projectionMargin;
+    for (const RecipeFile::EdgeWindow& e : plan->edges) {
+        Point c = center + (e.direction == 0 ? Point(e.offset, 0) : Point(0, e.offset));
+        Size sz = (e.direction == 0) ? Size(geometry.roiSearchLen, geometry.roiSearchWid) : Size(geometry.roiSearchWid, geometry.roiSearchLen);
+        plan->projectionRegions.push_back(Rect(c.x - sz.width / 2 - m, c.y - sz.height / 2 - m, sz.width + 2 * m, sz.height + 2 * m));
+    }
+    return plan;
+}
+
+std::shared_ptr<const RecipePlan> RecipeRegistry::buildSimulated(int id, const std::string& name, const MarkGeometry& geometry) {
+    string error;
+    if (!checkGeometry(geometry, error)) {
+        cerr << "[Recipe] Rejected plan " << id << " ('" << name << "'): " << error << endl;
+        return nullptr;
+    }
+    ImageSimulator sim;
+    sim.setGeometry(geometry);
+    return buildPlan(id, name, geometry, sim.generateWaferImage(geometry.waferSize, 0, 0, 0, 0));
+}
+
+std::shared_ptr<const RecipePlan> RecipeRegistry::buildFromFile(int id, const std::string& path) {
+    auto file = make_shared<RecipeFile>();
+    if (!file->open(path)) return nullptr;
+    return buildPlan(id, file->name(), file->geometry(), file->templ(), file);
+}
+
+void RecipeRegistry::publish(std::shared_ptr<const RecipePlan> plan) {
+    if (!plan) return;
+    lock_guard<mutex> lock(writeMutex);
+    auto next = make_shared<PlanMap>(*std::atomic_load(&snapshot));
+    (*next)[plan->id] = plan;
+    std::atomic_store(&snapshot, shared_ptr<const PlanMap>(next));
+}
+
+void RecipeRegistry::remove(int id) {
+    lock_guard<mutex> lock(writeMutex);
+    auto next = make_shared<PlanMap>(*std::atomic_load(&snapshot));
+    next->erase(id);
+    std::atomic_store(&snapshot, shared_ptr<const PlanMap>(next));
+}
+
+std::future<bool> RecipeRegistry::loadAsync(int id, const std::string& path) {
+    return std::async(std::launch::async, [this, id, path] {
+        auto plan = buildFromFile(id, path);
+        if (!plan) return false;
+        publish(plan);
+        cout << "[Recipe] Plan " << id << " ('" << plan->name << "') ready" << endl;
+        return true;
+        });
+}
+
+bool RecipeRegistry::parseSpec(const std::string& spec, int& id, std::string& path) {
+    size_t eq = spec.find('=');
+    if (eq == string::npos || eq == 0 || eq + 1 >= spec.size()) return false;
+    char* end = nullptr;
+    long v = strtol(spec.c_str(), &end, 10);
+    if (end != spec.c_str() + eq) return false;
+    id = (int)v;
+    path = spec.substr(eq + 1);
+    return true;
+}
+
+bool RecipeRegistry::loadSpecs(const std::vector<std::string>& specs) {
+    vector<pair<int, string>> parsed;
+    for (const string& s : specs) {
+        int id = 0;
+        string path;
+        if (!parseSpec(s, id, path)) {
+            cerr << "[Recipe] Expected id=path, got '" << s << "'" << endl;
+            return false;
+        }
+        parsed.push_back(make_pair(id, path));
+    }
+
+    bool hasDefault = std::any_of(parsed.begin(), parsed.end(), [](const pair<int, string>& p) { return p.first == 0; });
+    if (!hasDefault) publish(buildSimulated(0, "WaferConfig", MarkGeometry::fromConfig()));
+
+    vector<future<bool>> pending;
+    for (const auto& p : parsed) pending.push_back(loadAsync(p.first, p.second));
+
+    bool ok = true;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (pending[i].get()) continue;
+        cerr << "[Recipe] Cannot load plan " << parsed[i].first << " from " << parsed[i].second << endl;
+        ok = false;
+    }
+    return ok;
+}
+
+std::shared_ptr<const RecipePlan> RecipeRegistry::find(int id) const {
+    auto plans = std::atomic_load(&snapshot);
+    auto it = plans->find(id);
+    return (it != plans->end()) ? it->second : nullptr;
+}
+
+std::vector<int> RecipeRegistry::ids() const {
+    auto plans = std::atomic_load(&snapshot);
+    vector<int> out;
+    for (const auto& kv : *plans) out.push_back(kv.first);
+    return out;
+}
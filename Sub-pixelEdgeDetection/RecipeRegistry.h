@@ -0,0 +1,74 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <string>
+#include <vector>
+#include "MarkGeometry.h"
+#include "RecipeFile.h"
+#include "OrientedSampler.h"
+
+/**
+ * @struct RecipePlan
+ * @brief 一种标记设计的预计算执行计划，构建后只读，可被任意线程共享。
+ */
+struct RecipePlan {
+    int id = 0;
+    std::string name;
+    MarkGeometry geometry = MarkGeometry::fromConfig();
+    cv::Mat templ;                                // 粗定位模板 (只读)
+    std::shared_ptr<RecipeFile> source;           // 模板来自配方文件时持有其映射
+    RecipeFile::EdgeWindow edges[8] = {};         // 测量窗口 (offset, direction)，顺序同 Localization::edgeRois
+    OrientedGeometry oriented = {};               // 旋转采样表的几何键
+    int rotationProbeSpan = 0;                    // 旋转估计探测窗口距边中点的距离
+    int profileCapacity = 0;                      // 单个投影的最大长度 (测量方向含外扩)
+    std::vector<cv::Rect> projectionRegions;      // 相对模板左上角的 8 个积分图区域 (已外扩)
+};
+
+/**
+ * @class RecipeRegistry
+ * @brief 运行时配方表：按 id 保存共享的 RecipePlan，逐帧按 id 取用，无需任何每帧准备。
+ *
+ * 读取走快照 (shared_ptr 原子加载)，与发布互不阻塞；发布为写时复制。
+ * 新配方可在后台线程构建 (loadAsync)，构建完成前流水线继续使用旧快照，切换配方不会停顿。
+ */
+class RecipeRegistry {
+public:
+    RecipeRegistry();
+
+    // 由几何与模板构建计划 (模板可为空，由使用方另行设置)
+    // 几何非法 (尺寸非正、subStrips < 1、测量窗口超出标记等) 时报错并返回空
+    static std::shared_ptr<const RecipePlan> buildPlan(int id, const std::string& name, const MarkGeometry& geometry,
+        const cv::Mat& templ = cv::Mat(), std::shared_ptr<RecipeFile> source = nullptr);
+    // 按几何用仿真器生成标准模板 (无偏移) 并构建计划
+    static std::shared_ptr<const RecipePlan> buildSimulated(int id, const std::string& name, const MarkGeometry& geometry);
+    // 由配方文件构建计划 (模板零拷贝)
+    static std::shared_ptr<const RecipePlan> buildFromFile(int id, const std::string& path);
+
+    // 发布计划 (同 id 替换)；已取得旧计划的线程继续安全使用旧计划直到释放
+    void publish(std::shared_ptr<const RecipePlan> plan);
+    void remove(int id);
+
+    // 后台加载配方文件并发布，返回是否成功
+    std::future<bool> loadAsync(int id, const std::string& path);
+
+    /**
+     * @brief 加载 "id=path" 形式的配方列表 (命令行 --recipe)，各文件并行构建 (loadAsync)。
+     *        未指定 0 号配方时先按 WaferConfig 几何仿真生成 0 号计划。
+     * @return bool 全部配方加载成功时返回 true。
+     */
+    bool loadSpecs(const std::vector<std::string>& specs);
+    // 解析 "id=path"
+    static bool parseSpec(const std::string& spec, int& id, std::string& path);
+
+    // 取得计划 (不存在返回空)
+    std::shared_ptr<const RecipePlan> find(int id) const;
+    std::vector<int> ids() const;
+
+private:
+    typedef std::map<int, std::shared_ptr<const RecipePlan>> PlanMap;
+    std::shared_ptr<const PlanMap> snapshot;
+    std::mutex writeMutex;   // 仅串行化发布者
+};
@@ -0,0 +1,314 @@
+﻿#include "ResultLog.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <filesystem>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+    const char FILE_MAGIC[4] = { 'O', 'L', 'O', 'G' };
+    const char BLOCK_MAGIC[4] = { 'B', 'L', 'K', '1' };
+    // 版本 2：新增 quality 列。版本 1 的文件按列名转换读取 (缺失列取默认值)
+    const uint32_t FILE_VERSION = 2;
+    const size_t NAME_LEN = 16;
+
+    // 头部字节串：新建时写入，追加/读取时逐字节比对
+    vector<char> buildHeader() {
+        vector<char> h(FILE_MAGIC, FILE_MAGIC + 4);
+        auto put32 = [&](uint32_t v) { const char* p = (const char*)&v; h.insert(h.end(), p, p + 4); };
+        put32(FILE_VERSION);
+        put32((uint32_t)ResultLog::columns().size());
+        for (const ResultLog::Column& c : ResultLog::columns()) {
+            char name[NAME_LEN] = {};
+            memcpy(name, c.name, std::min(strlen(c.name), NAME_LEN - 1));
+            h.insert(h.end(), name, name + NAME_LEN);
+            put32(c.type);
+            put32(c.size);
+        }
+        return h;
+    }
+
+    bool readHeader(istream& in) {
+        vector<char> expected = buildHeader(), actual(expected.size());
+        return in.read(actual.data(), actual.size()) && actual == expected;
+    }
+
+    // 从 begin 起逐块跳读，返回最后一个完整数据块的结束偏移 (之后为崩溃留下的半块或垃圾)
+    uint64_t completeLength(istream& in, uint64_t begin, uint64_t fileSize, size_t recordBytes) {
+        uint64_t end = begin;
+        char blockHead[8];
+        in.clear();
+        in.seekg((streamoff)begin);
+        while (end + 8 <= fileSize && in.read(blockHead, 8) && memcmp(blockHead, BLOCK_MAGIC, 4) == 0) {
+            uint32_t n;
+            memcpy(&n, blockHead + 4, 4);
+            uint64_t next = end + 8 + (uint64_t)n * recordBytes;
+            if (next > fileSize) break;
+            end = next;
+            in.seekg((streamoff)end);
+        }
+        return end;
+    }
+
+    size_t recordBytesOf(const vector<ResultLog::Column>& cols) {
+        size_t bytes = 0;
+        for (const ResultLog::Column& c : cols) bytes += c.size;
+        return bytes;
+    }
+
+    // 文件中的一列：按列名对应到当前 ResultRecord 字段，target 为空表示当前版本已无此列 (读取时跳过)
+    struct FileColumn {
+        uint32_t size = 0;
+        const ResultLog::Column* target = nullptr;
+    };
+
+    // 解析任意版本的头部 (列描述自带名称/类型/宽度)；魔数不符、版本更新或列描述损坏时返回 false
+    bool readFileColumns(istream& in, uint32_t& version, vector<FileColumn>& cols, string& error) {
+        char magic[4];
+        uint32_t count = 0;
+        if (!in.read(magic, 4) || memcmp(magic, FILE_MAGIC, 4) != 0 || !in.read((char*)&version, 4) || !in.read((char*)&count, 4)) {
+            error = "not a result log";
+            return false;
+        }
+        if (version == 0 || version > FILE_VERSION) {
+            error = "unsupported version " + to_string(version) + " (this build reads up to " + to_string(FILE_VERSION) + ")";
+            return false;
+        }
+        if (count == 0 || count > 1024) {
+            error = "corrupt column table";
+            return false;
+        }
+
+        cols.assign(count, FileColumn());
+        for (FileColumn& fc : cols) {
+            char name[NAME_LEN + 1] = {};
+            uint32_t type = 0;
+            if (!in.read(name, NAME_LEN) || !in.read((char*)&type, 4) || !in.read((char*)&fc.size, 4) || fc.size == 0 || fc.size > 8) {
+                error = "corrupt column table";
+                return false;
+            }
+            for (const ResultLog::Column& c : ResultLog::columns()) {
+                if (strcmp(c.name, name) == 0 && c.type == type && c.size == fc.size) fc.target = &c;
+            }
+        }
+        return true;
+    }
+}
+
+#define RESULT_COLUMN(name, field, type) { name, type, (uint32_t)sizeof(ResultRecord::field), offsetof(ResultRecord, field) }
+#define EDGE_COLUMN(name, i) { name, 3, (uint32_t)sizeof(double), offsetof(ResultRecord, edges) + (i) * sizeof(double) }
+
+const std::vector<ResultLog::Column>& ResultLog::columns() {
+    static const vector<Column> cols = {
+        RESULT_COLUMN("frameId", frameId, 1),
+        RESULT_COLUMN("coarseX", coarseX, 0),
+        RESULT_COLUMN("coarseY", coarseY, 0),
+        EDGE_COLUMN("xOutL", 0), EDGE_COLUMN("xOutR", 1), EDGE_COLUMN("xInL", 2), EDGE_COLUMN("xInR", 3),
+        EDGE_COLUMN("yOutT", 4), EDGE_COLUMN("yOutB", 5), EDGE_COLUMN("yInT", 6), EDGE_COLUMN("yInB", 7),
+        RESULT_COLUMN("overlayX", overlayX, 3),
+        RESULT_COLUMN("overlayY", overlayY, 3),
+        RESULT_COLUMN("status", status, 0),
+        RESULT_COLUMN("quality", quality, 0),
+        RESULT_COLUMN("renderMs", renderMs, 2),
+        RESULT_COLUMN("coarseMs", coarseMs, 2),
+        RESULT_COLUMN("fineMs", fineMs, 2),
+    };
+    return cols;
+}
+
+ResultLog::ResultLog(size_t ringCapacity, int blockRecords)
+    : ring(std::max<size_t>(ringCapacity, 1)), blockRecords(std::max(1, blockRecords)) {
+    // 块不能超过环形缓冲，否则后台线程永远凑不满一块
+    this->blockRecords = (int)std::min<size_t>(this->blockRecords, ring.size());
+    blockBuffer.resize((size_t)this->blockRecords * sizeof(ResultRecord) + 8);
+}
+
+ResultLog::~ResultLog() {
+    close();
+}
+
+bool ResultLog::open(const std::string& path) {
+    close();
+
+    // 已有文件：头部一致时截掉崩溃留下的不完整尾块再追加 (否则新块接在半块之后，读取端按旧记录数越界)；
+    // 头部不一致 (其他版本/列布局) 时改名保留，绝不清空已有数据
+    bool appendable = false;
+    error_code ec;
+    uint64_t fileSize = fs::exists(path, ec) ? fs::file_size(path, ec) : 0;
+    if (!ec && fileSize > 0) {
+        uint64_t keep = 0;
+        {
+            ifstream probe(path, ios::binary);
+            appendable = probe && readHeader(probe);
+            if (appendable) keep = completeLength(probe, buildHeader().size(), fileSize, recordBytesOf(columns()));
+        }
+        if (appendable && keep < fileSize) {
+            cerr << "[ResultLog] Dropping " << (fileSize - keep) << " bytes of incomplete block at the end of " << path << endl;
+            fs::resize_file(path, keep, ec);
+        }
+        else if (!appendable) {
+            string aside = path + ".old";
+            for (int k = 1; fs::exists(aside); ++k) aside = path + ".old" + to_string(k);
+            cerr << "[ResultLog] " << path << " has a different header, moved to " << aside << endl;
+            fs::rename(path, aside, ec);
+        }
+        if (ec) {
+            cerr << "[ResultLog] Cannot recover " << path << ": " << ec.message() << endl;
+            return false;
+        }
+    }
+
+    file.open(path, ios::binary | (appendable ? ios::app : ios::trunc));
+    if (!file) {
+        cerr << "[ResultLog] Cannot open " << path << endl;
+        return false;
+    }
+    if (!appendable) {
+        vector<char> header = buildHeader();
+        file.write(header.data(), header.size());
+        file.flush();
+    }
+
+    head = 0;
+    tail = 0;
+    stallCount = 0;
+    stopping = false;
+    writer = thread(&ResultLog::writerLoop, this);
+    return true;
+}
+
+void ResultLog::close() {
+    if (writer.joinable()) {
+        stopping = true;
+        writer.join();
+    }
+    if (file.is_open()) file.close();
+}
+
+void ResultLog::write(const ResultRecord& record) {
+    uint64_t h = head.load(memory_order_relaxed);
+    while (h - tail.load(memory_order_acquire) >= ring.size()) {
+        stallCount.fetch_add(1, memory_order_relaxed);
+        this_thread::yield();
+    }
+    memcpy(&ring[h % ring.size()], &record, sizeof(ResultRecord));
+    head.store(h + 1, memory_order_release);
+}
+
+void ResultLog::writerLoop() {
+    auto lastWrite = chrono::steady_clock::now();
+    for (;;) {
+        uint64_t t = tail.load(memory_order_relaxed);
+        uint64_t avail = head.load(memory_order_acquire) - t;
+        bool stop = stopping.load();
+
+        // 凑满一块，或已停止/空闲超过 100 ms 时把尾部也写出
+        bool idleFlush = avail > 0 &&
+            chrono::steady_clock::now() - lastWrite > chrono::milliseconds(100);
+        if (avail >= (uint64_t)blockRecords || ((stop || idleFlush) && avail > 0)) {
+            size_t n = (size_t)std::min<uint64_t>(avail, blockRecords);
+            writeBlock(t, n);
+            tail.store(t + n, memory_order_release);
+            lastWrite = chrono::steady_clock::now();
+            continue;
+        }
+        if (stop) break;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+void ResultLog::writeBlock(uint64_t from, size_t count) {
+    // 行 -> 列转置到块缓冲，整块一次写出
+    char* out = blockBuffer.data();
+    memcpy(out, BLOCK_MAGIC, 4);
+    uint32_t n = (uint32_t)count;
+    memcpy(out + 4, &n, 4);
+    out += 8;
+
+    for (const Column& c : columns()) {
+        for (size_t i = 0; i < count; ++i) {
+            const char* rec = (const char*)&ring[(from + i) % ring.size()];
+            memcpy(out, rec + c.offset, c.size);
+            out += c.size;
+        }
+    }
+    file.write(blockBuffer.data(), out - blockBuffer.data());
+    file.flush();
+}
+
+bool ResultLogReader::read(const std::string& path, std::vector<ResultRecord>& records) {
+    records.clear();
+    ifstream f(path, ios::binary);
+    if (!f) {
+        cerr << "[ResultLog] Cannot open " << path << endl;
+        return false;
+    }
+    uint32_t version = 0;
+    vector<FileColumn> fileCols;
+    string error;
+    if (!readFileColumns(f, version, fileCols, error)) {
+        cerr << "[ResultLog] Cannot read " << path << ": " << error << endl;
+        return false;
+    }
+    if (version < FILE_VERSION) {
+        cerr << "[ResultLog] " << path << " is a version " << version << " log, converting (missing columns read as 0)" << endl;
+    }
+
+    size_t recordBytes = 0;
+    for (const FileColumn& fc : fileCols) recordBytes += fc.size;
+
+    vector<char> block;
+    char blockHead[8];
+    while (f.read(blockHead, 8) && memcmp(blockHead, BLOCK_MAGIC, 4) == 0) {
+        uint32_t n;
+        memcpy(&n, blockHead + 4, 4);
+        block.resize((size_t)n * recordBytes);
+        if (!f.read(block.data(), block.size())) break;   // 末尾不完整的块
+
+        size_t base = records.size();
+        records.resize(base + n);
+        const char* in = block.data();
+        for (const FileColumn& fc : fileCols) {
+            for (uint32_t i = 0; i < n && fc.target; ++i) {
+                memcpy((char*)&records[base + i] + fc.target->offset, in + (size_t)i * fc.size, fc.size);
+            }
+            in += (size_t)n * fc.size;
+        }
+    }
+    return true;
+}
+
+bool ResultLogReader::exportCsv(const std::string& logPath, const std::string& csvPath) {
+    vector<ResultRecord> records;
+    if (!read(logPath, records)) return false;
+
+    ofstream ofs(csvPath, ios::trunc);
+    if (!ofs) return false;
+
+    const vector<ResultLog::Column>& cols = ResultLog::columns();
+    for (size_t i = 0; i < cols.size(); ++i) ofs << (i ? "," : "") << cols[i].name;
+    ofs << "\n" << setprecision(10);
+
+    for (const ResultRecord& r : records) {
+        for (size_t i = 0; i < cols.size(); ++i) {
+            const char* p = (const char*)&r + cols[i].offset;
+            if (i) ofs << ",";
+            switch (cols[i].type) {
+            case 0: { int32_t v; memcpy(&v, p, 4); ofs << v; break; }
+            case 1: { int64_t v; memcpy(&v, p, 8); ofs << v; break; }
+            case 2: { float v; memcpy(&v, p, 4); ofs << v; break; }
+            default: { double v; memcpy(&v, p, 8); ofs << v; break; }
+            }
+        }
+        ofs << "\n";
+    }
+
+    cout << "[ResultLog] Exported " << records.size() << " records to " << csvPath << endl;
+    return ofs.good();
+}
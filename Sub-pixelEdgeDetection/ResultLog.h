@@ -0,0 +1,85 @@
+﻿#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+/**
+ * @struct ResultRecord
+ * @brief 单帧结果的定长记录 (写入时整条 memcpy 进环形缓冲)。
+ */
+struct ResultRecord {
+    int64_t frameId = 0;
+    int32_t coarseX = 0, coarseY = 0;
+    double edges[8] = {};            // 8 条边的原始位置，顺序同 Localization::edgeRois，-999 为无效
+    double overlayX = -999.0, overlayY = -999.0;
+    int32_t status = 0;              // FrameStatus
+    int32_t quality = 0;             // QualityVerdict (REJECTED 帧的拒绝原因)
+    float renderMs = 0.f, coarseMs = 0.f, fineMs = 0.f;   // 各阶段耗时
+};
+
+/**
+ * @class ResultLog
+ * @brief 列式、仅追加的二进制结果日志。
+ *
+ * 文件格式 (小端)：
+ *   头部  "OLOG" | uint32 版本 | uint32 列数 | 每列 { char name[16]; uint32 类型; uint32 元素字节数 }
+ *   列布局变化时递增版本；读取端按头部中的列名转换旧版本文件，写入端不向旧版本文件追加 (见 open)
+ *   数据块 "BLK1" | uint32 记录数 n | 逐列连续存放 n 个值
+ * 写入端只把记录 memcpy 进单生产者/单消费者环形缓冲，后台线程凑满一块后转置为列写盘；
+ * 进程中途退出时最多丢失未成块的尾部记录，已写入的块保持完整可读。
+ *
+ * 每个 ResultLog 只允许一个线程调用 write()；多线程各自持有一个日志 (如按分片分文件)。
+ */
+class ResultLog {
+public:
+    explicit ResultLog(size_t ringCapacity = 1 << 16, int blockRecords = 4096);
+    ~ResultLog();
+
+    // 打开日志：文件已存在且头部一致时截掉不完整的尾块后在末尾追加；
+    // 头部不一致时把原文件改名为 <path>.old (已存在则 .old1、.old2 ...) 保留，再新建
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return file.is_open(); }
+
+    // 写入一条记录；缓冲满时等待后台线程 (计入 stalls)
+    void write(const ResultRecord& record);
+
+    uint64_t written() const { return head.load(); }
+    uint64_t stalls() const { return stallCount.load(); }
+
+    // 列描述 (写入与读取共用)
+    struct Column {
+        const char* name;
+        uint32_t type;        // 0 = int32, 1 = int64, 2 = float32, 3 = float64
+        uint32_t size;
+        size_t offset;        // 在 ResultRecord 中的偏移
+    };
+    static const std::vector<Column>& columns();
+
+private:
+    void writerLoop();
+    void writeBlock(uint64_t from, size_t count);
+
+    std::ofstream file;
+    std::vector<ResultRecord> ring;
+    int blockRecords;
+    std::vector<char> blockBuffer;
+    std::atomic<uint64_t> head{ 0 }, tail{ 0 }, stallCount{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::thread writer;
+};
+
+/**
+ * @class ResultLogReader
+ * @brief 读取 ResultLog 文件并导出 CSV。
+ */
+class ResultLogReader {
+public:
+    // 读取全部完整数据块 (末尾不完整的块被忽略)。旧版本文件按列名转换，当前版本没有的列取默认值；
+    // 更新版本或非日志文件报错返回 false
+    static bool read(const std::string& path, std::vector<ResultRecord>& records);
+    static bool exportCsv(const std::string& logPath, const std::string& csvPath);
+};
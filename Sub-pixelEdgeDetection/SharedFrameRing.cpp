@@ -0,0 +1,227 @@
+﻿#include "SharedFrameRing.h"
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <new>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace {
+    const uint32_t RING_MAGIC = 0x474E5252;   // "RRNG"
+    const uint32_t RING_VERSION = 2;   // 2: SlotHeader::recipeId 与配方控制信箱
+    const size_t PAGE = 4096;
+
+    size_t alignUp(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared-memory atomics must be lock-free");
+}
+
+// ---------------------------------------------------------------- SharedMemoryRegion
+
+SharedMemoryRegion::~SharedMemoryRegion() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool SharedMemoryRegion::create(const std::string& name, size_t size) {
+    close();
+    string fullName = "Local\\" + name;
+    HANDLE h = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFFu), fullName.c_str());
+    if (!h) return false;
+    base = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!base) {
+        CloseHandle(h);
+        return false;
+    }
+    mapping = h;
+    bytes = size;
+    owner = true;
+    return true;
+}
+
+bool SharedMemoryRegion::open(const std::string& name) {
+    close();
+    string fullName = "Local\\" + name;
+    HANDLE h = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, fullName.c_str());
+    if (!h) return false;
+    base = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!base) {
+        CloseHandle(h);
+        return false;
+    }
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(base, &info, sizeof(info));
+    mapping = h;
+    bytes = info.RegionSize;
+    owner = false;
+    return true;
+}
+
+void SharedMemoryRegion::close() {
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle((HANDLE)mapping);
+    base = nullptr;
+    mapping = nullptr;
+    bytes = 0;
+}
+
+#else
+
+bool SharedMemoryRegion::create(const std::string& name, size_t size) {
+    close();
+    string fullName = "/" + name;
+    shm_unlink(fullName.c_str());   // 清除上次异常退出残留的区域
+    int fd = shm_open(fullName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return false;
+    if (ftruncate(fd, (off_t)size) != 0) {
+        ::close(fd);
+        shm_unlink(fullName.c_str());
+        return false;
+    }
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(fullName.c_str());
+        return false;
+    }
+    base = p;
+    bytes = size;
+    owner = true;
+    shmName = fullName;
+    return true;
+}
+
+bool SharedMemoryRegion::open(const std::string& name) {
+    close();
+    string fullName = "/" + name;
+    int fd = shm_open(fullName.c_str(), O_RDWR, 0600);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    base = p;
+    bytes = (size_t)st.st_size;
+    owner = false;
+    shmName = fullName;
+    return true;
+}
+
+void SharedMemoryRegion::close() {
+    if (base) munmap(base, bytes);
+    if (owner && !shmName.empty()) shm_unlink(shmName.c_str());
+    base = nullptr;
+    bytes = 0;
+    owner = false;
+    shmName.clear();
+}
+
+#endif
+
+// ---------------------------------------------------------------- SharedFrameRing
+
+bool SharedFrameRing::create(const std::string& name, int slotCount, int maxWidth, int maxHeight, int maxElemSize) {
+    size_t headerBytes = alignUp(sizeof(RingHeader), PAGE);
+    size_t slotHeaderBytes = alignUp(sizeof(SlotHeader), 64);
+    size_t frameBytes = alignUp((size_t)maxWidth * maxHeight * maxElemSize, PAGE);
+    size_t slotStride = alignUp(slotHeaderBytes + frameBytes, PAGE);
+    size_t total = headerBytes + slotStride * slotCount;
+
+    if (!region.create(name, total)) {
+        cerr << "[Ring] Cannot create shared memory '" << name << "' (" << total / (1024 * 1024) << " MB)" << endl;
+        return false;
+    }
+
+    RingHeader* h = new (region.data()) RingHeader();
+    h->magic = RING_MAGIC;
+    h->version = RING_VERSION;
+    h->slotCount = slotCount;
+    h->maxWidth = maxWidth;
+    h->maxHeight = maxHeight;
+    h->maxElemSize = maxElemSize;
+    h->headerBytes = headerBytes;
+    h->slotStride = slotStride;
+    h->slotHeaderBytes = slotHeaderBytes;
+    h->shutdown = 0;
+    h->recipeRequest = RECIPE_IDLE;
+    for (int i = 0; i < slotCount; ++i) {
+        SlotHeader* s = new (slot(i)) SlotHeader();
+        s->state = SLOT_EMPTY;
+    }
+    // 最后才发布就绪标志，客户端看到它时布局已完整
+    h->serverReady.store(1, memory_order_release);
+    return true;
+}
+
+bool SharedFrameRing::connect(const std::string& name, int timeoutMs) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    do {
+        if (region.open(name)) {
+            RingHeader* h = header();
+            if (region.size() >= sizeof(RingHeader) && h->magic == RING_MAGIC && h->version == RING_VERSION &&
+                h->serverReady.load(memory_order_acquire) == 1) {
+                return true;
+            }
+            region.close();
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+    } while (chrono::steady_clock::now() < deadline);
+
+    cerr << "[Ring] No measurement service on '" << name << "'" << endl;
+    return false;
+}
+
+void SharedFrameRing::close() {
+    region.close();
+}
+
+SharedFrameRing::SlotHeader* SharedFrameRing::slot(uint64_t seq) const {
+    RingHeader* h = header();
+    char* base = (char*)region.data() + h->headerBytes + (seq % h->slotCount) * h->slotStride;
+    return (SlotHeader*)base;
+}
+
+cv::Mat SharedFrameRing::pixels(uint64_t seq, int width, int height, int type) const {
+    char* data = (char*)slot(seq) + header()->slotHeaderBytes;
+    return Mat(height, width, type, data);
+}
+
+size_t SharedFrameRing::maxFrameBytes() const {
+    RingHeader* h = header();
+    return (size_t)h->maxWidth * h->maxHeight * h->maxElemSize;
+}
+
+bool SharedFrameRing::waitState(uint64_t seq, uint32_t expected, int timeoutMs) const {
+    const SlotHeader* s = slot(seq);
+    auto start = chrono::steady_clock::now();
+    // 先自旋让出，再逐步退避到 1 ms 睡眠，兼顾延迟与空闲 CPU 占用
+    for (int spins = 0;; ++spins) {
+        if (s->state.load(memory_order_acquire) == expected) return true;
+        if (header()->shutdown.load(memory_order_relaxed)) return false;
+        if (spins < 1000) {
+            this_thread::yield();
+            continue;
+        }
+        if (timeoutMs >= 0 && chrono::steady_clock::now() - start > chrono::milliseconds(timeoutMs)) return false;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
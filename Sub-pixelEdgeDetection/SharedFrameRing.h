@@ -0,0 +1,97 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include "ResultLog.h"
+
+/**
+ * @class SharedMemoryRegion
+ * @brief 命名共享内存 (Windows: CreateFileMapping，其他平台: POSIX shm_open + mmap)。
+ */
+class SharedMemoryRegion {
+public:
+    SharedMemoryRegion() = default;
+    ~SharedMemoryRegion();
+    SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+    SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+
+    // 服务端：新建 (同名旧区域会被替换)
+    bool create(const std::string& name, size_t bytes);
+    // 客户端：打开已存在的区域并映射全部内容
+    bool open(const std::string& name);
+    void close();
+
+    void* data() const { return base; }
+    size_t size() const { return bytes; }
+
+private:
+    void* base = nullptr;
+    size_t bytes = 0;
+    bool owner = false;
+#ifdef _WIN32
+    void* mapping = nullptr;
+#else
+    std::string shmName;
+#endif
+};
+
+/**
+ * @class SharedFrameRing
+ * @brief 共享内存中的帧环形缓冲：采集进程写入帧，测量服务原地读取并把结果写回同一槽位。
+ *
+ * 布局：RingHeader | Slot 0 | Slot 1 | ...，每个槽位 = SlotHeader + 按页对齐的像素区。
+ * 槽位状态机：EMPTY -> WRITING (客户端) -> FILLED -> PROCESSING (服务端) -> DONE -> EMPTY (客户端取走结果)。
+ * 双方都按序号轮转槽位，状态字用 acquire/release 原子量同步，像素不经任何拷贝即可包装为 cv::Mat。
+ * 当前协议为单客户端 + 单服务端。头部或槽位布局变化时须递增 RING_VERSION，旧客户端因此无法连接。
+ */
+class SharedFrameRing {
+public:
+    enum SlotState : uint32_t { SLOT_EMPTY = 0, SLOT_WRITING, SLOT_FILLED, SLOT_PROCESSING, SLOT_DONE };
+    // 配方控制信箱：客户端写入 id 与路径后置 PENDING，服务端后台加载完成后置 LOADED / FAILED
+    enum RecipeRequestState : uint32_t { RECIPE_IDLE = 0, RECIPE_PENDING, RECIPE_LOADED, RECIPE_FAILED };
+    static constexpr int RECIPE_PATH_MAX = 512;
+
+    struct RingHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slotCount;
+        uint32_t maxWidth, maxHeight, maxElemSize;
+        uint64_t headerBytes;
+        uint64_t slotStride;          // 相邻槽位的字节间距
+        uint64_t slotHeaderBytes;     // 槽位内像素区的偏移
+        std::atomic<uint32_t> serverReady;
+        std::atomic<uint32_t> shutdown;
+        std::atomic<uint32_t> recipeRequest;   // RecipeRequestState
+        int32_t recipeRequestId;
+        char recipeRequestPath[RECIPE_PATH_MAX];   // 服务端可访问的路径，以 0 结尾
+    };
+
+    struct SlotHeader {
+        std::atomic<uint32_t> state;
+        int32_t width, height, type;
+        uint64_t step;
+        int64_t frameId;
+        int32_t recipeId;             // 该帧使用的配方计划
+        int32_t hasTruth;             // 测试客户端附带真值时为 1，服务端据此判定 PASS/WARN
+        double trueShiftX, trueShiftY;
+        ResultRecord result;
+    };
+
+    // 服务端创建 / 客户端连接 (timeoutMs 内等待服务端就绪)
+    bool create(const std::string& name, int slotCount, int maxWidth, int maxHeight, int maxElemSize = 1);
+    bool connect(const std::string& name, int timeoutMs);
+    void close();
+
+    RingHeader* header() const { return (RingHeader*)region.data(); }
+    SlotHeader* slot(uint64_t seq) const;
+    // 槽位像素区包装为 cv::Mat (零拷贝)
+    cv::Mat pixels(uint64_t seq, int width, int height, int type) const;
+    size_t maxFrameBytes() const;
+
+    // 等待槽位进入指定状态；shutdown 置位或超时 (timeoutMs < 0 表示不超时) 返回 false
+    bool waitState(uint64_t seq, uint32_t expected, int timeoutMs) const;
+
+private:
+    SharedMemoryRegion region;
+};
@@ -11,13 +11,185 @@ SubPixelModel::SubPixelModel() {}
 
 SubPixelModel::~SubPixelModel() {}
 
+namespace {
+    // ϴڵС ()ģɴƽֲ̨ڱԵ
+    const int FIT_HALF_WINDOW = 8;
+
+    // Ĳݶȷֵ ( momentMethod ͬGrad[i] Ӧλ i)طֵ±
+    int gradientPeak(const std::vector<double>& data, std::vector<double>& grads) {
+        int n = (int)data.size();
+        grads.assign(n, 0.0);
+        for (int i = 1; i < n - 1; ++i) grads[i] = std::abs(data[i + 1] - data[i - 1]) / 2.0;
+        return (int)std::distance(grads.begin(), std::max_element(grads.begin(), grads.end()));
+    }
+
+    // ϴ [start, end] center ȡΪҶԳ (ƽ̨ȳʱϽᱻ򳤵һ)
+    //  FIT_HALF_WINDOWɴʱȡֵ 10% ϵݶȿȣ profile Լش
+    double fitWindow(const std::vector<double>& data, double center, int& start, int& end) {
+        std::vector<double> grads;
+        int n = (int)data.size();
+        int peak = gradientPeak(data, grads);
+        int lo = peak, hi = peak;
+        while (lo > 1 && grads[lo - 1] > 0.1 * grads[peak]) --lo;
+        while (hi < n - 2 && grads[hi + 1] > 0.1 * grads[peak]) ++hi;
+
+        double mid = std::round(2.0 * center) / 2.0;
+        double half = std::max<double>(FIT_HALF_WINDOW, hi - lo + 1);
+        half = std::min(half, std::min(mid, n - 1 - mid));
+        start = (int)std::ceil(mid - half);
+        end = (int)std::floor(mid + half);
+        return mid;
+    }
+
+    // СͳԷ A x = b (Ԫ˹Ԫ)A Ϊ n x n ȣʱ false
+    bool solveLinear(std::vector<double> A, std::vector<double> b, int n, double* x) {
+        for (int col = 0; col < n; ++col) {
+            int pivot = col;
+            for (int r = col + 1; r < n; ++r) {
+                if (std::abs(A[r * n + col]) > std::abs(A[pivot * n + col])) pivot = r;
+            }
+            if (std::abs(A[pivot * n + col]) < 1e-12) return false;
+            if (pivot != col) {
+                for (int c = 0; c < n; ++c) std::swap(A[col * n + c], A[pivot * n + c]);
+                std::swap(b[col], b[pivot]);
+            }
+            for (int r = col + 1; r < n; ++r) {
+                double f = A[r * n + col] / A[col * n + col];
+                for (int c = col; c < n; ++c) A[r * n + c] -= f * A[col * n + c];
+                b[r] -= f * b[col];
+            }
+        }
+        for (int r = n - 1; r >= 0; --r) {
+            double s = b[r];
+            for (int c = r + 1; c < n; ++c) s -= A[r * n + c] * x[c];
+            x[r] = s / A[r * n + r];
+        }
+        return true;
+    }
+
+    // ȨС˶ʽ y = sum p[k] x^k (k < order)x Դ
+    bool fitPolynomialLS(const std::vector<double>& xs, const std::vector<double>& ys, const std::vector<double>& ws,
+        int order, double* p) {
+        std::vector<double> A(order * order, 0.0), b(order, 0.0);
+        for (size_t i = 0; i < xs.size(); ++i) {
+            double pw[8];
+            pw[0] = 1.0;
+            for (int k = 1; k < 2 * order - 1; ++k) pw[k] = pw[k - 1] * xs[i];
+            for (int r = 0; r < order; ++r) {
+                b[r] += ws[i] * ys[i] * pw[r];
+                for (int c = 0; c < order; ++c) A[r * order + c] += ws[i] * pw[r + c];
+            }
+        }
+        return solveLinear(A, b, order, p);
+    }
+
+    // ĲԵģ f(x; a, b, c, s) Բƫ
+    typedef void (*EdgeModel)(double x, const double p[4], double& f, double g[4]);
+
+    void sigmoidModel(double x, const double p[4], double& f, double g[4]) {
+        double u = std::max(-50.0, std::min(50.0, (x - p[2]) / p[3]));
+        double q = 1.0 / (1.0 + std::exp(-u));
+        double dq = q * (1.0 - q);
+        f = p[0] + p[1] * q;
+        g[0] = 1.0;
+        g[1] = q;
+        g[2] = -p[1] * dq / p[3];
+        g[3] = -p[1] * dq * u / p[3];
+    }
+
+    void arcTanModel(double x, const double p[4], double& f, double g[4]) {
+        double u = (x - p[2]) / p[3];
+        double d = 1.0 / (1.0 + u * u);
+        f = p[0] + p[1] * std::atan(u);
+        g[0] = 1.0;
+        g[1] = std::atan(u);
+        g[2] = -p[1] * d / p[3];
+        g[3] = -p[1] * d * u / p[3];
+    }
+
+    // Levenberg-Marquardt  data[start..end]p ΪֵǷЧ
+    bool fitEdgeModel(const std::vector<double>& data, int start, int end, double p[4], EdgeModel model) {
+        auto cost = [&](const double* q) {
+            double sum = 0.0, f, g[4];
+            for (int i = start; i <= end; ++i) {
+                model(i, q, f, g);
+                sum += (data[i] - f) * (data[i] - f);
+            }
+            return sum;
+            };
+
+        double lambda = 1e-3;
+        double current = cost(p);
+        for (int iter = 0; iter < 30; ++iter) {
+            std::vector<double> JtJ(16, 0.0), Jtr(4, 0.0);
+            double f, g[4];
+            for (int i = start; i <= end; ++i) {
+                model(i, p, f, g);
+                double r = data[i] - f;
+                for (int a = 0; a < 4; ++a) {
+                    Jtr[a] += g[a] * r;
+                    for (int b = 0; b < 4; ++b) JtJ[a * 4 + b] += g[a] * g[b];
+                }
+            }
+
+            bool improved = false;
+            double dp[4] = {};
+            while (lambda < 1e8) {
+                std::vector<double> A = JtJ;
+                for (int a = 0; a < 4; ++a) A[a * 4 + a] *= (1.0 + lambda);
+                double trial[4];
+                if (solveLinear(A, Jtr, 4, dp)) {
+                    for (int a = 0; a < 4; ++a) trial[a] = p[a] + dp[a];
+                    trial[3] = std::max(0.05, std::min(20.0, trial[3]));   // ɿȱΪн
+                    double c = cost(trial);
+                    if (c < current) {
+                        std::copy(trial, trial + 4, p);
+                        current = c;
+                        lambda = std::max(1e-7, lambda * 0.1);
+                        improved = true;
+                        break;
+                    }
+                }
+                lambda *= 10.0;
+            }
+            if (!improved || std::abs(dp[2]) < 1e-6) break;
+        }
+        return std::isfinite(p[2]) && p[2] >= start && p[2] <= end;
+    }
+}
+
 double SubPixelModel::calculateEdge(const std::vector<double>& profile, ModelType type) {
     if (profile.size() < 5) return -999.0;
 
-    //  type ѡʲôΪ޸ǰľ⣬ǿʹ
-    // ҵȽ "ռط (Gradient Centroid)" 
-    // Ӧле "ط"  "ķ"
-    return momentMethod(profile);
+    // ˮʹùҵȽ "ռط (Gradient Centroid)"Ӧле "ط"  "ķ"
+    // ģ͹ͶӰ߶Ա (--compare-models / --pareto)
+    // λԼһ£ i λ iԾλ k-1  k ֮ʱΪ k-0.5
+    switch (type) {
+    case Sigmoid: return fitSigmoid(profile);
+    case GrayMoment: return grayMoment(profile);
+    case SpatialMoment: return momentMethod(profile);
+    case Gaussian: return fitGaussian(profile);
+    case Polynomial: return fitPolynomial(profile);
+    case ArcTan: return fitArcTan(profile);
+    }
+    return -999.0;
+}
+
+const std::vector<SubPixelModel::ModelType>& SubPixelModel::allTypes() {
+    static const vector<ModelType> types = { Sigmoid, GrayMoment, SpatialMoment, Gaussian, Polynomial, ArcTan };
+    return types;
+}
+
+const char* SubPixelModel::typeName(ModelType type) {
+    switch (type) {
+    case Sigmoid: return "Sigmoid";
+    case GrayMoment: return "GrayMoment";
+    case SpatialMoment: return "SpatialMoment";
+    case Gaussian: return "Gaussian";
+    case Polynomial: return "Polynomial";
+    case ArcTan: return "ArcTan";
+    }
+    return "Unknown";
 }
 
 // [޸] ռط (Spatial Moment / Center of Gravity)
@@ -69,11 +241,120 @@ double SubPixelModel::momentMethod(const std::vector<double>& data) {
     return center;
 }
 
-// ɽӿڶԷ뱨ڲʹ
+// ҶȾط (Tabatabai-Mitchell)ǰ׻ҶȾرֲԾͻҶռԵλ
+double SubPixelModel::grayMoment(const std::vector<double>& data) {
+    double c0 = momentMethod(data);
+    if (c0 == -999.0) return -999.0;
+    int start, end;
+    fitWindow(data, c0, start, end);
+    int m = end - start + 1;
+    if (m < 5) return -999.0;
+
+    double m1 = 0.0, m2 = 0.0, m3 = 0.0;
+    for (int i = start; i <= end; ++i) {
+        m1 += data[i];
+        m2 += data[i] * data[i];
+        m3 += data[i] * data[i] * data[i];
+    }
+    m1 /= m; m2 /= m; m3 /= m;
+    double var = m2 - m1 * m1;
+    if (var <= 1e-9) return -999.0;
+
+    double sigma = std::sqrt(var);
+    double skew = (m3 + 2.0 * m1 * m1 * m1 - 3.0 * m1 * m2) / (sigma * sigma * sigma);
+    double pLow = 0.5 * (1.0 + skew * std::sqrt(1.0 / (4.0 + skew * skew)));
+
+    // ΪͻҶ () ʱԵڵͻҶȶ֮󣬷ڸ߻Ҷȶ֮
+    bool rising = data[end] > data[start];
+    double fraction = rising ? pLow : 1.0 - pLow;
+    return start - 0.5 + m * fraction;
+}
+
+// Sigmoid ϣf(x) = a + b / (1 + exp(-(x - c) / s))c Ϊ 50% Ҷȵ
 double SubPixelModel::fitSigmoid(const std::vector<double>& data) {
-    return momentMethod(data);
+    double c0 = momentMethod(data);
+    if (c0 == -999.0) return -999.0;
+    int start, end;
+    fitWindow(data, c0, start, end);
+    if (end - start < 4) return -999.0;
+
+    double left = (data[start] + data[start + 1]) / 2.0, right = (data[end] + data[end - 1]) / 2.0;
+    double p[4] = { left, right - left, c0, 1.0 };
+    return fitEdgeModel(data, start, end, p, sigmoidModel) ? p[2] : -999.0;
 }
 
+// ϣf(x) = a + b * atan((x - c) / s)β Sigmoid Կɴ
+double SubPixelModel::fitArcTan(const std::vector<double>& data) {
+    double c0 = momentMethod(data);
+    if (c0 == -999.0) return -999.0;
+    int start, end;
+    fitWindow(data, c0, start, end);
+    if (end - start < 4) return -999.0;
+
+    double left = (data[start] + data[start + 1]) / 2.0, right = (data[end] + data[end - 1]) / 2.0;
+    double p[4] = { (left + right) / 2.0, (right - left) / CV_PI, c0, 1.0 };
+    return fitEdgeModel(data, start, end, p, arcTanModel) ? p[2] : -999.0;
+}
+
+// ˹ϣݶȷֵ ~ ˹ ln(ݶ) ݶƽΪȨ (Caruana)㼴Ե
 double SubPixelModel::fitGaussian(const std::vector<double>& data) {
-    return momentMethod(data);
+    std::vector<double> grads;
+    int n = (int)data.size();
+    int peak = gradientPeak(data, grads);
+    double maxGrad = grads[peak];
+    if (maxGrad <= 1e-9) return -999.0;
+
+    // ֵ 10% ĵ㣬֤岢˳
+    std::vector<double> xs, ys, ws;
+    for (int i = std::max(1, peak - 4); i <= std::min(n - 2, peak + 4); ++i) {
+        if (grads[i] <= 0.1 * maxGrad) continue;
+        xs.push_back(i - peak);
+        ys.push_back(std::log(grads[i]));
+        ws.push_back(grads[i] * grads[i]);
+    }
+    double offset;
+    if (xs.size() >= 3) {
+        double p[3];
+        if (!fitPolynomialLS(xs, ys, ws, 3, p) || p[2] >= -1e-9) return -999.0;
+        offset = -p[1] / (2.0 * p[2]);
+    }
+    else {
+        // ԾֻпԵ 1~2 ݶȷ㣬˻Ϊֵڵ˹ֵ
+        // ݶȡֵ 1e-3  (Ծǡ֮ʱ޶Գƣе)
+        if (peak < 1 || peak > n - 2) return -999.0;
+        double floorGrad = 1e-3 * maxGrad;
+        double l = std::log(std::max(grads[peak - 1], floorGrad));
+        double c = std::log(maxGrad);
+        double r = std::log(std::max(grads[peak + 1], floorGrad));
+        double denom = l - 2.0 * c + r;
+        if (denom >= -1e-9) return -999.0;
+        offset = 0.5 * (l - r) / denom;
+    }
+    if (std::abs(offset) > 2.0) return -999.0;
+    return peak + offset;
+}
+
+// ʽϣڻҶζʽСˣյ x = -p2 / (3 p3) Ե
+// ĳֵ (ȡ) ΪĶԳȡ 4ƽ̨ԳʱζʽĹյᱻ򳤵һ
+double SubPixelModel::fitPolynomial(const std::vector<double>& data) {
+    double c0 = momentMethod(data);
+    if (c0 == -999.0) return -999.0;
+    int n = (int)data.size();
+    double mid = std::round(2.0 * c0) / 2.0;
+    int start = std::max(0, (int)std::ceil(mid - 4.0));
+    int end = std::min(n - 1, (int)std::floor(mid + 4.0));
+    if (end - start < 4) return -999.0;
+
+    std::vector<double> xs, ys, ws;
+    for (int i = start; i <= end; ++i) {
+        xs.push_back(i - mid);
+        ys.push_back(data[i]);
+        ws.push_back(1.0);
+    }
+    double p[4];
+    if (!fitPolynomialLS(xs, ys, ws, 4, p) || std::abs(p[3]) < 1e-12) return -999.0;
+
+    double offset = -p[2] / (3.0 * p[3]);
+    if (offset < start - mid || offset > end - mid) return -999.0;
+    return mid + offset;
 }
\ No newline at end of file
@@ -23,10 +23,17 @@ public:
     // 返回值: 亚像素边缘相对于 profile 起点的偏移量
     double calculateEdge(const std::vector<double>& profile, ModelType type);
 
+    // 全部算法类型 (按枚举顺序，均为独立实现) 与名称，供模型对比/报表使用
+    static const std::vector<ModelType>& allTypes();
+    static const char* typeName(ModelType type);
+
 private:
     // 具体算法实现 (声明)
     double fitSigmoid(const std::vector<double>& data);
     double fitGaussian(const std::vector<double>& data);
     double momentMethod(const std::vector<double>& data);
+    double grayMoment(const std::vector<double>& data);
+    double fitPolynomial(const std::vector<double>& data);
+    double fitArcTan(const std::vector<double>& data);
     // 其他模型可以在此扩展...
 };
\ No newline at end of file
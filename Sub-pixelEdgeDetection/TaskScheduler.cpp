@@ -0,0 +1,204 @@
+﻿#include "TaskScheduler.h"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace {
+    // 当前线程所属的调度器与序号 (每个线程至多属于一个调度器)
+    thread_local const TaskScheduler* currentScheduler = nullptr;
+    thread_local int currentIndex = -1;
+
+    void pinToCore(int core) {
+#ifdef _WIN32
+        SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (core % (8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)core;
+#endif
+    }
+}
+
+TaskScheduler::TaskScheduler(int count, bool pinThreads) {
+    int cores = (int)std::max(1u, thread::hardware_concurrency());
+    if (count <= 0) count = cores;
+
+    // 工作线程占满前 count 个核心后，OpenCV 的 parallel_for_ 只用剩下的核心 (不足 1 个时串行)
+    if (pinThreads) {
+        previousCvThreads = cv::getNumThreads();
+        cv::setNumThreads(std::max(1, cores - count));
+    }
+
+    for (int i = 0; i < count; ++i) workers.emplace_back(new Worker());
+    for (int i = 0; i < count; ++i) {
+        workers[i]->thread = thread(&TaskScheduler::workerLoop, this, i, pinThreads);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    waitIdle();
+    {
+        lock_guard<mutex> lock(sleepMtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers) {
+        if (w->thread.joinable()) w->thread.join();
+    }
+    if (previousCvThreads >= 0) cv::setNumThreads(previousCvThreads);
+}
+
+int TaskScheduler::currentWorker() const {
+    return (currentScheduler == this) ? currentIndex : -1;
+}
+
+void TaskScheduler::submit(Task task) {
+    push(std::move(task), nullptr);
+}
+
+void TaskScheduler::push(Task task, const void* group) {
+    int self = currentWorker();
+    int target = (self >= 0) ? self : (int)(nextQueue++ % workers.size());
+    {
+        lock_guard<mutex> lock(workers[target]->mtx);
+        workers[target]->tasks.push_back({ std::move(task), group });
+        pending++;
+    }
+    wake.notify_one();
+}
+
+bool TaskScheduler::tryPop(int self, Task& task) {
+    if (self >= 0) {
+        Worker& w = *workers[self];
+        lock_guard<mutex> lock(w.mtx);
+        if (!w.tasks.empty()) {
+            task = std::move(w.tasks.back().fn);
+            w.tasks.pop_back();
+            active++;
+            pending--;
+            return true;
+        }
+    }
+
+    int n = (int)workers.size();
+    for (int k = 1; k <= n; ++k) {
+        int victim = (std::max(self, 0) + k) % n;
+        if (victim == self) continue;
+        Worker& w = *workers[victim];
+        lock_guard<mutex> lock(w.mtx);
+        if (!w.tasks.empty()) {
+            task = std::move(w.tasks.front().fn);
+            w.tasks.pop_front();
+            active++;
+            pending--;
+            if (self >= 0) stealCount++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::tryPopGroup(int self, const void* group, Task& task) {
+    // 组内子任务由本线程 (或同组的提交者) 刚压入，通常在某个队列的尾部附近，从尾部往前找
+    int n = (int)workers.size();
+    for (int k = 0; k < n; ++k) {
+        int victim = (std::max(self, 0) + k) % n;
+        Worker& w = *workers[victim];
+        lock_guard<mutex> lock(w.mtx);
+        for (auto it = w.tasks.rbegin(); it != w.tasks.rend(); ++it) {
+            if (it->group != group) continue;
+            task = std::move(it->fn);
+            w.tasks.erase(std::next(it).base());
+            active++;
+            pending--;
+            if (victim != self && self >= 0) stealCount++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::execute(Task& task) {
+    task();
+    task = nullptr;
+    executedCount++;
+    if (--active == 0 && pending.load() == 0) {
+        lock_guard<mutex> lock(sleepMtx);
+        idle.notify_all();
+    }
+}
+
+void TaskScheduler::workerLoop(int index, bool pin) {
+    currentScheduler = this;
+    currentIndex = index;
+    if (pin) pinToCore(index);
+
+    Task task;
+    for (;;) {
+        if (tryPop(index, task)) {
+            execute(task);
+            continue;
+        }
+        unique_lock<mutex> lock(sleepMtx);
+        if (stopping && pending.load() == 0) break;
+        // 带超时等待：提交与入睡之间的通知丢失时最多延迟 1 ms
+        wake.wait_for(lock, chrono::milliseconds(1), [&] { return pending.load() > 0 || stopping; });
+    }
+}
+
+void TaskScheduler::runAndWait(std::vector<Task>& tasks) {
+    if (tasks.empty()) return;
+
+    // 组状态放在本次调用栈上，其地址即组标识。计数在锁内递减并通知：
+    // 等待方只有在锁内看到 0 才返回，此后不会再有子任务触碰这块栈内存
+    struct JoinGroup {
+        mutex mtx;
+        condition_variable done;
+        size_t remaining;
+    } join;
+    join.remaining = tasks.size();
+    auto finish = [&join] {
+        lock_guard<mutex> lock(join.mtx);
+        if (--join.remaining == 0) join.done.notify_all();
+        };
+
+    const void* group = &join;
+    for (size_t i = 1; i < tasks.size(); ++i) {
+        push([&tasks, &finish, i] {
+            tasks[i]();
+            finish();
+        }, group);
+    }
+    tasks[0]();
+    finish();
+
+    // 等待期间只帮忙执行本组尚未被取走的子任务 (接手其他帧的整帧任务会让本帧的完成时间再加上一整帧)。
+    // 取不到时其余子任务都已在其他线程上执行，之后也不会再有本组任务入队，直接睡到计数归零，不占用 (可能已绑定的) 核心
+    int self = currentWorker();
+    Task task;
+    while (tryPopGroup(self, group, task)) execute(task);
+    unique_lock<mutex> lock(join.mtx);
+    join.done.wait(lock, [&] { return join.remaining == 0; });
+}
+
+void TaskScheduler::waitIdle() {
+    unique_lock<mutex> lock(sleepMtx);
+    while (pending.load() > 0 || active.load() > 0) {
+        idle.wait_for(lock, chrono::milliseconds(1));
+    }
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+/**
+ * @class TaskScheduler
+ * @brief 工作窃取线程池：每个工作线程一个双端队列，自己从尾部取 (LIFO，刚拆出的子任务仍在缓存中)，
+ *        空闲时从其他线程队列的头部窃取 (FIFO，偷走最早、通常也最大的任务)。
+ *
+ * 工作线程内提交的任务进入本线程队列，外部线程提交的任务轮流分给各线程。
+ * runAndWait 为 fork-join：调用方 (可以是工作线程) 在等待期间只执行同一组的子任务，嵌套拆分不会死锁，
+ * 也不会在等待时接手其他帧的整帧任务而拖长本组的完成时间；组内已无可取的任务时在条件变量上休眠，不空转。
+ * pinThreads 时工作线程 i 绑定到核心 i，并把 OpenCV 内部线程数限制为剩余核心，避免两套线程池争抢 (析构时恢复)。
+ */
+class TaskScheduler {
+public:
+    using Task = std::function<void()>;
+
+    // workers: 工作线程数 (0 = 全部核心)
+    explicit TaskScheduler(int workers = 0, bool pinThreads = false);
+    ~TaskScheduler();   // 执行完已提交的任务后退出，并恢复 OpenCV 线程数
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    void submit(Task task);
+
+    // 执行一组任务并等待全部完成 (tasks[0] 由调用线程直接执行)
+    void runAndWait(std::vector<Task>& tasks);
+
+    // 等待队列清空且没有正在执行的任务
+    void waitIdle();
+
+    int workerCount() const { return (int)workers.size(); }
+    // 调用线程在本调度器中的序号，非本调度器的工作线程返回 -1
+    int currentWorker() const;
+
+    size_t queueDepth() const { return pending.load(std::memory_order_relaxed); }   // 已提交未开始的任务数
+    uint64_t steals() const { return stealCount.load(std::memory_order_relaxed); }
+    uint64_t executed() const { return executedCount.load(std::memory_order_relaxed); }
+
+private:
+    // group 非空时为 runAndWait 的子任务，标识所属的 fork-join 组
+    struct Job {
+        Task fn;
+        const void* group;
+    };
+
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Job> tasks;
+        std::thread thread;
+    };
+
+    void push(Task task, const void* group);
+    // 先取自己队列的尾部，再按序窃取其他队列的头部；取到时 active 已加一
+    bool tryPop(int self, Task& task);
+    // 只取属于 group 的任务 (runAndWait 等待期间)
+    bool tryPopGroup(int self, const void* group, Task& task);
+    void execute(Task& task);
+    void workerLoop(int index, bool pin);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> pending{ 0 };
+    std::atomic<int> active{ 0 };
+    std::atomic<uint64_t> stealCount{ 0 }, executedCount{ 0 };
+    std::atomic<unsigned> nextQueue{ 0 };
+    std::atomic<bool> stopping{ false };
+    int previousCvThreads = -1;   // pinThreads 时构造前的 cv::getNumThreads()
+    std::mutex sleepMtx;
+    std::condition_variable wake, idle;
+};
@@ -1,8 +1,10 @@
 #include "Utilities.h"
+#include <opencv2/core/hal/intrin.hpp>
 #include <numeric>
 #include <algorithm>
 #include <vector>
 #include <cmath>
+#include <climits>
 
 // --- GradientUtils ʵ ---
 
@@ -15,136 +17,339 @@ cv::Mat GradientUtils::applySobel(const cv::Mat& input, int dx, int dy, int ksiz
 
 // --- Utilities ʵ ---
 
-std::vector<double> Utilities::calculateRMSGradient(const cv::Mat& gradImg, int direction) {
-    CV_Assert(gradImg.type() == CV_16S); //  16 λзݶͼ
+namespace {
+    // СͼֱӴУ̵߳ȿ㱾
+    const int RMS_MIN_PARALLEL_PIXELS = 256 * 256;
+    const int RMS_MIN_STRIPE_ROWS = 32;
 
-    if (direction == 0) { // X  ()
-        int cols = gradImg.cols;
-        int rows = gradImg.rows;
-        std::vector<double> rms_gradient_x(cols);
+    // һ int16 ݶȵƽԪۼӵۼ (ȡô)
+    // ƽ double ۼӣ 2^30 < 2^23 ʱȷ
+    inline void accumulateSquaresRow(const short* p, double* acc, int n) {
+        int j = 0;
+#if CV_SIMD128_64F
+        for (; j <= n - 8; j += 8) {
+            cv::v_int32x4 lo, hi;
+            cv::v_int16x8 v = cv::v_load(p + j);
+            cv::v_mul_expand(v, v, lo, hi);
+            cv::v_store(acc + j, cv::v_add(cv::v_load(acc + j), cv::v_cvt_f64(lo)));
+            cv::v_store(acc + j + 2, cv::v_add(cv::v_load(acc + j + 2), cv::v_cvt_f64_high(lo)));
+            cv::v_store(acc + j + 4, cv::v_add(cv::v_load(acc + j + 4), cv::v_cvt_f64(hi)));
+            cv::v_store(acc + j + 6, cv::v_add(cv::v_load(acc + j + 6), cv::v_cvt_f64_high(hi)));
+        }
+#endif
+        for (; j < n; ++j) acc[j] += (double)p[j] * p[j];
+    }
 
-        for (int j = 0; j < cols; ++j) {
-            double sum_sq = 0.0;
-            for (int i = 0; i < rows; ++i) {
-                double val = static_cast<double>(gradImg.at<short>(i, j));
-                sum_sq += val * val;
-            }
-            rms_gradient_x[j] = std::sqrt(sum_sq / rows);
+    // һ int16 ݶȵƽ
+    inline double sumSquaresRow(const short* p, int n) {
+        int j = 0;
+        double sum = 0.0;
+#if CV_SIMD128_64F
+        // ƽ (v_mul_expand 32768^2 = 2^30 int32)תΪ double ۼӣ
+        //  v_dotprodSobel ͵ -32768 ʱ֮Ϊ 2^31 int32
+        cv::v_float64x2 s0 = cv::v_setzero_f64(), s1 = cv::v_setzero_f64();
+        for (; j <= n - 8; j += 8) {
+            cv::v_int32x4 lo, hi;
+            cv::v_int16x8 v = cv::v_load(p + j);
+            cv::v_mul_expand(v, v, lo, hi);
+            s0 = cv::v_add(s0, cv::v_add(cv::v_cvt_f64(lo), cv::v_cvt_f64_high(lo)));
+            s1 = cv::v_add(s1, cv::v_add(cv::v_cvt_f64(hi), cv::v_cvt_f64_high(hi)));
         }
-        return rms_gradient_x;
+        double buf[2];
+        cv::v_store(buf, cv::v_add(s0, s1));
+        sum = buf[0] + buf[1];
+#endif
+        for (; j < n; ++j) sum += (double)p[j] * p[j];
+        return sum;
     }
-    else { // Y  ()
-        int cols = gradImg.cols;
-        int rows = gradImg.rows;
-        std::vector<double> rms_gradient_y(rows);
-
-        for (int i = 0; i < rows; ++i) {
-            double sum_sq = 0.0;
-            for (int j = 0; j < cols; ++j) {
-                double val = static_cast<double>(gradImg.at<short>(i, j));
-                sum_sq += val * val;
-            }
-            rms_gradient_y[i] = std::sqrt(sum_sq / cols);
+
+    // һ 8 λҶԪۼӵۼ (uint32  1600 )
+    inline void accumulateRow(const uchar* p, unsigned* acc, int n) {
+        int j = 0;
+#if CV_SIMD128
+        for (; j <= n - 16; j += 16) {
+            cv::v_uint16x8 w0, w1;
+            cv::v_uint32x4 d0, d1, d2, d3;
+            cv::v_expand(cv::v_load(p + j), w0, w1);
+            cv::v_expand(w0, d0, d1);
+            cv::v_expand(w1, d2, d3);
+            cv::v_store(acc + j, cv::v_add(cv::v_load(acc + j), d0));
+            cv::v_store(acc + j + 4, cv::v_add(cv::v_load(acc + j + 4), d1));
+            cv::v_store(acc + j + 8, cv::v_add(cv::v_load(acc + j + 8), d2));
+            cv::v_store(acc + j + 12, cv::v_add(cv::v_load(acc + j + 12), d3));
+        }
+#endif
+        for (; j < n; ++j) acc[j] += p[j];
+    }
+
+    // һ 16 λҶԪۼ (uint32  65537 )
+    inline void accumulateRow(const ushort* p, unsigned* acc, int n) {
+        int j = 0;
+#if CV_SIMD128
+        for (; j <= n - 8; j += 8) {
+            cv::v_uint32x4 d0, d1;
+            cv::v_expand(cv::v_load(p + j), d0, d1);
+            cv::v_store(acc + j, cv::v_add(cv::v_load(acc + j), d0));
+            cv::v_store(acc + j + 4, cv::v_add(cv::v_load(acc + j + 4), d1));
+        }
+#endif
+        for (; j < n; ++j) acc[j] += p[j];
+    }
+
+    // һ 16 λҶ֮ ( double ۼӣп)
+    inline double sumRow(const ushort* p, int n) {
+        int j = 0;
+        double sum = 0.0;
+#if CV_SIMD128
+        // ÿ 8 Ԫ uint32  ( 8 * 65535)ת double
+        for (; j <= n - 8; j += 8) {
+            cv::v_uint32x4 d0, d1;
+            cv::v_expand(cv::v_load(p + j), d0, d1);
+            sum += cv::v_reduce_sum(cv::v_add(d0, d1));
         }
-        return rms_gradient_y;
+#endif
+        for (; j < n; ++j) sum += p[j];
+        return sum;
+    }
+
+    // һ 8 λҶ֮
+    inline double sumRow(const uchar* p, int n) {
+        int j = 0;
+        unsigned sum = 0;
+#if CV_SIMD128
+        cv::v_uint32x4 s = cv::v_setzero_u32();
+        for (; j <= n - 16; j += 16) {
+            cv::v_uint16x8 w0, w1;
+            cv::v_uint32x4 d0, d1, d2, d3;
+            cv::v_expand(cv::v_load(p + j), w0, w1);
+            cv::v_expand(w0, d0, d1);
+            cv::v_expand(w1, d2, d3);
+            s = cv::v_add(s, cv::v_add(cv::v_add(d0, d1), cv::v_add(d2, d3)));
+        }
+        sum = cv::v_reduce_sum(s);
+#endif
+        for (; j < n; ++j) sum += p[j];
+        return (double)sum;
+    }
+
+    // зп黮ÿдԼĲֺͣ˳鲢 (̵߳޹)
+    int stripeCount(const cv::Mat& img, bool parallel) {
+        if (!parallel || (size_t)img.rows * img.cols < (size_t)RMS_MIN_PARALLEL_PIXELS) return 1;
+        return std::max(1, std::min(cv::getNumThreads(), img.rows / RMS_MIN_STRIPE_ROWS));
     }
 }
 
-std::vector<double> Utilities::calculateRMSGray(const cv::Mat& grayImg, int direction) {
-    CV_Assert(grayImg.type() == CV_8UC1); //  8 λҶͼ
+void Utilities::calculateRMSGradient(const cv::Mat& gradImg, int direction, std::vector<double>& out, bool parallel) {
+    CV_Assert(gradImg.type() == CV_16S); //  16 λзݶͼ
 
-    if (direction == 0) { // X  ()
-        int cols = grayImg.cols;
-        int rows = grayImg.rows;
-        std::vector<double> rms_gray_x(cols);
+    const int rows = gradImg.rows;
+    const int cols = gradImg.cols;
+    const int stripes = stripeCount(gradImg, parallel);
 
-        for (int j = 0; j < cols; ++j) {
-            double sum = 0.0;
-            for (int i = 0; i < rows; ++i) {
-                sum += static_cast<double>(grayImg.at<uchar>(i, j));
+    if (direction == 0) { // X  ()ʽȡۼӵƽ
+        out.assign(cols, 0.0);
+        if (stripes == 1) {
+            for (int i = 0; i < rows; ++i) accumulateSquaresRow(gradImg.ptr<short>(i), out.data(), cols);
+        }
+        else {
+            std::vector<double> partial((size_t)stripes * cols, 0.0);
+            cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+                for (int s = range.start; s < range.end; ++s) {
+                    double* acc = partial.data() + (size_t)s * cols;
+                    for (int i = rows * s / stripes; i < rows * (s + 1) / stripes; ++i)
+                        accumulateSquaresRow(gradImg.ptr<short>(i), acc, cols);
+                }
+                });
+            for (int s = 0; s < stripes; ++s) {
+                const double* acc = partial.data() + (size_t)s * cols;
+                for (int j = 0; j < cols; ++j) out[j] += acc[j];
             }
-            rms_gray_x[j] = sum / rows; // ע⣺"RMS Ҷ"ƺָƽҶ
         }
-        return rms_gray_x;
+        for (int j = 0; j < cols; ++j) out[j] = std::sqrt(out[j] / rows);
     }
     else { // Y  ()
-        int cols = grayImg.cols;
-        int rows = grayImg.rows;
-        std::vector<double> rms_gray_y(rows);
-
-        for (int i = 0; i < rows; ++i) {
-            double sum = 0.0;
-            for (int j = 0; j < cols; ++j) {
-                sum += static_cast<double>(grayImg.at<uchar>(i, j));
-            }
-            rms_gray_y[i] = sum / cols;
+        out.resize(rows);
+        auto body = [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; ++i)
+                out[i] = std::sqrt(sumSquaresRow(gradImg.ptr<short>(i), cols) / cols);
+            };
+        if (stripes == 1) body(cv::Range(0, rows));
+        else cv::parallel_for_(cv::Range(0, rows), body, stripes);
+    }
+}
+
+int Utilities::observedBits(const cv::Mat& image, int previous) {
+    int bits = 8;
+    if (image.depth() == CV_16U && image.channels() == 1) {
+        // ÿ 8 ȡһ (4096x3000 ֡Լ 1.5M )Ƭ֣©
+        ushort maxVal = 0;
+        for (int y = 0; y < image.rows; y += 8) {
+            const ushort* row = image.ptr<ushort>(y);
+            for (int x = 0; x < image.cols; ++x) maxVal = std::max(maxVal, row[x]);
         }
-        return rms_gray_y;
+        while (bits < 16 && ((1 << bits) - 1) < maxVal) bits++;
     }
+    return std::max(bits, previous);
+}
+
+std::vector<double> Utilities::calculateRMSGradient(const cv::Mat& gradImg, int direction) {
+    std::vector<double> rms_gradient;
+    calculateRMSGradient(gradImg, direction, rms_gradient);
+    return rms_gradient;
 }
 
+namespace {
+    template <typename T>
+    void rmsGray(const cv::Mat& grayImg, int direction, std::vector<double>& out, bool parallel) {
+        const int rows = grayImg.rows;
+        const int cols = grayImg.cols;
+        const int stripes = stripeCount(grayImg, parallel);
 
-// --- ˹Ƥ (Prompt 6.3) ---
+        if (direction == 0) { // X  ()
+            std::vector<unsigned> partial((size_t)stripes * cols, 0u);
+            auto body = [&](const cv::Range& range) {
+                for (int s = range.start; s < range.end; ++s) {
+                    unsigned* acc = partial.data() + (size_t)s * cols;
+                    for (int i = rows * s / stripes; i < rows * (s + 1) / stripes; ++i)
+                        accumulateRow(grayImg.ptr<T>(i), acc, cols);
+                }
+                };
+            if (stripes == 1) body(cv::Range(0, 1));
+            else cv::parallel_for_(cv::Range(0, stripes), body);
 
-// ṹ壬ͻȡԭʼ
-struct RankedItem {
-    double value;
-    int index;
-    int rank;
-};
+            out.assign(cols, 0.0);
+            for (int s = 0; s < stripes; ++s) {
+                const unsigned* acc = partial.data() + (size_t)s * cols;
+                for (int j = 0; j < cols; ++j) out[j] += acc[j];
+            }
+            for (int j = 0; j < cols; ++j) out[j] /= rows; // ע⣺е"RMS Ҷ"ƺָƽҶ
+        }
+        else { // Y  ()
+            out.resize(rows);
+            auto body = [&](const cv::Range& range) {
+                for (int i = range.start; i < range.end; ++i)
+                    out[i] = sumRow(grayImg.ptr<T>(i), cols) / cols;
+                };
+            if (stripes == 1) body(cv::Range(0, rows));
+            else cv::parallel_for_(cv::Range(0, rows), body, stripes);
+        }
+    }
+}
 
-// ȽϺ
-bool compareByValue(const RankedItem& a, const RankedItem& b) {
-    return a.value < b.value;
+void Utilities::calculateRMSGray(const cv::Mat& grayImg, int direction, std::vector<double>& out, bool parallel) {
+    //  8 λ 16 λҶͼλֱػ (ת)
+    CV_Assert(grayImg.type() == CV_8UC1 || grayImg.type() == CV_16UC1);
+    if (grayImg.depth() == CV_8U) rmsGray<uchar>(grayImg, direction, out, parallel);
+    else rmsGray<ushort>(grayImg, direction, out, parallel);
 }
 
-bool compareByIndex(const RankedItem& a, const RankedItem& b) {
-    return a.index < b.index;
+std::vector<double> Utilities::calculateRMSGray(const cv::Mat& grayImg, int direction) {
+    std::vector<double> rms_gray;
+    calculateRMSGray(grayImg, direction, rms_gray);
+    return rms_gray;
 }
 
-// ȡȼ
-std::vector<double> getRanks(const std::vector<double>& v) {
-    std::vector<RankedItem> items(v.size());
-    for (size_t i = 0; i < v.size(); ++i) {
-        items[i] = { v[i], static_cast<int>(i), 0 };
+
+// --- ˹Ƥ (Prompt 6.3) ---
+
+void SpearmanCorrelator::rank(const std::vector<double>& v, std::vector<double>& ranks) {
+    const int n = static_cast<int>(v.size());
+    ranks.resize(n);
+    if (n == 0) return;
+
+    auto mm = std::minmax_element(v.begin(), v.end());
+    double lo = *mm.first, hi = *mm.second;
+
+    // 1.  ( 8/16 λҶͶӰ)O(n + ֵ)
+    // ֵ int Χ (ʱת int ΪδΪ)±һȡ lo ƫ
+    bool quantized = (hi - lo) <= std::max(4.0 * n, 256.0) && (hi - lo) < 65536.0 &&
+        lo >= (double)INT_MIN && hi <= (double)INT_MAX;
+    for (int i = 0; quantized && i < n; ++i) quantized = (v[i] == std::floor(v[i]));
+
+    if (quantized) {
+        counts.assign(static_cast<int>(hi - lo) + 2, 0);
+        for (int i = 0; i < n; ++i) counts[static_cast<int>(v[i] - lo) + 1]++;
+
+        // counts[k] ΪСڵ k ֵԪظֵȡƽ start + (cnt + 1) / 2
+        for (size_t k = 1; k < counts.size(); ++k) counts[k] += counts[k - 1];
+        for (int i = 0; i < n; ++i) {
+            int k = static_cast<int>(v[i] - lo);
+            int before = counts[k];
+            int cnt = counts[k + 1] - before;
+            ranks[i] = before + (cnt + 1) * 0.5;
+        }
+        return;
     }
 
-    // ֵ
-    std::sort(items.begin(), items.end(), compareByValue);
+    // 2. һݣ򣬰жηƽ
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return v[a] < v[b]; });
 
-    // ȼ
-    for (size_t i = 0; i < items.size(); ++i) {
-        items[i].rank = static_cast<int>(i) + 1;
+    for (int i = 0; i < n;) {
+        int j = i + 1;
+        while (j < n && v[order[j]] == v[order[i]]) ++j;
+        double avgRank = (i + 1 + j) * 0.5; //  i+1 .. j ƽ
+        for (int k = i; k < j; ++k) ranks[order[k]] = avgRank;
+        i = j;
     }
+}
 
-    // ԭʼ
-    std::sort(items.begin(), items.end(), compareByIndex);
+double SpearmanCorrelator::correlateRanks(const std::vector<double>& centeredRef, double refSumSq, const std::vector<double>& ranks) {
+    // ƽȵľֵΪ (n+1)/2Ƥѷأ޲ʱĹʽ 3.23 ȫȼ
+    const size_t n = ranks.size();
+    const double mean = (n + 1) * 0.5;
+    double sxy = 0.0, syy = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double d = ranks[i] - mean;
+        sxy += centeredRef[i] * d;
+        syy += d * d;
+    }
+    if (refSumSq <= 0.0 || syy <= 0.0) return 0.0; // У޶
+    return sxy / std::sqrt(refSumSq * syy);
+}
 
-    std::vector<double> ranks(v.size());
-    for (size_t i = 0; i < v.size(); ++i) {
-        ranks[i] = static_cast<double>(items[i].rank);
+double SpearmanCorrelator::centerRanks(std::vector<double>& ranks) {
+    const double mean = (ranks.size() + 1) * 0.5;
+    double sumSq = 0.0;
+    for (double& r : ranks) {
+        r -= mean;
+        sumSq += r * r;
     }
-    return ranks;
+    return sumSq;
 }
 
-double Utilities::calculateSpearman(const std::vector<double>& v1, const std::vector<double>& v2) {
+double SpearmanCorrelator::correlate(const std::vector<double>& v1, const std::vector<double>& v2) {
     if (v1.size() != v2.size() || v1.empty()) {
         return 0.0;
     }
 
-    std::vector<double> ranks_v1 = getRanks(v1);
-    std::vector<double> ranks_v2 = getRanks(v2);
+    rank(v1, ranksRef);
+    double refSumSq = centerRanks(ranksRef);
+    rank(v2, ranksCand);
+    return correlateRanks(ranksRef, refSumSq, ranksCand);
+}
 
-    size_t n = v1.size();
-    double sum_d_sq = 0.0;
+void SpearmanCorrelator::correlateBatch(const std::vector<double>& reference,
+    const std::vector<std::vector<double>>& candidates, std::vector<double>& out) {
+    out.assign(candidates.size(), 0.0);
+    if (reference.empty()) return;
 
-    for (size_t i = 0; i < n; ++i) {
-        double d = ranks_v1[i] - ranks_v2[i];
-        sum_d_sq += d * d;
+    // οߵֻһ
+    rank(reference, ranksRef);
+    double refSumSq = centerRanks(ranksRef);
+
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        if (candidates[c].size() != reference.size()) continue;
+        rank(candidates[c], ranksCand);
+        out[c] = correlateRanks(ranksRef, refSumSq, ranksCand);
     }
+}
 
-    // Ĺʽ 3.23
-    return 1.0 - (6.0 * sum_d_sq) / (static_cast<double>(n) * (n * n - 1.0));
+double Utilities::calculateSpearman(const std::vector<double>& v1, const std::vector<double>& v2) {
+    // ÿ̸߳һݴ滺
+    thread_local SpearmanCorrelator correlator;
+    return correlator.correlate(v1, v2);
 }
 
 std::vector<int> Utilities::findPeaks(const std::vector<double>& data, int minPeakDistance) {
@@ -38,14 +38,29 @@ public:
      */
     static std::vector<double> calculateRMSGradient(const cv::Mat& gradImg, int direction);
 
+    /**
+     * @brief calculateRMSGradient Ԥ汾ʽȡ ()  SIMD ۼӣ
+     *        ͼп鲢С
+     * @param out [] 㹻ʱ·䡣
+     * @param parallel Ƿп鲢 (Сͼʼմ)
+     */
+    static void calculateRMSGradient(const cv::Mat& gradImg, int direction, std::vector<double>& out, bool parallel = true);
+
     /**
      * @brief  RMS Ҷ (ģ, ͼ 4.2)
-     * @param grayImg Ҷͼ
+     * @param grayImg Ҷͼ (CV_8UC1  CV_16UC112/16 λת 8 λ)
      * @param direction 0 ʾ X  ()1 ʾ Y  ()
      * @return std::vector<double>  RMS Ҷֵһά
      */
     static std::vector<double> calculateRMSGray(const cv::Mat& grayImg, int direction);
 
+    /**
+     * @brief calculateRMSGray Ԥ汾 (ȡSIMDɰп鲢)
+     * @param out [] 㹻ʱ·䡣
+     * @param parallel Ƿп鲢 (Сͼʼմ)
+     */
+    static void calculateRMSGray(const cv::Mat& grayImg, int direction, std::vector<double>& out, bool parallel = true);
+
     /**
      * @brief ˹Ƥϵ (Prompt 6.3,  3.3.3 )
      * @param v1 1
@@ -61,4 +76,55 @@ public:
      * @return std::vector<int> ֵλõ
      */
     static std::vector<int> findPeaks(const std::vector<double>& data, int minPeakDistance = 10);
+
+    /**
+     * @brief ֡ʵҶƶЧλ (λδ֪ʱʹã 12 λݴ CV_16U )
+     *        ȡֵСλ ( 2^bits - 1)гԿƿ
+     * @param image ͨͼ (CV_8U  8)
+     * @param previous ֮ǰ۲쵽λȡ߽ϴߣʹƶ֡֡䡣
+     * @return int λ [8, 16]
+     */
+    static int observedBits(const cv::Mat& image, int previous = 0);
+};
+
+/**
+ * @class SpearmanCorrelator
+ * @brief ˹Ƥ棺ֵȡƽȣݴ滺øá
+ *
+ * һõ (O(n log n))ͶӰ (ҶȾֵ) ü (O(n + ֵ))
+ * ̰߳ȫÿ߳ʹøԵʵ
+ */
+class SpearmanCorrelator {
+public:
+    /**
+     * @brief ƽ (ȴ 1 ʼֵȡȵƽ)
+     * @param v 
+     * @param ranks []  v ȳ
+     */
+    void rank(const std::vector<double>& v, std::vector<double>& ranks);
+
+    /**
+     * @brief ˹Ƥϵ (ƽƤѷ)
+     * @return double ϵ, Χ [-1.0, 1.0]Ȳһ¡ΪջΪʱ 0
+     */
+    double correlate(const std::vector<double>& v1, const std::vector<double>& v2);
+
+    /**
+     * @brief һο߶ԶѡأοߵֻһΡ
+     * @param reference οߡ
+     * @param candidates ѡ (οһµļΪ 0)
+     * @param out []  candidates һһӦϵ
+     */
+    void correlateBatch(const std::vector<double>& reference,
+        const std::vector<std::vector<double>>& candidates, std::vector<double>& out);
+
+private:
+    std::vector<int> order;         // 򻺳
+    std::vector<int> counts;        // 򻺳
+    std::vector<double> ranksRef;   // οߵ (ȥֵ) 
+    std::vector<double> ranksCand;  // ѡߵ
+
+    // ԭؼȥȾֵ (n+1)/2ƽ
+    static double centerRanks(std::vector<double>& ranks);
+    static double correlateRanks(const std::vector<double>& centeredRef, double refSumSq, const std::vector<double>& ranks);
 };
@@ -16,7 +16,40 @@ namespace WaferConfig {
     // λ
     const int ROI_SEARCH_LEN = 60;   // 򳤶 (ֱڱԵ)
     const int ROI_SEARCH_WID = 20;   //  (ƽڱԵ)
+    const int PROJECTION_MARGIN = 10; // ͼԲڵ (/ ROI ضͼ)
+    const int ROI_SUB_STRIPS = 4;    // ÿرԵзֵ (/)
+    const double STRIP_TRIM_RATIO = 0.25; // λýβֵĵβ
+    const int ROTATION_PROBE_SPAN = 50; // תƣÿ̽ⴰԱеľ
+    const int ROI_MIN_SEARCH_LEN = 32; // Ӧڳ (׿ƫ + ط 5 px ִ + ģ)
+    const double COARSE_UNCERTAINTY_SIGMAS = 3.0; // Ӧڰֶλȷȵļ
+
+    // ֶλ (YOLO ѡ -> ģƥ)
+    const int CASCADE_YOLO_INPUT = 320;     // ģʽµ YOLO ߳
+    const int CASCADE_SEARCH_PAD = 24;      // ѡޣģƥ ģ + 2*PAD ڽ
+    const int CASCADE_MAX_CANDIDATES = 3;   // ֤ĺѡ (Ŷ)
+    const double CASCADE_BOX_ERROR_NET_PX = 2.0; // ѡؼƣPAD ٸǸ x ű
+    const int CASCADE_WIDEN_STEPS = 2;      // ֵ߽ʱԷֵΪġPAD ӱƥĴþ˻ȫͼ
+
+    // ϡģ (SSDAֻģԵۼǰżλ)
+    const int SPARSE_MATCH_POINTS = 1024;   // ۼӵģ (˳)
+    const double SPARSE_EDGE_FRACTION = 0.25; // ݶȷֵֵĸñΪԵ
+    const int SPARSE_VERIFY_PAD = 2;        // ʤλ PAD  TM_CCOEFF_NORMED ˲
+
+    // ֿ YOLO  (ͼߴп飬)
+    const int YOLO_TILE_MARGIN = 32;        // ڿص = ǳߴ (䷽ waferSize) +  ()һǱĳһ
+    const int YOLO_TILE_BATCH = 8;          // ÿǰĿ ( blob ڴ: 8 * 3 * 640^2 * 4 B ~= 39 MB)
+    const int YOLO_MAX_TILES = 48;          // ֡ޣʹ ( 400 px  / 640 鲽 2084096x3000 Լ 234 ) ʱ
+                                            // ˻ͼ letterbox ŵĵǰ򣬳ɱн
 
     // Եжֵ (ֹԴڱ)
     const double EDGE_GRADIENT_THRESHOLD = 5.0;
+
+    // ſ (λ֮ǰĿԤ죬ϸֱ֡Ӿܾ)
+    const double GATE_MIN_MATCH_SCORE = 0.5;   // ֶλ÷ (ģ TM_CCOEFF_NORMED / YOLO Ŷ)
+    const double GATE_MAX_SATURATION = 0.05;   // ڱر
+    const double GATE_MIN_SNR = 4.0;           // ߶Աȶ / ׼ 
+    const int GATE_MAX_CLIPPED_WINDOWS = 0;    // Խͼ (ü) Ĳ OUT_OF_VIEW8 = δſʱһֻüܾ
+
+    // ֤׼X/Y СڸֵΪ PASS ()
+    const double PASS_TOLERANCE = 0.05;
 }
\ No newline at end of file
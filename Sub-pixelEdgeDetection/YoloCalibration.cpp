@@ -0,0 +1,181 @@
+﻿#include "YoloCalibration.h"
+#include "DatasetGenerator.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+    // YOLO 标签行 (class cx cy w h，归一化) -> 像素框
+    Rect parseLabel(const string& label, Size imageSize) {
+        istringstream ss(label);
+        int cls;
+        double cx, cy, w, h;
+        if (!(ss >> cls >> cx >> cy >> w >> h)) return Rect();
+        return Rect((int)std::round((cx - w / 2) * imageSize.width), (int)std::round((cy - h / 2) * imageSize.height),
+            (int)std::round(w * imageSize.width), (int)std::round(h * imageSize.height));
+    }
+
+    double iou(const Rect& a, const Rect& b) {
+        double inter = (a & b).area();
+        double uni = a.area() + b.area() - inter;
+        return uni > 0 ? inter / uni : 0.0;
+    }
+
+    void printScore(ostream& os, const string& name, const DetectorScore& s) {
+        os << fixed << setprecision(3)
+            << "[" << name << "] recall " << s.recall() << " (" << s.hits << "/" << s.frames << ")"
+            << ", mean IoU " << s.meanIoU
+            << ", center error mean/max " << s.meanCenterError << " / " << s.maxCenterError << " px"
+            << ", latency mean/p95 " << setprecision(2) << s.meanMs << " / " << s.p95Ms << " ms" << endl;
+    }
+}
+
+std::vector<cv::Mat> YoloCalibration::simulatedImages(const CalibrationConfig& cfg, int first, int count,
+    std::vector<cv::Rect>* labels) {
+    DatasetConfig dc;
+    dc.imageSize = cfg.imageSize;
+    dc.seed = cfg.seed;
+    DatasetGenerator generator(dc);
+    ImageSimulator simulator;
+
+    vector<Mat> images;
+    if (labels) labels->clear();
+    for (int i = first; i < first + count; ++i) {
+        string label;
+        images.push_back(generator.renderSample(i, simulator, label));
+        if (labels) labels->push_back(parseLabel(label, images.back().size()));
+    }
+    return images;
+}
+
+DetectorScore YoloCalibration::evaluate(YoloDetector& detector, const std::vector<cv::Mat>& images,
+    const std::vector<cv::Rect>& labels) {
+    DetectorScore s;
+    vector<double> times;
+    double iouSum = 0.0, centerSum = 0.0;
+
+    // 预热一次 (首次推理含内存分配与层初始化)，之后每张只计时一次前向
+    if (!images.empty()) detector.detect(images[0]);
+    for (size_t i = 0; i < images.size() && i < labels.size(); ++i) {
+        auto t0 = chrono::steady_clock::now();
+        Rect box = detector.detect(images[i]);
+        times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+
+        s.frames++;
+        double overlap = iou(box, labels[i]);
+        iouSum += overlap;
+        if (overlap >= 0.5) {
+            s.hits++;
+            Point2d d = (Point2d(box.tl()) + Point2d(box.br())) * 0.5 - (Point2d(labels[i].tl()) + Point2d(labels[i].br())) * 0.5;
+            double e = std::sqrt(d.x * d.x + d.y * d.y);
+            centerSum += e;
+            s.maxCenterError = std::max(s.maxCenterError, e);
+        }
+    }
+
+    if (s.frames > 0) {
+        s.meanIoU = iouSum / s.frames;
+        double sum = 0.0;
+        for (double t : times) sum += t;
+        s.meanMs = sum / times.size();
+        sort(times.begin(), times.end());
+        s.p95Ms = times[std::min(times.size() - 1, (size_t)std::ceil(0.95 * times.size()) - 1)];
+    }
+    if (s.hits > 0) s.meanCenterError = centerSum / s.hits;
+    return s;
+}
+
+bool YoloCalibration::run(const CalibrationConfig& cfg, CalibrationReport& report) {
+    report = CalibrationReport();
+
+    YoloDetector fp32(cfg.modelPath), int8(cfg.modelPath);
+    if (fp32.isQuantized()) {
+        cerr << "[Calib] " << cfg.modelPath << " is already quantized, expected an FP32 model" << endl;
+        return false;
+    }
+
+    // 1. 校准集与评估集 (50 倍超采样渲染，每张约数百毫秒)
+    cout << "[Calib] Rendering " << cfg.calibCount << " calibration + " << cfg.evalCount << " evaluation images..." << endl;
+    vector<Mat> calib = simulatedImages(cfg, 0, cfg.calibCount);
+    vector<Rect> labels;
+    vector<Mat> eval = simulatedImages(cfg, cfg.calibCount, cfg.evalCount, &labels);
+
+    // 2. 逐层激活范围 (FP32 网络) 写成校准表，供离线导出 INT8 模型
+    report.ranges = fp32.activationRanges(calib);
+    if (report.ranges.empty()) {
+        cerr << "[Calib] Cannot collect activation ranges from " << cfg.modelPath << endl;
+        return false;
+    }
+    if (!cfg.tablePath.empty()) {
+        if (!writeCalibrationTable(cfg.tablePath, report.ranges)) {
+            cerr << "[Calib] Cannot write " << cfg.tablePath << endl;
+            return false;
+        }
+        cout << "[Calib] Calibration table (" << report.ranges.size() << " tensors) written to " << cfg.tablePath << endl;
+    }
+
+    // 3. 量化 (OpenCV 内存中的 INT8 网络，仅用于对比)
+    auto t0 = chrono::steady_clock::now();
+    report.quantized = int8.quantize(calib);
+    if (!report.quantized) return false;
+    report.quantParams = int8.quantizationSummary();
+    cout << "[Calib] Quantized in " << fixed << setprecision(1)
+        << chrono::duration<double>(chrono::steady_clock::now() - t0).count() << " s: " << report.quantParams << endl;
+
+    // 4. 对比评估
+    report.fp32 = evaluate(fp32, eval, labels);
+    report.int8 = evaluate(int8, eval, labels);
+    printScore(cout, "FP32", report.fp32);
+    printScore(cout, "INT8", report.int8);
+    cout << "[Calib] Speedup: " << fixed << setprecision(2) << report.speedup() << "x" << endl;
+
+    if (!cfg.reportPath.empty() && writeReport(cfg.reportPath, cfg, report)) {
+        cout << "[Calib] Report written to " << cfg.reportPath << endl;
+    }
+    return true;
+}
+
+bool YoloCalibration::writeCalibrationTable(const std::string& path, const std::vector<ActivationRange>& ranges) {
+    ofstream ofs(path, ios::trunc);
+    if (!ofs) return false;
+
+    ofs << setprecision(9) << "{\n";
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        const ActivationRange& r = ranges[i];
+        ofs << "  \"";
+        for (char c : r.tensor) {
+            if (c == '"' || c == '\\') ofs << '\\';
+            ofs << c;
+        }
+        ofs << "\": [" << r.minVal << ", " << r.maxVal << "]" << (i + 1 < ranges.size() ? ",\n" : "\n");
+    }
+    ofs << "}\n";
+    return ofs.good();
+}
+
+bool YoloCalibration::writeReport(const std::string& path, const CalibrationConfig& cfg, const CalibrationReport& report) {
+    ofstream ofs(path, ios::trunc);
+    if (!ofs) return false;
+
+    ofs << "# YOLO INT8 calibration report\n"
+        << "model " << cfg.modelPath << "\n"
+        << "seed " << cfg.seed << "\n"
+        << "calibration images " << cfg.calibCount << " (index 0.." << cfg.calibCount - 1 << ")\n"
+        << "evaluation images " << cfg.evalCount << " (index " << cfg.calibCount << ".." << cfg.calibCount + cfg.evalCount - 1 << ")\n"
+        << "image size " << cfg.imageSize << "\n"
+        << "calibration table " << (cfg.tablePath.empty() ? "-" : cfg.tablePath) << " (" << report.ranges.size() << " tensors)\n"
+        << "quantization " << report.quantParams << "\n\n";
+    printScore(ofs, "FP32", report.fp32);
+    printScore(ofs, "INT8", report.int8);
+    ofs << "speedup " << fixed << setprecision(2) << report.speedup() << "x\n"
+        << "recall delta " << setprecision(4) << report.int8.recall() - report.fp32.recall() << "\n"
+        << "center error delta " << report.int8.meanCenterError - report.fp32.meanCenterError << " px\n";
+    return ofs.good();
+}
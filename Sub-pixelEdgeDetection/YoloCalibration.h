@@ -0,0 +1,80 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "YoloDetector.h"
+
+/**
+ * @struct CalibrationConfig
+ * @brief INT8 量化校准与评估参数。
+ */
+struct CalibrationConfig {
+    std::string modelPath;           // FP32 ONNX 模型
+    int calibCount = 64;             // 校准图像数 (ImageSimulator 生成，序号 0 ~ calibCount-1)
+    int evalCount = 64;              // 评估图像数 (紧接校准序号之后，与校准集不重叠)
+    int imageSize = 640;
+    uint64_t seed = 4242;            // 与训练/验证集 (DatasetConfig 默认 2025/2026) 不同
+    std::string reportPath = "yolo_int8_report.txt";
+    std::string tablePath = "yolo_int8_calibration.json";   // 逐层激活范围校准表 (空则不写)
+};
+
+/**
+ * @struct DetectorScore
+ * @brief 单个模型在评估集上的框精度与延迟。
+ */
+struct DetectorScore {
+    int frames = 0;
+    int hits = 0;                    // IoU >= 0.5 的帧数
+    double meanIoU = 0.0;
+    double meanCenterError = 0.0;    // 命中帧的框中心误差 (像素)
+    double maxCenterError = 0.0;
+    double meanMs = 0.0;
+    double p95Ms = 0.0;
+
+    double recall() const { return frames > 0 ? (double)hits / frames : 0.0; }
+};
+
+/**
+ * @struct CalibrationReport
+ * @brief FP32 与 INT8 的对比结果。
+ */
+struct CalibrationReport {
+    bool quantized = false;
+    std::string quantParams;         // 输入/输出 scale 与 zero point
+    std::vector<ActivationRange> ranges; // FP32 网络逐层激活范围 (写入校准表)
+    DetectorScore fp32;
+    DetectorScore int8;
+    double speedup() const { return int8.meanMs > 0 ? fp32.meanMs / int8.meanMs : 0.0; }
+};
+
+/**
+ * @class YoloCalibration
+ * @brief 用仿真图像对 YOLO 做训练后 INT8 量化，并与 FP32 模型比较框精度和推理延迟。
+ *
+ * 校准与评估图像均由 DatasetGenerator::renderSample 生成 (与训练数据同分布、带真值框)，
+ * 由 seed + 序号确定，报告可复现。OpenCV DNN 内的量化网络 (Net::quantize) 只用于精度/延迟对比，无法写出；
+ * 可部署的产物是校准表：FP32 网络在校准集上的逐层激活范围 (JSON，键为 ONNX 张量名，值为 [min, max]，
+ * 与 onnxruntime 校准表相同)，由离线导出工具据此生成 QDQ 格式的 INT8 模型，YoloDetector 可直接加载。
+ */
+class YoloCalibration {
+public:
+    /**
+     * @brief 执行校准、量化与评估，写出文本报告。
+     * @return bool 模型加载且量化成功时返回 true。
+     */
+    static bool run(const CalibrationConfig& cfg, CalibrationReport& report);
+
+    // 仿真校准集 (序号 [first, first + count))，labels 为对应的真值框
+    static std::vector<cv::Mat> simulatedImages(const CalibrationConfig& cfg, int first, int count,
+        std::vector<cv::Rect>* labels = nullptr);
+
+    // 在带真值框的图像上评估检测器 (每张图先预热一次不计时)
+    static DetectorScore evaluate(YoloDetector& detector, const std::vector<cv::Mat>& images,
+        const std::vector<cv::Rect>& labels);
+
+    static bool writeReport(const std::string& path, const CalibrationConfig& cfg, const CalibrationReport& report);
+
+    // 校准表：{ "<张量名>": [min, max], ... }，首项为网络输入 (模型中的输入张量名)
+    static bool writeCalibrationTable(const std::string& path, const std::vector<ActivationRange>& ranges);
+};
@@ -1,16 +1,95 @@
 #include "YoloDetector.h"
+#include "Utilities.h"
 #include <iostream>
+#include <sstream>
+#include <cfloat>
+#include <fstream>
+#include <iterator>
+#include <set>
 
 using namespace cv;
 using namespace cv::dnn;
 using namespace std;
 
+namespace {
+    // С protobuf ߸ʽ [p, end) ÿֶλص (ֶκ, , ȶ)ʽ󷵻 false
+    template <typename F>
+    bool forEachField(const unsigned char* p, const unsigned char* end, F&& onField) {
+        auto varint = [&](uint64_t& v) {
+            v = 0;
+            for (int shift = 0; p < end && shift < 64; shift += 7) {
+                unsigned char b = *p++;
+                v |= (uint64_t)(b & 0x7F) << shift;
+                if (!(b & 0x80)) return true;
+            }
+            return false;
+            };
+        while (p < end) {
+            uint64_t key, len = 0;
+            if (!varint(key)) return false;
+            int wire = (int)(key & 7);
+            const unsigned char* body = p;
+            if (wire == 0) { if (!varint(len)) return false; len = 0; }
+            else if (wire == 1) len = 8;
+            else if (wire == 5) len = 4;
+            else if (wire == 2) { if (!varint(len)) return false; body = p; }
+            else return false;
+            if (len > (uint64_t)(end - p)) return false;
+            p += len;
+            onField((int)(key >> 3), wire, body, (size_t)len);
+        }
+        return true;
+    }
+
+    // ONNX ͼ (ModelProto.graph = 7GraphProto.input = 11, initializer = 5
+    // ValueInfoProto.name / TensorProto.name ֱΪֶ 1 / 8)ȨسʼҲΪľɵҪų
+    string onnxInputName(const string& modelPath) {
+        ifstream ifs(modelPath, ios::binary);
+        vector<unsigned char> bytes((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+        if (bytes.empty()) return "";
+
+        vector<string> inputs;
+        set<string> initializers;
+        auto nameField = [](const unsigned char* p, size_t n, int field) {
+            string name;
+            forEachField(p, p + n, [&](int f, int wire, const unsigned char* b, size_t len) {
+                if (f == field && wire == 2) name.assign((const char*)b, len);
+                });
+            return name;
+            };
+        forEachField(bytes.data(), bytes.data() + bytes.size(), [&](int f, int wire, const unsigned char* g, size_t n) {
+            if (f != 7 || wire != 2) return;
+            forEachField(g, g + n, [&](int gf, int gwire, const unsigned char* b, size_t len) {
+                if (gwire != 2) return;
+                if (gf == 11) inputs.push_back(nameField(b, len, 1));
+                else if (gf == 5) initializers.insert(nameField(b, len, 8));
+                });
+            });
+        for (const string& name : inputs) {
+            if (!name.empty() && !initializers.count(name)) return name;
+        }
+        return "";
+    }
+}
+
 // 캯
 YoloDetector::YoloDetector(const string& modelPath) {
     try {
         net = readNetFromONNX(modelPath);
         net.setPreferableBackend(DNN_BACKEND_OPENCV);
         net.setPreferableTarget(DNN_TARGET_CPU);
+
+        // ģ͵ Quantize/Dequantize  *Int8 
+        vector<string> types;
+        net.getLayerTypes(types);
+        for (const string& t : types) {
+            if (t.find("Int8") != string::npos || t.find("Quantize") != string::npos) quantized = true;
+        }
+        if (quantized) cout << "[Yolo] INT8 model loaded: " << modelPath << endl;
+
+        // У׼Ӧģеʵ (YOLOv8 Ϊ "images")
+        inputName = onnxInputName(modelPath);
+        if (inputName.empty()) inputName = "images";
     }
     catch (const cv::Exception& e) {
         cerr << "[YoloError] Error loading model: " << e.what() << endl;
@@ -27,44 +106,322 @@ Mat YoloDetector::formatToSquare(const Mat& source) {
     return result;
 }
 
-// ⺯
-cv::Rect YoloDetector::detect(const cv::Mat& image) {
-    if (net.empty()) return Rect(0, 0, 0, 0);
+cv::Mat YoloDetector::to8U(const cv::Mat& image) const {
+    if (image.depth() == CV_8U) return image;
+    int bits = sensorBits;
+    if (bits <= 0) bits = observedBits = Utilities::observedBits(image, observedBits);
+    Mat out;
+    image.convertTo(out, CV_8U, 255.0 / ((1 << bits) - 1));
+    return out;
+}
+
+cv::Mat YoloDetector::makeBlob(const cv::Mat& image) {
+    // ģͰ 3 ͨѵҶͼչΪ 3 ͨblobFromImage  1/255 ֻ 8 λ
+    Mat modelInput = formatToSquare(to8U(image));
+    if (modelInput.channels() == 1) cvtColor(modelInput, modelInput, COLOR_GRAY2BGR);
 
-    // 1. Ԥ
-    Mat modelInput = formatToSquare(image);
     Mat blob;
     // YOLOv8 Ĭ 640x640һ 0-1
-    blobFromImage(modelInput, blob, 1.0 / 255.0, Size(640, 640), Scalar(), true, false);
-    net.setInput(blob);
+    blobFromImage(modelInput, blob, 1.0 / 255.0, Size(inputSize, inputSize), Scalar(), true, false);
+    return blob;
+}
+
+bool YoloDetector::quantize(const std::vector<cv::Mat>& calibImages) {
+    if (net.empty() || calibImages.empty()) return false;
+
+    vector<Mat> blobs;
+    for (const Mat& img : calibImages) blobs.push_back(makeBlob(img));
+
+    try {
+        // У׼ͳƼΧõÿ scale / zero point
+        Net int8Net = net.quantize(blobs, CV_32F, CV_32F, true);
+        if (int8Net.empty()) return false;
+        int8Net.setPreferableBackend(DNN_BACKEND_OPENCV);
+        int8Net.setPreferableTarget(DNN_TARGET_CPU);
+        net = int8Net;
+        quantized = true;
+    }
+    catch (const cv::Exception& e) {
+        cerr << "[YoloError] Quantization failed: " << e.what() << endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<ActivationRange> YoloDetector::activationRanges(const std::vector<cv::Mat>& calibImages) {
+    vector<ActivationRange> ranges;
+    if (net.empty() || quantized || calibImages.empty()) return ranges;
+
+    vector<string> names = net.getLayerNames();
+    ActivationRange input;
+    input.tensor = inputName;
+    input.minVal = FLT_MAX;
+    input.maxVal = -FLT_MAX;
+    vector<ActivationRange> layers(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        layers[i].tensor = names[i];
+        layers[i].minVal = FLT_MAX;
+        layers[i].maxVal = -FLT_MAX;
+    }
+
+    auto accumulate = [](const Mat& m, ActivationRange& r) {
+        if (m.depth() != CV_32F || !m.isContinuous()) return;
+        const float* p = m.ptr<float>();
+        for (size_t k = 0, n = m.total() * m.channels(); k < n; ++k) {
+            r.minVal = std::min(r.minVal, p[k]);
+            r.maxVal = std::max(r.maxVal, p[k]);
+        }
+        };
+
+    try {
+        for (const Mat& img : calibImages) {
+            Mat blob = makeBlob(img);
+            accumulate(blob, input);
+            net.setInput(blob);
+            vector<vector<Mat>> outputs;
+            net.forward(outputs, names);
+            for (size_t i = 0; i < outputs.size() && i < layers.size(); ++i) {
+                for (const Mat& m : outputs[i]) accumulate(m, layers[i]);
+            }
+        }
+    }
+    catch (const cv::Exception& e) {
+        cerr << "[YoloError] Activation calibration failed: " << e.what() << endl;
+        return ranges;
+    }
+
+    ranges.push_back(input);
+    for (const ActivationRange& r : layers) {
+        if (r.minVal <= r.maxVal) ranges.push_back(r);
+    }
+    return ranges;
+}
+
+std::string YoloDetector::quantizationSummary() const {
+    if (!quantized) return "";
+
+    vector<float> inScales, outScales;
+    vector<int> inZeros, outZeros;
+    try {
+        net.getInputDetails(inScales, inZeros);
+        net.getOutputDetails(outScales, outZeros);
+    }
+    catch (const cv::Exception&) {
+        return "input/output details unavailable";
+    }
+
+    ostringstream ss;
+    for (size_t i = 0; i < inScales.size() && i < inZeros.size(); ++i)
+        ss << "input[" << i << "] scale=" << inScales[i] << " zp=" << inZeros[i] << "; ";
+    for (size_t i = 0; i < outScales.size() && i < outZeros.size(); ++i)
+        ss << "output[" << i << "] scale=" << outScales[i] << " zp=" << outZeros[i] << "; ";
+    return ss.str();
+}
+
+void YoloDetector::setInputSize(int size) {
+    inputSize = std::max(32, size / 32 * 32);
+    if (tileMark > 0) setTiling(tileMark);
+}
+
+bool YoloDetector::setTiling(int markSize) {
+    tileOverlap = tileMark = 0;
+    if (markSize <= 0) return true;
+
+    //  = inputSize - ص 32 (ʧ)
+    int overlap = markSize + WaferConfig::YOLO_TILE_MARGIN;
+    if (inputSize - overlap < 32) {
+        cerr << "[YoloError] Tile size " << inputSize << " cannot hold a " << markSize
+            << " px mark (needs >= " << overlap + 32 << "), tiling disabled" << endl;
+        return false;
+    }
+    tileOverlap = overlap;
+    tileMark = markSize;
+    loggedFrame = Size();
+    cout << "[Yolo] Tiling " << inputSize << " px tiles, stride " << inputSize - overlap << " px (mark " << markSize
+        << " px), at most " << WaferConfig::YOLO_MAX_TILES << " tiles per frame" << endl;
+    return true;
+}
+
+std::vector<cv::Rect> YoloDetector::tileLayout(cv::Size frame) const {
+    int tile = inputSize;
+    if (tileOverlap <= 0 || (frame.width <= tile && frame.height <= tile)) return vector<Rect>{ Rect(Point(0, 0), frame) };
+
+    int stride = tile - tileOverlap;
+    auto starts = [&](int length) {
+        vector<int> s;
+        if (length <= tile) return vector<int>{ 0 };
+        for (int p = 0; p + tile < length; p += stride) s.push_back(p);
+        s.push_back(length - tile);
+        return s;
+        };
+    vector<Rect> tiles;
+    for (int y : starts(frame.height))
+        for (int x : starts(frame.width))
+            tiles.push_back(Rect(x, y, std::min(tile, frame.width - x), std::min(tile, frame.height - y)));
+    return tiles;
+}
+
+double YoloDetector::imageScale(const cv::Mat& image) const {
+    int longSide = std::max(image.cols, image.rows);
+    if (longSide <= inputSize) return 1.0;
+    if (tileOverlap > 0 && tileCount(image.size()) <= WaferConfig::YOLO_MAX_TILES) return 1.0;
+    return (double)longSide / inputSize;
+}
+
+// ⺯
+cv::Rect YoloDetector::detect(const cv::Mat& image, float* confidence) {
+    if (confidence) *confidence = 0.f;
+    vector<Detection> detections = detectAll(image);
+    if (detections.empty()) {
+        return Rect(0, 0, 0, 0);
+    }
+
+    // ѽ (Ŷߵһ)
+    // ֱӷ Rect Localization.cpp еת
+    if (confidence) *confidence = detections[0].confidence;
+    return detections[0].box;
+}
+
+std::vector<Detection> YoloDetector::detectAll(const cv::Mat& image) {
+    if (net.empty()) return vector<Detection>();
+    if (tileOverlap > 0 && (image.cols > inputSize || image.rows > inputSize)) {
+        int count = tileCount(image.size());
+        bool tiled = count <= WaferConfig::YOLO_MAX_TILES;
+        if (image.size() != loggedFrame) {
+            loggedFrame = image.size();
+            cout << "[Yolo] " << image.cols << "x" << image.rows << " frame: " << count << " tiles";
+            if (!tiled) cout << " exceeds " << WaferConfig::YOLO_MAX_TILES << ", using one downscaled full-frame pass";
+            cout << endl;
+        }
+        if (tiled) return detectTiled(image);
+    }
+
+    // 1. Ԥ (letterbox α߳ڻԭ)
+    int squareSize = std::max(image.cols, image.rows);
+    net.setInput(makeBlob(image));
 
     // 2. 
     vector<Mat> outputs;
     net.forward(outputs, net.getUnconnectedOutLayersNames());
 
-    // 3.  ( YOLOv8 [1, 84, 8400] ʽ)
-    Mat outputData = outputs[0];
-    int dimensions = outputData.size[2];
-    int rows = outputData.size[1];
+    // 3.  ( YOLOv8 [1, 84, N] ʽ640 ʱ N = 8400)
+    vector<int> class_ids;
+    vector<float> confidences;
+    vector<Rect> boxes;
+    Mat& out = outputs[0];
+    parseOutput(Mat(out.size[1], out.size[2], CV_32F, out.data), (float)squareSize / inputSize, Point(0, 0),
+        boxes, confidences, class_ids);
 
-    // άתô (ȷ outputData  [8400 x 84])
-    if (dimensions > rows) {
-        outputData = outputData.reshape(1, rows);
-        cv::transpose(outputData, outputData);
-    }
-    else {
-        outputData = outputData.reshape(1, dimensions);
-    }
+    // 4. NMS (Ǽֵ)
+    return suppress(boxes, confidences, class_ids);
+}
 
-    float* data = (float*)outputData.data;
-    float x_factor = (float)modelInput.cols / 640.0f;
-    float y_factor = (float)modelInput.rows / 640.0f;
+std::vector<Detection> YoloDetector::detectTiled(const cv::Mat& image) {
+    if (net.empty()) return vector<Detection>();
 
+    // 1. п飺 inputSize - overlap (setTiling ѱ֤ >= 32)һͼԵ inputSize һ߲
+    int tile = inputSize;
+    vector<Rect> tiles = tileLayout(image.size());
+
+    Mat color = to8U(image);
+    if (color.channels() == 1) cvtColor(color, color, COLOR_GRAY2BGR);
+
+    // 2. ǰ (ÿ YOLO_TILE_BATCH ) [B, 84, N]
     vector<int> class_ids;
     vector<float> confidences;
     vector<Rect> boxes;
+    vector<Detection> cutBoxes;
+    const Rect frame(0, 0, image.cols, image.rows);
+    for (size_t b0 = 0; b0 < tiles.size(); b0 += WaferConfig::YOLO_TILE_BATCH) {
+        size_t b1 = std::min(tiles.size(), b0 + WaferConfig::YOLO_TILE_BATCH);
+        vector<Mat> batch;
+        for (size_t t = b0; t < b1; ++t) {
+            Mat patch = color(tiles[t]);
+            if (patch.cols < tile || patch.rows < tile) {
+                copyMakeBorder(patch, patch, 0, tile - patch.rows, 0, tile - patch.cols, BORDER_CONSTANT, Scalar::all(0));
+            }
+            batch.push_back(patch);
+        }
 
-    //  Anchors (ͨ 8400 )
+        Mat blob;
+        blobFromImages(batch, blob, 1.0 / 255.0, Size(tile, tile), Scalar(), true, false);
+        net.setInput(blob);
+        vector<Mat> outputs;
+        net.forward(outputs, net.getUnconnectedOutLayersNames());
+
+        Mat& out = outputs[0];
+        size_t plane = (size_t)out.size[1] * out.size[2];
+        for (size_t t = b0; t < b1; ++t) {
+            vector<Rect> tileBoxes;
+            vector<float> tileConf;
+            vector<int> tileCls;
+            parseOutput(Mat(out.size[1], out.size[2], CV_32F, (float*)out.data + (t - b0) * plane), 1.0f,
+                tiles[t].tl(), tileBoxes, tileConf, tileCls);
+
+            // 3. ӷ촦ſڲ߽ (Ҹñ߲ͼ߽) ĿǱضϵģռϲ
+            const Rect& r = tiles[t];
+            for (size_t k = 0; k < tileBoxes.size(); ++k) {
+                Rect box = tileBoxes[k] & frame;
+                bool cut = (box.x <= r.x + 1 && r.x > 0) || (box.y <= r.y + 1 && r.y > 0) ||
+                    (box.br().x >= r.br().x - 1 && r.br().x < frame.width) ||
+                    (box.br().y >= r.br().y - 1 && r.br().y < frame.height);
+                if (cut) {
+                    cutBoxes.push_back({ box, tileConf[k], tileCls[k] });
+                    continue;
+                }
+                boxes.push_back(box);
+                confidences.push_back(tileConf[k]);
+                class_ids.push_back(tileCls[k]);
+            }
+        }
+    }
+
+    // 4. ͬһڿеĽضƬλص (ص)ȡԭŶȡ
+    for (size_t i = 0; i < cutBoxes.size(); ++i) {
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            for (size_t j = i + 1; j < cutBoxes.size(); ++j) {
+                if (cutBoxes[j].classId != cutBoxes[i].classId || (cutBoxes[i].box & cutBoxes[j].box).area() == 0) continue;
+                cutBoxes[i].box |= cutBoxes[j].box;
+                cutBoxes[i].confidence = std::max(cutBoxes[i].confidence, cutBoxes[j].confidence);
+                cutBoxes.erase(cutBoxes.begin() + j);
+                merged = true;
+                break;
+            }
+        }
+    }
+
+    // ϲƬδ󲿷ĳ (ñѱһ) ʱΪѡ NMS
+    size_t fullCount = boxes.size();
+    for (const Detection& d : cutBoxes) {
+        bool covered = false;
+        for (size_t k = 0; k < fullCount && !covered; ++k) {
+            covered = (d.box & boxes[k]).area() >= 0.7 * d.box.area();
+        }
+        if (covered) continue;
+        boxes.push_back(d.box);
+        confidences.push_back(d.confidence);
+        class_ids.push_back(d.classId);
+    }
+
+    // 5. ȫ NMSϲصڱͬʱͬһ
+    return suppress(boxes, confidences, class_ids);
+}
+
+void YoloDetector::parseOutput(cv::Mat outputData, float scale, cv::Point offset,
+    std::vector<cv::Rect>& boxes, std::vector<float>& confidences, std::vector<int>& class_ids) {
+    // άתô (ȷ outputData  [N x 84])
+    if (outputData.cols > outputData.rows) {
+        cv::transpose(outputData, outputData);
+    }
+    else if (!outputData.isContinuous()) {
+        outputData = outputData.clone();
+    }
+
+    float* data = (float*)outputData.data;
+
+    //  Anchors
     for (int i = 0; i < outputData.rows; ++i) {
         float* classes_scores = data + 4;
         Mat scores(1, outputData.cols - 4, CV_32FC1, classes_scores);
@@ -78,11 +435,11 @@ cv::Rect YoloDetector::detect(const cv::Mat& image) {
             float w = data[2];
             float h = data[3];
 
-            // ԭ ( square input)
-            int left = int((x - 0.5 * w) * x_factor);
-            int top = int((y - 0.5 * h) * y_factor);
-            int width = int(w * x_factor);
-            int height = int(h * y_factor);
+            // ԭ ( square input / Ͻ)
+            int left = int((x - 0.5 * w) * scale) + offset.x;
+            int top = int((y - 0.5 * h) * scale) + offset.y;
+            int width = int(w * scale);
+            int height = int(h * scale);
 
             boxes.push_back(Rect(left, top, width, height));
             confidences.push_back((float)max_class_score);
@@ -90,16 +447,17 @@ cv::Rect YoloDetector::detect(const cv::Mat& image) {
         }
         data += outputData.cols;
     }
+}
 
-    // 4. NMS (Ǽֵ)
+std::vector<Detection> YoloDetector::suppress(const std::vector<cv::Rect>& boxes, const std::vector<float>& confidences,
+    const std::vector<int>& class_ids) {
+    // NMS ѰŶȽ
     vector<int> nms_result;
     NMSBoxes(boxes, confidences, 0.45, 0.45, nms_result);
 
-    if (nms_result.empty()) {
-        return Rect(0, 0, 0, 0);
+    vector<Detection> detections;
+    for (int idx : nms_result) {
+        detections.push_back({ boxes[idx], confidences[idx], class_ids[idx] });
     }
-
-    // 5. ѽ (Ŷߵһ)
-    // ֱӷ Rect Localization.cpp еת
-    return boxes[nms_result[0]];
-}
\ No newline at end of file
+    return detections;
+}
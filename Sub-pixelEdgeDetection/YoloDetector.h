@@ -3,20 +3,101 @@
 #include <opencv2/dnn.hpp>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include "WaferConfig.h"
+
+// У׼ϵļΧ (FP32)
+struct ActivationRange {
+    std::string tensor;              //  (OpenCV  ONNX ʱýڵ)
+    float minVal = 0.f, maxVal = 0.f;
+};
+
+//  (ԭͼ)
+struct Detection {
+    cv::Rect box;
+    float confidence = 0.f;
+    int classId = 0;
+};
 
 class YoloDetector {
 public:
     // 캯 ONNX ģ
+    // FP32 ģ INT8 ģ (QDQ/QLinear ʽ onnxruntime quantize_static ) ֱӼ
     YoloDetector(const std::string& modelPath);
 
+    // У׼ͼѵ̬ (ͨ INT8 Ȩأ/ FP32)ɹ󱾼 INT8 
+    bool quantize(const std::vector<cv::Mat>& calibImages);
+
+    // ǷΪ INT8 (صģͻ quantize() ֮)
+    bool isQuantized() const { return quantized; }
+
+    //  FP32 ͳУ׼ͼļΧ ( quantize ʹͬԤ)
+    // дУ׼ߵ ( onnxruntime quantize_static) ɿɲ INT8 ģͣʱؿ
+    // һΪ룬ȡ ONNX ͼ ( YOLOv8  "images")
+    std::vector<ActivationRange> activationRanges(const std::vector<cv::Mat>& calibImages);
+
+    // ժҪ (/ scale  zero point)δʱΪ
+    std::string quantizationSummary() const;
+
+    // ߳ (Ĭ 640Ϊ 32 ı)СѵߴʱԶ̬뵼 ONNX
+    // ֶλֻҪѡ򣬿 320 ȽС뻻ȡԼ 4 ٶ
+    // ѿֿʱ³ߴŲ±رշֿ ( setTiling)
+    void setInputSize(int size);
+    int getInputSize() const { return inputSize; }
+
+    // 16 λ֡Чλǰ 2^bits - 1 ŵ 8 λѵ (0-255 / 255) һ
+    // bits <= 0 (Ĭ) ʾδ֪֡Ҷƶ (Utilities::observedBits)ٶ 16 λ
+    void setSensorBits(int bits) { sensorBits = (bits <= 0) ? 0 : std::max(9, std::min(16, bits)); }
+
+    // ű (ÿضӦԭͼ)ͼ letterbox ʱΪ  / inputSizeֿʱΪ 1
+    double imageScale(const cv::Mat& image) const;
+
+    // ֿߴͼ inputSize ԭֱгص飬ǰӳͼ겢ȫ NMS
+    // Сǲͼŵ 640 ʧɱ̶
+    // markSize: б (ע) ı߳䷽ waferSizeصȡ markSize + YOLO_TILE_MARGIN
+    // ֤һĳһڡ (inputSize) Ų±ʱܾ false
+    // markSize <= 0 ر (ĬϹرգͼ letterbox ŵ inputSize)
+    //  = ceil((W - overlap) / ) x ceil((H - overlap) / ) = inputSize - overlap
+    //  YOLO_MAX_TILES ֡˻ͼ (ǰ)ÿ֡ߴ״γʱӡ
+    bool setTiling(int markSize);
+    bool isTiled() const { return tileOverlap > 0; }
+    // óߴ֡ǰֿҪĿ (δֿ򲻳 inputSize ʱΪ 1)
+    int tileCount(cv::Size frame) const { return (int)tileLayout(frame).size(); }
+
+    //  NMS ȫ򣬰ŶȽ
+    // ֿͼһ߳ inputSize ʱ detectTiled
+    std::vector<Detection> detectAll(const cv::Mat& image);
+    std::vector<Detection> detectTiled(const cv::Mat& image);
+
     // ⺯Ŷȵ (Best Box)
     // δ⵽ؿ Rect(0,0,0,0)
     // һĶ޸ "cannot convert std::vector<Detection> to cv::Rect" ı
-    cv::Rect detect(const cv::Mat& image);
+    // confidence: ѡѿŶ (δ⵽Ϊ 0)
+    cv::Rect detect(const cv::Mat& image, float* confidence = nullptr);
 
 private:
     cv::dnn::Net net;
+    int inputSize = 640;
+    bool quantized = false;
+    std::string inputName;        // ONNX ͼ (ʱ YOLOv8 ȡ "images")
+    int tileOverlap = 0;
+    int tileMark = 0;
+    cv::Size loggedFrame;         // Ѵӡ֡ߴ
+    int sensorBits = 0;           // 0 = δ֪֡ƶ
+    mutable int observedBits = 0;
 
+    // 鲼֣ inputSize - overlapһͼԵ
+    std::vector<cv::Rect> tileLayout(cv::Size frame) const;
     // ԤLetterbox (ֳ)
     cv::Mat formatToSquare(const cv::Mat& source);
+    // 16 λ֡ŵ 8 λ (8 λ֡ԭ)
+    cv::Mat to8U(const cv::Mat& image) const;
+    // Ԥ + blobFromImage (У׼)
+    cv::Mat makeBlob(const cv::Mat& image);
+    // ͼ ([84, N]  [N, 84]) * scale + offset ԭͼ
+    void parseOutput(cv::Mat output, float scale, cv::Point offset,
+        std::vector<cv::Rect>& boxes, std::vector<float>& confidences, std::vector<int>& classIds);
+    // ȫ NMSŶȽ
+    static std::vector<Detection> suppress(const std::vector<cv::Rect>& boxes, const std::vector<float>& confidences,
+        const std::vector<int>& classIds);
 };
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <string>
 #include <iomanip>
 #include <numeric>
+#include <algorithm>
+#include <cmath>
 #include <opencv2/opencv.hpp>
 #include <direct.h> // 用于创建文件夹 (_mkdir)
 
@@ -12,6 +14,12 @@
 #include "SubPixelModel.h"
 #include "Utilities.h"
 #include "WaferConfig.h" // 引入配置
+#include "DatasetGenerator.h"
+#include "BufferPool.h"
+#include "BatchProcessor.h"
+#include "MeasurementDaemon.h"
+#include "YoloCalibration.h"
+#include "ParetoHarness.h"
 
 using namespace std;
 using namespace cv;
@@ -241,15 +249,13 @@ void TraditionalMethodTest() {
     cout << "================================================================================" << endl;
 
     ImageSimulator simulator;
-    Localization localization;
+    BatchProcessor processor;   // 内含标准模板与定位器，与批量/分片模式共用同一测量代码
 
     string saveDir = "TestImages";
     _mkdir(saveDir.c_str());
 
-    // 1. 生成标准模板 (无偏移)
+    // 1. 生成标准模板 (无偏移，由 BatchProcessor 构造时完成)
     cout << "[Init] Generating Standard Template..." << endl;
-    Mat templateImg = simulator.generateWaferImage(WaferConfig::WAFER_SIZE, 0, 0, 0, 0);
-    localization.createTemplate(templateImg, Rect(0, 0, 0, 0));
 
     // 2. 构建系统性测试用例 (模拟论文中的验证集)
     vector<TestCase> testCases;
@@ -277,8 +283,13 @@ void TraditionalMethodTest() {
     testCases.push_back({ 1.50, 1.50, "Large Shift" });
 
     int numTests = testCases.size();
-    int successCount = 0;
-    double maxError = 0.0;
+    BatchStats stats;
+
+    // 逐帧结果另存为二进制日志 (可用 --export-csv 导出)，每次运行重新生成
+    string logPath = saveDir + "/results.olog";
+    std::remove(logPath.c_str());
+    ResultLog log;
+    log.open(logPath);
 
     cout << "\n[Start Testing] Running " << numTests << " systematic tests..." << endl;
     cout << setfill('-') << setw(110) << "-" << setfill(' ') << endl;
@@ -296,27 +307,18 @@ void TraditionalMethodTest() {
         string filename = saveDir + "/Case_" + to_string(i) + ".png";
         imwrite(filename, testImg);
 
-        Point coarsePos = localization.coarseLocalization(testImg);
-        Point2d measured = localization.fineLocalization(testImg, coarsePos, SubPixelModel::Sigmoid);
-
-        bool success = (measured.x != -999.0);
-        double errX = 0.0, errY = 0.0;
-        string statusStr = "FAIL";
-
-        if (success) {
-            errX = abs(measured.x - trueShiftX);
-            errY = abs(measured.y - trueShiftY);
-            maxError = max(maxError, max(errX, errY));
+        FrameJob job;
+        job.id = i;
+        job.shiftX = trueShiftX;
+        job.shiftY = trueShiftY;
+        FrameResult result = processor.measure(job, testImg);
+        stats.add(result);
+        if (log.isOpen()) log.write(BatchProcessor::toRecord(result));
 
-            // 严格标准: < 0.05 px
-            if (errX < 0.05 && errY < 0.05) {
-                statusStr = "PASS";
-                successCount++;
-            }
-            else {
-                statusStr = "WARN";
-            }
-        }
+        bool success = (result.status == FRAME_PASS || result.status == FRAME_WARN);
+        Point2d measured = result.measured;
+        double errX = result.errX, errY = result.errY;
+        string statusStr = (result.status == FRAME_PASS) ? "PASS" : (success ? "WARN" : (result.status == FRAME_REJECTED ? "REJECT" : "FAIL"));
 
         cout << "| " << setw(2) << i << " | "
             << setw(16) << left << testCases[i].description << right << " | "
@@ -331,15 +333,9 @@ void TraditionalMethodTest() {
     }
 
     cout << setfill('-') << setw(110) << "-" << setfill(' ') << endl;
-    cout << "\n[Summary] Success: " << successCount << "/" << numTests << endl;
-    cout << "Max Error Observed: " << maxError << " px" << endl;
-
-    if (maxError < 0.05) {
-        cout << ">> SYSTEM VERIFIED: Algorithm matches paper's expected precision on standard steps." << endl;
-    }
-    else {
-        cout << ">> STILL HAS ERROR: Look for patterns in the table above (e.g., is error higher at 0.5?)." << endl;
-    }
+    log.close();
+    stats.printSummary();
+    PooledMatAllocator::instance().printStats();
 
     cout << "\nPress Enter to exit..." << endl;
     cin.get();
@@ -347,8 +343,343 @@ void TraditionalMethodTest() {
     return;
 }
 
+namespace {
+    // 已知边缘位置 center 的合成投影：每个样本为像素 [i-0.5, i+0.5] 内的面积平均，
+    // 边缘为标准差 sigma 的高斯模糊阶跃 (sigma = 0 为理想阶跃)，与测量流水线的位置约定一致
+    vector<double> syntheticEdgeProfile(int length, double center, double sigma, double low, double high) {
+        const int SUB = 50;
+        vector<double> profile(length);
+        for (int i = 0; i < length; ++i) {
+            double sum = 0.0;
+            for (int s = 0; s < SUB; ++s) {
+                double x = i - 0.5 + (s + 0.5) / SUB;
+                double step = (sigma > 0) ? 0.5 * std::erfc(-(x - center) / (sigma * std::sqrt(2.0))) : (x >= center ? 1.0 : 0.0);
+                sum += step;
+            }
+            profile[i] = low + (high - low) * sum / SUB;
+        }
+        return profile;
+    }
+}
+
+/// <summary>
+/// 亚像素模型自检：已知位置的锐利/模糊阶跃 (两种极性) 逐一经过全部 ModelType，
+/// 打印各模型的最大误差，任一模型失败 (-999) 或超差时返回非零。
+/// 近理想阶跃 (sigma < 1) 在像素积分后只剩 1~2 个过渡样本，各模型都有与边缘小数位置相关的固有偏差，容差放宽
+/// 用法: --model-test
+/// </summary>
+int SubPixelModelTest() {
+    cout << "================================================================================" << endl;
+    cout << "   Sub-pixel Model Validation (Synthetic Edge Profiles)    " << endl;
+    cout << "================================================================================" << endl;
+
+    const int length = 41;
+    const double sharpTolerance = 0.25, blurTolerance = 0.1;   // 像素，sigma < 1 / sigma >= 1
+    const vector<double> centers = { 20.0, 20.25, 20.5, 20.75 };
+    const vector<double> sigmas = { 0.0, 0.5, 1.2, 2.0, 3.0 };
+
+    SubPixelModel model;
+    const auto& types = SubPixelModel::allTypes();
+
+    cout << setfill('-') << setw(92) << "-" << setfill(' ') << endl;
+    cout << "| Sigma | Center  |";
+    for (auto type : types) cout << setw(10) << SubPixelModel::typeName(type) << " |";
+    cout << endl;
+    cout << setfill('-') << setw(92) << "-" << setfill(' ') << endl;
+
+    vector<double> worstSharp(types.size(), 0.0), worstBlur(types.size(), 0.0);
+    vector<int> failures(types.size(), 0);
+    for (double sigma : sigmas) {
+        vector<double>& worst = (sigma < 1.0) ? worstSharp : worstBlur;
+        for (double center : centers) {
+            for (int polarity = 0; polarity < 2; ++polarity) {
+                vector<double> profile = polarity ? syntheticEdgeProfile(length, center, sigma, 200.0, 40.0)
+                    : syntheticEdgeProfile(length, center, sigma, 40.0, 200.0);
+                cout << "| " << fixed << setprecision(1) << setw(5) << sigma << " | "
+                    << setprecision(2) << setw(6) << center << (polarity ? "-" : "+") << " |" << setprecision(3);
+                for (size_t t = 0; t < types.size(); ++t) {
+                    double pos = model.calculateEdge(profile, types[t]);
+                    if (pos == -999.0) {
+                        failures[t]++;
+                        cout << setw(10) << "FAIL" << " |";
+                        continue;
+                    }
+                    double err = pos - center;
+                    worst[t] = std::max(worst[t], std::abs(err));
+                    cout << setw(10) << err << " |";
+                }
+                cout << endl;
+            }
+        }
+    }
+
+    cout << setfill('-') << setw(92) << "-" << setfill(' ') << endl;
+    bool pass = true;
+    for (size_t t = 0; t < types.size(); ++t) {
+        bool ok = failures[t] == 0 && worstSharp[t] < sharpTolerance && worstBlur[t] < blurTolerance;
+        pass = pass && ok;
+        cout << "[ModelTest] " << setw(14) << left << SubPixelModel::typeName(types[t]) << right << setprecision(4)
+            << " max |err| sharp = " << worstSharp[t] << " px, blurred = " << worstBlur[t] << " px, failures = " << failures[t]
+            << (ok ? "  PASS" : "  FAIL") << endl;
+    }
+    return pass ? 0 : 1;
+}
+
+
+/// <summary>
+/// 生成 YOLO 训练/验证数据集 (替代旧版 simulator.generateDataset)
+/// 用法: --dataset <datasetRoot> [trainCount] [valCount] [shardIndex] [shardCount]
+/// </summary>
+void GenerateYoloDataset(const string& datasetRoot, int trainCount, int valCount, int shardIndex, int shardCount) {
+    DatasetConfig cfg;
+    cfg.shardIndex = shardIndex;
+    cfg.shardCount = shardCount;
+
+    cfg.numImages = trainCount;
+    cfg.imageDir = datasetRoot + "/train/images";
+    cfg.labelDir = datasetRoot + "/train/labels";
+    DatasetGenerator(cfg).run();
+
+    // 验证集使用不同的种子，避免与训练集重复
+    cfg.numImages = valCount;
+    cfg.seed += 1;
+    cfg.imageDir = datasetRoot + "/val/images";
+    cfg.labelDir = datasetRoot + "/val/labels";
+    DatasetGenerator(cfg).run();
+
+    cout << "Dataset ready, you can start python train.py now." << endl;
+}
+
+
+/// <summary>
+/// 加载 --recipe 配方，并检查清单用到的 recipeId 是否均已注册 (未注册的帧会测量失败)
+/// </summary>
+bool loadManifestRecipes(RecipeRegistry& registry, const vector<string>& specs, const vector<FrameJob>& jobs) {
+    if (!registry.loadSpecs(specs)) return false;
+    vector<int> missing;
+    for (const FrameJob& j : jobs) {
+        if (!registry.find(j.recipeId) && std::find(missing.begin(), missing.end(), j.recipeId) == missing.end()) {
+            missing.push_back(j.recipeId);
+        }
+    }
+    for (int id : missing) {
+        cerr << "[Batch] Manifest uses recipe " << id << " which is not registered (--recipe " << id << "=<path>); its frames will fail" << endl;
+    }
+    return true;
+}
+
+
+/// <summary>
+/// 分片批量测量 (本机多进程代替多节点)
+/// 用法:
+///   --make-manifest <manifest> <count> [seed]         生成随机仿真清单
+///   --batch <manifest> <shards> [workDir]             协调器：启动 shards 个 worker 并合并结果
+///   --worker <manifest> <shardIndex> <shardCount> <statsOut> [resultLog]
+///   --merge <stats1> [stats2 ...]                     合并多节点的分片统计
+///   --export-csv <resultLog> <csv>                    二进制结果日志导出为 CSV
+///   --serve [ringName] [slots] [recipe|-] [yoloModel|-] [cascade|tiled|sparse|pin (可用 + 组合)|-] [sensorBits] [workers]
+///                                                    常驻测量服务 (共享内存收帧)
+///   --make-recipe <recipe> [name]                    生成标准模板并写出配方文件
+///   --client [ringName] [frames] [shutdown]          本地测试客户端 (仿真帧)
+///   --capture-profiles <manifest> <cache>          测量清单中的帧并把 8 条边的投影写入投影缓存
+///   --compare-models <cache>                         对缓存投影用全部 ModelType 重新拟合并比较 (不读图像)
+///   --model-test                                     已知位置的合成阶跃逐一经过全部 ModelType，超差时返回非零
+///   --pareto [framesPerCell] [json] [yoloModel]      各 ModelType x 粗定位方式 x 噪声/对比度 的精度-延迟 Pareto 表
+///   --calibrate-yolo <fp32.onnx> [calibCount] [evalCount] [report] [table]  写出逐层激活校准表，INT8 量化并与 FP32 对比
+///   --load-recipe <ringName> <id=path>               请求运行中的服务加载/替换配方 (后台构建，不打断测量)
+/// 任意命令后可重复 --recipe <id=path> 注册多个配方 (--worker/--batch/--serve/--capture-profiles 按清单或帧的 recipeId 取用)；
+/// 未指定 0 号配方时按 WaferConfig 几何生成。
+/// --bits <n> 指定 16 位帧的有效位数 (如 12 位相机，--worker/--batch/--serve/--capture-profiles)；
+/// 未指定时按帧的实际最大灰度推断满量程，不假定 16 位。
+/// </summary>
+int RunBatchCommand(int argc, char** argv) {
+    // 先取出 --recipe / --bits 选项，其余参数保持原有位置含义
+    vector<string> recipeSpecs;
+    int sensorBits = 0;
+    vector<char*> args;
+    for (int i = 0; i < argc; ++i) {
+        if (string(argv[i]) == "--recipe" && i + 1 < argc) {
+            recipeSpecs.push_back(argv[++i]);
+            continue;
+        }
+        if (string(argv[i]) == "--bits" && i + 1 < argc) {
+            sensorBits = atoi(argv[++i]);
+            continue;
+        }
+        args.push_back(argv[i]);
+    }
+    argc = (int)args.size();
+    argv = args.data();
+    if (argc < 2) return -1;
+
+    string cmd = argv[1];
+
+    if (cmd == "--make-manifest" && argc >= 4) {
+        uint64_t seed = (argc > 4) ? strtoull(argv[4], nullptr, 10) : 2025;
+        vector<FrameJob> jobs = BatchProcessor::simulationManifest(atoi(argv[3]), seed);
+        if (!BatchProcessor::saveManifest(argv[2], jobs)) return 1;
+        cout << "[Batch] Manifest written: " << jobs.size() << " frames -> " << argv[2] << endl;
+        return 0;
+    }
+
+    if (cmd == "--batch" && argc >= 4) {
+        string workDir = (argc > 4) ? argv[4] : "BatchShards";
+        BatchStats merged;
+        bool complete = BatchProcessor::runCoordinator(argv[0], argv[2], atoi(argv[3]), workDir, merged, recipeSpecs, sensorBits);
+        merged.printSummary();
+        return complete ? 0 : 1;
+    }
+
+    if (cmd == "--worker" && argc >= 6) {
+        vector<FrameJob> jobs;
+        if (!BatchProcessor::loadManifest(argv[2], jobs)) return 1;
+        RecipeRegistry registry;
+        if (!loadManifestRecipes(registry, recipeSpecs, jobs)) return 1;
+        ResultLog log;
+        if (argc > 6 && !log.open(argv[6])) return 1;
+        BatchProcessor processor;
+        processor.setRegistry(&registry);
+        processor.setSensorBits(sensorBits);
+        BatchStats stats = processor.runShard(jobs, atoi(argv[3]), atoi(argv[4]), log.isOpen() ? &log : nullptr);
+        log.close();
+        return stats.save(argv[5]) ? 0 : 1;
+    }
+
+    if (cmd == "--merge" && argc >= 3) {
+        BatchStats merged;
+        for (int i = 2; i < argc; ++i) {
+            BatchStats part;
+            if (!part.load(argv[i])) {
+                cerr << "[Batch] Cannot read shard stats: " << argv[i] << endl;
+                return 1;
+            }
+            merged.merge(part);
+        }
+        merged.printSummary();
+        return 0;
+    }
+
+    if (cmd == "--capture-profiles" && argc >= 4) {
+        vector<FrameJob> jobs;
+        if (!BatchProcessor::loadManifest(argv[2], jobs)) return 1;
+        RecipeRegistry registry;
+        if (!loadManifestRecipes(registry, recipeSpecs, jobs)) return 1;
+        ProfileCache cache;
+        BatchProcessor processor;
+        processor.setRegistry(&registry);
+        processor.setSensorBits(sensorBits);
+        processor.captureAll(jobs, cache);
+        return cache.save(argv[3]) ? 0 : 1;
+    }
+
+    if (cmd == "--compare-models" && argc >= 3) {
+        ProfileCache cache;
+        if (!cache.load(argv[2])) return 1;
+        BatchProcessor::compareModels(cache);
+        return 0;
+    }
+
+    if (cmd == "--model-test") {
+        return SubPixelModelTest();
+    }
+
+    if (cmd == "--pareto") {
+        ParetoConfig cfg;
+        if (argc > 2) cfg.framesPerCell = std::max(2, atoi(argv[2]));
+        if (argc > 3 && string(argv[3]) != "-") cfg.jsonPath = argv[3];
+        if (argc > 4) cfg.yoloModel = argv[4];
+        ParetoHarness::run(cfg);
+        return 0;
+    }
+
+    if (cmd == "--export-csv" && argc >= 4) {
+        return ResultLogReader::exportCsv(argv[2], argv[3]) ? 0 : 1;
+    }
+
+    if (cmd == "--serve") {
+        DaemonConfig cfg;
+        if (argc > 2) cfg.ringName = argv[2];
+        if (argc > 3) cfg.slots = std::max(1, atoi(argv[3]));
+        if (argc > 4 && string(argv[4]) != "-") cfg.recipePath = argv[4];
+        if (argc > 5 && string(argv[5]) != "-") cfg.yoloModel = argv[5];
+        if (argc > 6) {
+            string mode = argv[6];
+            cfg.cascade = mode.find("cascade") != string::npos;
+            cfg.tiled = mode.find("tiled") != string::npos;
+            cfg.sparse = mode.find("sparse") != string::npos;
+            cfg.pinThreads = mode.find("pin") != string::npos;
+        }
+        if (argc > 7) cfg.sensorBits = atoi(argv[7]);
+        if (sensorBits > 0) cfg.sensorBits = sensorBits;
+        if (argc > 8) cfg.workers = std::max(1, atoi(argv[8]));
+        cfg.recipes = recipeSpecs;
+        return MeasurementDaemon(cfg).serve();
+    }
+
+    if (cmd == "--make-recipe" && argc >= 3) {
+        string name = (argc > 3) ? argv[3] : "BoxInBox_Default";
+        ImageSimulator simulator;
+        Mat templ = simulator.generateWaferImage(WaferConfig::WAFER_SIZE, 0, 0, 0, 0);
+        if (!RecipeFile::save(argv[2], name, MarkGeometry::fromConfig(), templ)) {
+            cerr << "[Recipe] Cannot write " << argv[2] << endl;
+            return 1;
+        }
+        cout << "[Recipe] Written '" << name << "' -> " << argv[2] << endl;
+        return 0;
+    }
+
+    if (cmd == "--load-recipe" && argc >= 4) {
+        int id = 0;
+        string path;
+        if (!RecipeRegistry::parseSpec(argv[3], id, path)) {
+            cerr << "[Recipe] Expected id=path, got '" << argv[3] << "'" << endl;
+            return 1;
+        }
+        MeasurementClient client;
+        if (!client.connect(argv[2])) return 1;
+        bool ok = client.loadRecipe(id, path);
+        cout << "[Recipe] Plan " << id << (ok ? " loaded by service" : " failed to load") << endl;
+        return ok ? 0 : 1;
+    }
+
+    if (cmd == "--client") {
+        string ringName = (argc > 2) ? argv[2] : DaemonConfig().ringName;
+        int frames = (argc > 3) ? atoi(argv[3]) : 1000;
+        bool shutdown = (argc > 4) && string(argv[4]) == "shutdown";
+        return MeasurementClient::runSimulatedAcquisition(ringName, frames, shutdown);
+    }
+
+    if (cmd == "--calibrate-yolo" && argc >= 3) {
+        CalibrationConfig cfg;
+        cfg.modelPath = argv[2];
+        if (argc > 3) cfg.calibCount = std::max(1, atoi(argv[3]));
+        if (argc > 4) cfg.evalCount = std::max(1, atoi(argv[4]));
+        if (argc > 5) cfg.reportPath = argv[5];
+        if (argc > 6) cfg.tablePath = (string(argv[6]) == "-") ? "" : argv[6];
+        CalibrationReport report;
+        return YoloCalibration::run(cfg, report) ? 0 : 1;
+    }
+
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    // 整帧缓冲 (模拟结果、预处理中间图、匹配结果图、YOLO blob) 经缓冲池循环复用
+    PooledMatAllocator::install();
+
+    if (argc >= 3 && string(argv[1]) == "--dataset") {
+        int trainCount = (argc > 3) ? atoi(argv[3]) : 500;
+        int valCount = (argc > 4) ? atoi(argv[4]) : 100;
+        int shardIndex = (argc > 5) ? atoi(argv[5]) : 0;
+        int shardCount = (argc > 6) ? atoi(argv[6]) : 1;
+        GenerateYoloDataset(argv[2], trainCount, valCount, shardIndex, shardCount);
+        return 0;
+    }
 
-int main() {
+    if (argc >= 2) {
+        int rc = RunBatchCommand(argc, argv);
+        if (rc >= 0) return rc;
+    }
 
     //传统方法
     TraditionalMethodTest();